@@ -6,7 +6,6 @@
 //
 // game-style memory allocator
 //
-// this is a placeholder for a game-style memory allocator
 // using malloc and free is frowned upon in grown-up circles.
 //
 // these functions are poor for the following reasons:
@@ -14,12 +13,121 @@
 // 1) free() has to compute the size of the block to free
 // 2) these functions use heavy weight locks to guard the heap.
 // 3) implementations are quite variable
+//
+// This allocator keeps a free list for each size class of small blocks.
+// Because the caller gives us the size in free(), we do not need a header
+// on each block, we just push the block onto the free list for that size.
+// Small blocks are carved out of large chunks that are never given back to the heap.
+// Large blocks still go to malloc and free.
+//
+// Statistics:
+//
+// We keep counts and high-water marks for each size class and for each "site".
+// A site is a name for the code that is allocating, eg.
+//
+//   allocator::site_scope site("collada");
+//   ... all allocations on this thread are charged to "collada" ...
+//
+// With OCTET_TRACK_ALLOCATIONS, every live block is recorded so that we can
+// charge frees to the right site and report leaks at exit. This is slow, so it
+// is only on by default in debug builds.
+//
+//   allocator::dump_stats(stdout);
+//   allocator::dump_live(stdout);
+
+#ifndef OCTET_TRACK_ALLOCATIONS
+  #ifdef _DEBUG
+    #define OCTET_TRACK_ALLOCATIONS 1
+  #else
+    #define OCTET_TRACK_ALLOCATIONS 0
+  #endif
+#endif
 
 namespace octet {
   class allocator {
+    enum {
+      // all pool blocks are a multiple of this size (and aligned to it, for SSE)
+      granularity = 16,
+
+      // largest block we keep in a pool
+      max_pooled = 512,
+
+      num_classes = max_pooled / granularity,
+
+      // how much memory we grab from the heap at a time
+      chunk_size = 0x10000,
+
+      // maximum number of different allocation sites
+      max_sites = 64,
+    };
+
+    // free blocks are linked together through their first word
+    struct block {
+      block *next;
+    };
+
+    // one of these for each size of block, plus one for large blocks.
+    struct size_class {
+      spin_lock lock;
+      block *free_list;
+      uint8_t *chunk_ptr;
+      uint8_t *chunk_max;
+
+      // statistics (guarded by lock)
+      int num_blocks;
+      int max_blocks;
+      int num_allocs;
+    };
+
+    // statistics for one user of memory (updated atomically)
+    struct site {
+      const char *name;
+      volatile int num_bytes;
+      volatile int max_bytes;
+      volatile int num_allocs;
+      volatile int total_bytes;
+    };
+
+    // a record of a live block, for leak tracking
+    struct live_block {
+      void *ptr;
+      size_t size;
+      int site;
+    };
+
     // singleton state, a bit like an old-world global variable
     struct state_t {
-      int num_bytes;
+      volatile int num_bytes;
+      volatile int max_bytes;
+      size_class classes[num_classes + 1];
+
+      spin_lock site_lock;
+      volatile int num_sites;
+      site sites[max_sites];
+
+      // open-addressed table of live blocks, allocated with ::malloc
+      spin_lock live_lock;
+      live_block *live;
+      unsigned num_live;
+      unsigned max_live;
+
+      state_t() {
+        num_bytes = max_bytes = 0;
+        memset(sites, 0, sizeof(sites));
+        sites[0].name = "other";
+        num_sites = 1;
+        live = 0;
+        num_live = max_live = 0;
+        for (int i = 0; i <= num_classes; ++i) {
+          size_class &sc = classes[i];
+          sc.free_list = 0;
+          sc.chunk_ptr = sc.chunk_max = 0;
+          sc.num_blocks = sc.max_blocks = sc.num_allocs = 0;
+        }
+        if (OCTET_TRACK_ALLOCATIONS) {
+          atexit(report_leaks);
+        }
+      }
     };
 
     static state_t &state() {
@@ -27,28 +135,329 @@ namespace octet {
       return instance;
     }
 
+    // the site that this thread is currently charging allocations to
+    static int &current_site() {
+      static OCTET_THREAD_LOCAL int instance;
+      return instance;
+    }
+
+    // return the size class for a size or -1 if this block is not pooled
+    static int get_class(size_t size) {
+      // note that size 0 becomes a very large number here and goes to malloc
+      return size - 1 < max_pooled ? (int)((size - 1) / granularity) : -1;
+    }
+
+    static void *pool_malloc(int cls) {
+      size_class &sc = state().classes[cls];
+      sc.lock.lock();
+      block *res = sc.free_list;
+      if (res) {
+        sc.free_list = res->next;
+      } else {
+        size_t block_size = (cls + 1) * granularity;
+        if (sc.chunk_ptr + block_size > sc.chunk_max) {
+          // get a new chunk from the heap and align it.
+          // the remains of the old chunk are lost, but this is rare.
+          uint8_t *chunk = (uint8_t*)::malloc(chunk_size + granularity);
+          sc.chunk_ptr = (uint8_t*)(((intptr_t)chunk + granularity - 1) & -(intptr_t)granularity);
+          sc.chunk_max = sc.chunk_ptr + chunk_size;
+        }
+        res = (block*)sc.chunk_ptr;
+        sc.chunk_ptr += block_size;
+      }
+      sc.num_allocs++;
+      if (++sc.num_blocks > sc.max_blocks) sc.max_blocks = sc.num_blocks;
+      sc.lock.unlock();
+      return (void*)res;
+    }
+
+    static void pool_free(int cls, void *ptr) {
+      size_class &sc = state().classes[cls];
+      sc.lock.lock();
+      block *b = (block*)ptr;
+      b->next = sc.free_list;
+      sc.free_list = b;
+      sc.num_blocks--;
+      sc.lock.unlock();
+    }
+
+    // large blocks go to the heap, but we still count them
+    static void *heap_malloc(size_t size) {
+      size_class &sc = state().classes[num_classes];
+      void *res = ::malloc(size);
+      sc.lock.lock();
+      sc.num_allocs++;
+      if (++sc.num_blocks > sc.max_blocks) sc.max_blocks = sc.num_blocks;
+      sc.lock.unlock();
+      return res;
+    }
+
+    static void heap_free(void *ptr) {
+      size_class &sc = state().classes[num_classes];
+      ::free(ptr);
+      sc.lock.lock();
+      sc.num_blocks--;
+      sc.lock.unlock();
+    }
+
+    static void add_bytes(int site_index, int bytes, int allocs) {
+      state_t &st = state();
+      atomic::max(&st.max_bytes, atomic::add(&st.num_bytes, bytes));
+      site &s = st.sites[site_index];
+      atomic::add(&s.num_allocs, allocs);
+      if (bytes > 0) atomic::add(&s.total_bytes, bytes);
+      if (OCTET_TRACK_ALLOCATIONS) {
+        atomic::max(&s.max_bytes, atomic::add(&s.num_bytes, bytes));
+      }
+    }
+
+    // live block table: linear probing with backward shift deletion (no tombstones)
+    static unsigned live_hash(void *ptr, unsigned mask) {
+      uintptr_t h = (uintptr_t)ptr / granularity;
+      return (unsigned)(h ^ (h >> 13)) * 0x9e3779b1u & mask;
+    }
+
+    static void live_insert(state_t &st, void *ptr, size_t size, int site) {
+      if (st.num_live * 2 >= st.max_live) {
+        live_block *old = st.live;
+        unsigned old_max = st.max_live;
+        st.max_live = old_max ? old_max * 2 : 1024;
+        st.live = (live_block*)::malloc(sizeof(live_block) * st.max_live);
+        memset(st.live, 0, sizeof(live_block) * st.max_live);
+        st.num_live = 0;
+        for (unsigned i = 0; i != old_max; ++i) {
+          if (old[i].ptr) live_insert(st, old[i].ptr, old[i].size, old[i].site);
+        }
+        ::free(old);
+      }
+      unsigned mask = st.max_live - 1;
+      unsigned i = live_hash(ptr, mask);
+      while (st.live[i].ptr) i = (i + 1) & mask;
+      st.live[i].ptr = ptr;
+      st.live[i].size = size;
+      st.live[i].site = site;
+      st.num_live++;
+    }
+
+    // remove a block and return the site it was charged to
+    static int live_erase(state_t &st, void *ptr) {
+      if (!st.max_live) return 0;
+      unsigned mask = st.max_live - 1;
+      unsigned i = live_hash(ptr, mask);
+      while (st.live[i].ptr != ptr) {
+        if (!st.live[i].ptr) return 0;
+        i = (i + 1) & mask;
+      }
+      int site = st.live[i].site;
+      st.num_live--;
+      // shift later entries back into the hole
+      for (unsigned j = (i + 1) & mask; st.live[j].ptr; j = (j + 1) & mask) {
+        unsigned k = live_hash(st.live[j].ptr, mask);
+        if (((j - k) & mask) >= ((j - i) & mask)) {
+          st.live[i] = st.live[j];
+          i = j;
+        }
+      }
+      st.live[i].ptr = 0;
+      return site;
+    }
+
+    static void track(void *ptr, size_t size, int site) {
+      state_t &st = state();
+      st.live_lock.lock();
+      live_insert(st, ptr, size, site);
+      st.live_lock.unlock();
+    }
+
+    static int untrack(void *ptr) {
+      state_t &st = state();
+      st.live_lock.lock();
+      int site = live_erase(st, ptr);
+      st.live_lock.unlock();
+      return site;
+    }
+
+    static void print_live(void *context, void *ptr, size_t size, const char *site) {
+      fprintf((FILE*)context, "  %p %8d %s\n", ptr, (int)size, site);
+    }
+
+    static void report_leaks() {
+      if (state().num_live) {
+        printf("allocator: %d blocks still allocated at exit\n", state().num_live);
+        dump_live(stdout);
+      }
+    }
+
   public:
-    // todo: implement this from scratch using a pool allocator
     static void *malloc(size_t size) {
-      state().num_bytes += size;
-      void *res = ::malloc(size);
-      //printf("malloc %p[%d] -> %d\n", res, size, state().num_bytes);
+      int cls = get_class(size);
+      void *res = cls >= 0 ? pool_malloc(cls) : heap_malloc(size);
+      int site = current_site();
+      add_bytes(site, (int)size, 1);
+      if (OCTET_TRACK_ALLOCATIONS) track(res, size, site);
       return res;
     }
 
+    // note: size must be the same as the size passed to malloc()
     static void free(void *ptr, size_t size) {
-      state().num_bytes -= size;
-      //printf("free %p[%d] -> %d\n", ptr, size, state().num_bytes);
-      return ::free(ptr);
+      if (!ptr) return;
+      int site = OCTET_TRACK_ALLOCATIONS ? untrack(ptr) : 0;
+      add_bytes(site, -(int)size, 0);
+      int cls = get_class(size);
+      if (cls >= 0) {
+        pool_free(cls, ptr);
+      } else {
+        heap_free(ptr);
+      }
     }
 
     static void *realloc(void *ptr, size_t old_size, size_t size) {
-      state().num_bytes += size - old_size;
-      void *res = ::realloc(ptr, size);
-      //printf("realloc %p[%d] -> %p[%d] %d\n", ptr, old_size, res, size, state().num_bytes);
+      if (!ptr) return malloc(size);
+
+      // the block stays charged to its original site.
+      // untrack before freeing so that another thread can not reuse the block first.
+      int site = OCTET_TRACK_ALLOCATIONS ? untrack(ptr) : current_site();
+
+      int old_cls = get_class(old_size);
+      int cls = get_class(size);
+      void *res;
+      if (old_cls == -1 && cls == -1) {
+        // both on the heap
+        res = ::realloc(ptr, size);
+      } else if (old_cls == cls) {
+        // same size class: nothing to do
+        res = ptr;
+      } else {
+        // moving to or from a pool
+        res = cls >= 0 ? pool_malloc(cls) : heap_malloc(size);
+        memcpy(res, ptr, old_size < size ? old_size : size);
+        if (old_cls >= 0) {
+          pool_free(old_cls, ptr);
+        } else {
+          heap_free(ptr);
+        }
+      }
+
+      add_bytes(site, (int)size - (int)old_size, 0);
+      if (OCTET_TRACK_ALLOCATIONS) track(res, size, site);
       return res;
     }
 
+    // return the index of a named site, adding it if necessary.
+    static int get_site(const char *name) {
+      state_t &st = state();
+      st.site_lock.lock();
+      int i = 0;
+      while (i != st.num_sites && st.sites[i].name != name && strcmp(st.sites[i].name, name)) {
+        ++i;
+      }
+      if (i == st.num_sites) {
+        if (i == max_sites) {
+          i = 0;
+        } else {
+          st.sites[i].name = name;
+          st.num_sites = i + 1;
+        }
+      }
+      st.site_lock.unlock();
+      return i;
+    }
+
+    // charge allocations on this thread to a named site until the end of the scope.
+    // note: the name must be a string constant.
+    class site_scope {
+      int old_site;
+    public:
+      site_scope(const char *name) {
+        old_site = current_site();
+        current_site() = get_site(name);
+      }
+
+      ~site_scope() {
+        current_site() = old_site;
+      }
+    };
+
+    // statistics for a size class. the last class is for large blocks.
+    struct class_stats {
+      int block_size;  // 0 for large blocks
+      int num_blocks;
+      int max_blocks;
+      int num_allocs;
+    };
+
+    // statistics for a site. num_bytes and max_bytes need OCTET_TRACK_ALLOCATIONS
+    struct site_stats {
+      const char *name;
+      int num_bytes;
+      int max_bytes;
+      int num_allocs;
+      int total_bytes;
+    };
+
+    static int get_num_bytes() { return state().num_bytes; }
+    static int get_max_bytes() { return state().max_bytes; }
+    static int get_num_classes() { return num_classes + 1; }
+    static int get_num_sites() { return state().num_sites; }
+
+    static class_stats get_class_stats(int cls) {
+      size_class &sc = state().classes[cls];
+      sc.lock.lock();
+      class_stats res = {
+        cls == num_classes ? 0 : (cls + 1) * granularity,
+        sc.num_blocks, sc.max_blocks, sc.num_allocs
+      };
+      sc.lock.unlock();
+      return res;
+    }
+
+    static site_stats get_site_stats(int index) {
+      site &s = state().sites[index];
+      site_stats res = { s.name, s.num_bytes, s.max_bytes, s.num_allocs, s.total_bytes };
+      return res;
+    }
+
+    // print a summary of memory use
+    static void dump_stats(FILE *file) {
+      fprintf(file, "allocator: %d bytes (max %d)\n", get_num_bytes(), get_max_bytes());
+      fprintf(file, "  size    blocks       max    allocs\n");
+      for (int i = 0; i != get_num_classes(); ++i) {
+        class_stats cs = get_class_stats(i);
+        if (!cs.num_allocs) continue;
+        if (cs.block_size) {
+          fprintf(file, "%6d %9d %9d %9d\n", cs.block_size, cs.num_blocks, cs.max_blocks, cs.num_allocs);
+        } else {
+          fprintf(file, " large %9d %9d %9d\n", cs.num_blocks, cs.max_blocks, cs.num_allocs);
+        }
+      }
+      fprintf(file, "  site                    bytes       max    allocs     total\n");
+      for (int i = 0; i != get_num_sites(); ++i) {
+        site_stats ss = get_site_stats(i);
+        fprintf(file, "  %-20s %9d %9d %9d %9d\n", ss.name, ss.num_bytes, ss.max_bytes, ss.num_allocs, ss.total_bytes);
+      }
+    }
+
+    // call fn for every live block (needs OCTET_TRACK_ALLOCATIONS)
+    // note: fn must not allocate memory.
+    static void for_each_live(void (*fn)(void *context, void *ptr, size_t size, const char *site), void *context) {
+      state_t &st = state();
+      st.live_lock.lock();
+      for (unsigned i = 0; i != st.max_live; ++i) {
+        live_block &b = st.live[i];
+        if (b.ptr) {
+          fn(context, b.ptr, b.size, st.sites[b.site].name);
+        }
+      }
+      st.live_lock.unlock();
+    }
+
+    static int get_num_live() { return (int)state().num_live; }
+
+    // print every live block (needs OCTET_TRACK_ALLOCATIONS)
+    static void dump_live(FILE *file) {
+      for_each_live(print_live, (void*)file);
+    }
+
     // crude check of stack integrity
     static void test(const char *label) {
       printf("test %s\n", label);
@@ -57,4 +466,3 @@ namespace octet {
     }
   };
 }
-
@@ -0,0 +1,297 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// arena (bump) allocator for short-lived data
+//
+// Allocation is just a pointer increment and free() does almost nothing.
+// Instead, everything is thrown away at once with reset() (eg. at the end of a frame)
+// or by leaving a scope (eg. when a file has finished loading).
+//
+// Each thread gets its own arena, so allocation takes no locks. The arenas are
+// kept in a list so that reset_all() can clear every thread's arena between frames,
+// and they are given back to the heap at exit.
+//
+// arena_allocator<> can be used as the allocator_t of dynarray, hash_map and dictionary:
+//
+//   {
+//     load_allocator::scope scope;
+//     dynarray<float, load_allocator> values;
+//     values.push_back(1);
+//     ...
+//   } // values' memory is reclaimed here
+//
+// Be careful: memory from an arena must not be used after a reset() or
+// after its scope has ended.
+
+namespace octet {
+  class arena {
+    enum {
+      // all blocks are aligned to this, for SSE
+      alignment = 16,
+
+      // smallest chunk we get from the heap
+      min_chunk_size = 0x10000,
+    };
+
+    // chunks are linked together with the newest first
+    struct chunk {
+      chunk *next;
+      size_t size;
+
+      uint8_t *begin() { return (uint8_t*)(((intptr_t)(this + 1) + alignment - 1) & -(intptr_t)alignment); }
+      uint8_t *end() { return begin() + size; }
+    };
+
+    chunk *chunks;
+    uint8_t *ptr;
+    uint8_t *max;
+
+    // the most recent block. only this block can be freed or grown in place.
+    uint8_t *last;
+
+    static size_t round(size_t size) {
+      return (size + alignment - 1) & ~(size_t)(alignment - 1);
+    }
+
+    void new_chunk(size_t size) {
+      size = size < min_chunk_size ? (size_t)min_chunk_size : size;
+      chunk *c = (chunk*)::malloc(sizeof(chunk) + size + alignment);
+      c->next = chunks;
+      c->size = size;
+      chunks = c;
+      ptr = c->begin();
+      max = c->end();
+    }
+
+    // free chunks until c is the newest
+    void free_chunks(chunk *c) {
+      while (chunks != c) {
+        chunk *next = chunks->next;
+        ::free(chunks);
+        chunks = next;
+      }
+    }
+
+  public:
+    // position in the arena to rewind to
+    struct marker {
+      chunk *c;
+      uint8_t *ptr;
+    };
+
+    arena() {
+      chunks = 0;
+      ptr = max = last = 0;
+    }
+
+    ~arena() {
+      release();
+    }
+
+    void *malloc(size_t size) {
+      size = round(size);
+      if (!ptr || ptr + size > max) {
+        new_chunk(size);
+      }
+      last = ptr;
+      ptr += size;
+      return (void*)last;
+    }
+
+    // only the last block is actually freed.
+    void free(void *p, size_t size) {
+      if (p && p == last && last + round(size) == ptr) {
+        ptr = last;
+        last = 0;
+      }
+    }
+
+    void *realloc(void *p, size_t old_size, size_t size) {
+      if (!p) return malloc(size);
+
+      // grow or shrink the last block in place
+      if (p == last && last + round(old_size) == ptr && last + round(size) <= max) {
+        ptr = last + round(size);
+        return p;
+      }
+
+      if (size <= old_size) return p;
+
+      void *res = malloc(size);
+      memcpy(res, p, old_size);
+      return res;
+    }
+
+    marker mark() {
+      marker m = { chunks, ptr };
+      return m;
+    }
+
+    // discard everything allocated since mark()
+    void rewind(const marker &m) {
+      if (m.c) {
+        free_chunks(m.c);
+        ptr = m.ptr;
+        max = m.c->end();
+        last = 0;
+      } else {
+        // the arena was empty, so keep the memory for next time
+        reset();
+      }
+    }
+
+    // discard everything.
+    // if we needed more than one chunk, replace them with one big one
+    // so that next time we do not need to go to the heap at all.
+    void reset() {
+      if (chunks && chunks->next) {
+        size_t total = 0;
+        for (chunk *c = chunks; c; c = c->next) {
+          total += c->size;
+        }
+        free_chunks(0);
+        new_chunk(total);
+      } else if (chunks) {
+        ptr = chunks->begin();
+      }
+      last = 0;
+    }
+
+    // give all memory back to the heap
+    void release() {
+      free_chunks(0);
+      ptr = max = last = 0;
+    }
+
+    // total bytes reserved from the heap
+    size_t get_capacity() const {
+      size_t total = 0;
+      for (chunk *c = chunks; c; c = c->next) {
+        total += c->size;
+      }
+      return total;
+    }
+  };
+
+  // static interface to a per-thread arena, for use as an allocator_t.
+  // the tag class makes a separate arena for each kind of lifetime.
+  template <class tag_t> class arena_allocator {
+    struct thread_arena : arena {
+      thread_arena *next;
+    };
+
+    // every thread's arena for this tag
+    struct threads_t {
+      spin_lock lock;
+      thread_arena *first;
+
+      // goes up in release_all(), so that threads know to make new arenas
+      unsigned generation;
+
+      threads_t() {
+        first = 0;
+        generation = 0;
+        atexit(release_all);
+      }
+    };
+
+    static threads_t &threads() {
+      static threads_t instance;
+      return instance;
+    }
+
+    static thread_arena *&get_ptr() {
+      static OCTET_THREAD_LOCAL thread_arena *ptr;
+      return ptr;
+    }
+
+    static unsigned &get_generation() {
+      static OCTET_THREAD_LOCAL unsigned generation;
+      return generation;
+    }
+
+  public:
+    // get the arena for this thread
+    static arena &get() {
+      thread_arena *&ptr = get_ptr();
+      threads_t &t = threads();
+      if (!ptr || get_generation() != t.generation) {
+        ptr = new thread_arena();
+        get_generation() = t.generation;
+        t.lock.lock();
+        ptr->next = t.first;
+        t.first = ptr;
+        t.lock.unlock();
+      }
+      return *ptr;
+    }
+
+    static void *malloc(size_t size) {
+      return get().malloc(size);
+    }
+
+    static void free(void *ptr, size_t size) {
+      get().free(ptr, size);
+    }
+
+    static void *realloc(void *ptr, size_t old_size, size_t size) {
+      return get().realloc(ptr, old_size, size);
+    }
+
+    // throw away everything allocated on this thread
+    static void reset() {
+      get().reset();
+    }
+
+    // throw away everything allocated on every thread.
+    // no other thread may be using its arena, eg. call this between frames.
+    static void reset_all() {
+      threads_t &t = threads();
+      t.lock.lock();
+      for (thread_arena *a = t.first; a; a = a->next) {
+        a->reset();
+      }
+      t.lock.unlock();
+    }
+
+    // give every thread's arena back to the heap (done at exit).
+    // as with reset_all(), no other thread may be using its arena.
+    static void release_all() {
+      threads_t &t = threads();
+      t.lock.lock();
+      thread_arena *a = t.first;
+      t.first = 0;
+      t.generation++;
+      t.lock.unlock();
+      while (a) {
+        thread_arena *next = a->next;
+        delete a;
+        a = next;
+      }
+    }
+
+    // everything allocated during the lifetime of a scope is thrown away at the end.
+    class scope {
+      arena::marker m;
+    public:
+      scope() {
+        m = get().mark();
+      }
+
+      ~scope() {
+        get().rewind(m);
+      }
+    };
+  };
+
+  // data that lives until the end of the frame
+  struct frame_arena_tag {};
+  typedef arena_allocator<frame_arena_tag> frame_allocator;
+
+  // data that lives until a file has finished loading
+  struct load_arena_tag {};
+  typedef arena_allocator<load_arena_tag> load_allocator;
+}
@@ -0,0 +1,128 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// atomic operations and spin locks
+//
+// These are thin wrappers around the compiler intrinsics so that
+// containers and resources can be shared between threads.
+//
+// example:
+//
+//   spin_lock lock;
+//   lock.lock();
+//   ... do something that only one thread may do at a time ...
+//   lock.unlock();
+//
+
+#ifdef WIN32
+  #include <intrin.h>
+  #define OCTET_THREAD_LOCAL __declspec(thread)
+#else
+  #define OCTET_THREAD_LOCAL __thread
+#endif
+
+namespace octet {
+  class atomic {
+  public:
+    // set *dest to value and return the old value
+    static int exchange(volatile int *dest, int value) {
+      #ifdef WIN32
+        return (int)_InterlockedExchange((volatile long*)dest, (long)value);
+      #else
+        return __sync_lock_test_and_set(dest, value);
+      #endif
+    }
+
+    // add value to *dest and return the new value
+    static int add(volatile int *dest, int value) {
+      #ifdef WIN32
+        return (int)_InterlockedExchangeAdd((volatile long*)dest, (long)value) + value;
+      #else
+        return __sync_add_and_fetch(dest, value);
+      #endif
+    }
+
+    // if *dest == comparand, set *dest to value. Always return the old value.
+    static int compare_exchange(volatile int *dest, int value, int comparand) {
+      #ifdef WIN32
+        return (int)_InterlockedCompareExchange((volatile long*)dest, (long)value, (long)comparand);
+      #else
+        return __sync_val_compare_and_swap(dest, comparand, value);
+      #endif
+    }
+
+    // raise *dest to at least value (for high-water marks). Return the new value.
+    static int max(volatile int *dest, int value) {
+      int old = *dest;
+      while (old < value) {
+        int prev = compare_exchange(dest, value, old);
+        if (prev == old) return value;
+        old = prev;
+      }
+      return old;
+    }
+
+    // add one to *dest without ordering other memory accesses (for taking an extra reference)
+    static void increment_relaxed(volatile int *dest) {
+      #ifdef WIN32
+        _InterlockedIncrement((volatile long*)dest);
+      #else
+        __atomic_fetch_add(dest, 1, __ATOMIC_RELAXED);
+      #endif
+    }
+
+    // subtract one from *dest with release semantics and return the new value.
+    // our writes are visible before anyone else sees the new count.
+    static int decrement_release(volatile int *dest) {
+      #ifdef WIN32
+        return (int)_InterlockedDecrement((volatile long*)dest);
+      #else
+        return __atomic_sub_fetch(dest, 1, __ATOMIC_RELEASE);
+      #endif
+    }
+
+    // make other threads' released writes visible to us (eg. before deleting a shared object)
+    static void acquire_fence() {
+      #ifdef WIN32
+        _ReadWriteBarrier();
+      #else
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      #endif
+    }
+
+    // set *dest to zero with release semantics (for unlocking)
+    static void release_zero(volatile int *dest) {
+      #ifdef WIN32
+        _ReadWriteBarrier();
+        *dest = 0;
+      #else
+        __sync_lock_release(dest);
+      #endif
+    }
+  };
+
+  // a very small lock for very short critical sections, such as
+  // popping an item from a free list. Do not hold one of these for long!
+  class spin_lock {
+    volatile int value;
+  public:
+    spin_lock() {
+      value = 0;
+    }
+
+    void lock() {
+      while (atomic::exchange(&value, 1)) {
+        // wait without hammering the bus until the lock looks free
+        while (value) {
+        }
+      }
+    }
+
+    void unlock() {
+      atomic::release_zero(&value);
+    }
+  };
+}
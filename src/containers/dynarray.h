@@ -15,21 +15,69 @@
 //
 //   // now treat the array like an ordinary array.
 //   printf("%d\n", my_array[1]);
+//
+// Relocation:
+//
+// Most classes do not keep pointers to themselves and so can be moved to a new
+// address with memcpy. Marking a class as relocatable lets dynarray grow with realloc
+// and insert or erase with memmove, instead of constructing and destroying every element:
+//
+//   OCTET_RELOCATABLE(my_class)
+//
 
+#ifndef OCTET_HAS_MOVE
+  #if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1600)
+    #define OCTET_HAS_MOVE 1
+  #else
+    #define OCTET_HAS_MOVE 0
+  #endif
+#endif
 
-// dynamic array class similar to std::vector
 namespace octet {
+  // is_relocatable<type>::value is 1 if objects of this type may be moved with memcpy.
+  template <class type> struct is_relocatable { enum { value = 0 }; };
+  template <class type> struct is_relocatable<type *> { enum { value = 1 }; };
+
+  #define OCTET_RELOCATABLE(type) template <> struct is_relocatable<type> { enum { value = 1 }; };
+
+  OCTET_RELOCATABLE(bool)
+  OCTET_RELOCATABLE(char)
+  OCTET_RELOCATABLE(signed char)
+  OCTET_RELOCATABLE(unsigned char)
+  OCTET_RELOCATABLE(short)
+  OCTET_RELOCATABLE(unsigned short)
+  OCTET_RELOCATABLE(int)
+  OCTET_RELOCATABLE(unsigned int)
+  OCTET_RELOCATABLE(long)
+  OCTET_RELOCATABLE(unsigned long)
+  OCTET_RELOCATABLE(long long)
+  OCTET_RELOCATABLE(unsigned long long)
+  OCTET_RELOCATABLE(float)
+  OCTET_RELOCATABLE(double)
+
+  // dynamic array class similar to std::vector
   template <class item_t, class allocator_t=allocator, bool use_new_delete=true> class dynarray {
     item_t *data_;
     typedef unsigned int_size_t;
     int_size_t size_;
     int_size_t capacity_;
-    enum { min_capacity = 8 };
+    enum {
+      min_capacity = 8,
+
+      // if true, we can move elements with memcpy and realloc
+      relocate = !use_new_delete || is_relocatable<item_t>::value
+    };
 
     dynarray(const dynarray &rhs) {
       // you can't do this at the moment!
     }
 
+    #if OCTET_HAS_MOVE
+      static item_t &&move(item_t &value) { return static_cast<item_t&&>(value); }
+    #else
+      static item_t &move(item_t &value) { return value; }
+    #endif
+
   public:
     dynarray() {
       data_ = 0;
@@ -38,8 +86,14 @@ namespace octet {
     }
 
     dynarray(int_size_t size) {
-      data_ = (item_t*)allocator::malloc(size * sizeof(item_t));
+      data_ = (item_t*)allocator_t::malloc(size * sizeof(item_t));
       size_ = capacity_ = size;
+      if (use_new_delete) {
+        dynarray_dummy_t x;
+        for (int_size_t i = 0; i != size; ++i) {
+          new (data_ + i, x) item_t;
+        }
+      }
     }
 
     ~dynarray() {
@@ -70,36 +124,77 @@ namespace octet {
     }
   
     iterator insert(iterator it, const item_t &new_item) {
-      int_size_t old_length = size_;
-      resize(size_+1);
-      for (int_size_t i = old_length; i != it.elem; --i) {
-        data_[i] = data_[i-1];
+      if (relocate) {
+        if (&new_item >= data_ && &new_item < data_ + size_) {
+          // new_item is in this array, so copy it before we move things.
+          item_t tmp(new_item);
+          return insert(it, tmp);
+        }
+        dynarray_dummy_t x;
+        grow(size_+1);
+        memmove((void*)(data_ + it.elem + 1), (void*)(data_ + it.elem), (size_ - it.elem) * sizeof(item_t));
+        new (data_ + it.elem, x) item_t(new_item);
+        size_++;
+      } else {
+        int_size_t old_length = size_;
+        resize(size_+1);
+        for (int_size_t i = old_length; i != it.elem; --i) {
+          data_[i] = move(data_[i-1]);
+        }
+        data_[it.elem] = new_item;
       }
-      data_[it.elem] = new_item;
       return it;
     }
 
     iterator erase(iterator it) {
-      for (int_size_t i = it.elem; i < size_-1; ++i) {
-        data_[i] = data_[i+1];
-      }
-      resize(size_-1);
+      erase(it.elem);
       return it;
     }
   
     void erase(unsigned elem) {
-      for (int_size_t i = elem; i < size_-1; ++i) {
-        data_[i] = data_[i+1];
+      if (relocate) {
+        if (use_new_delete) data_[elem].~item_t();
+        memmove((void*)(data_ + elem), (void*)(data_ + elem + 1), (size_ - elem - 1) * sizeof(item_t));
+        size_--;
+      } else {
+        for (int_size_t i = elem; i < size_-1; ++i) {
+          data_[i] = move(data_[i+1]);
+        }
+        resize(size_-1);
       }
-      resize(size_-1);
     }
   
     void push_back(const item_t &new_item) {
-      int_size_t old_length = size_;
-      resize(size_+1);
-      data_[old_length] = new_item;
+      if (size_ == capacity_ && &new_item >= data_ && &new_item < data_ + size_) {
+        // new_item is in this array and is about to move.
+        item_t tmp(new_item);
+        push_back(tmp);
+        return;
+      }
+      dynarray_dummy_t x;
+      grow(size_+1);
+      if (use_new_delete) {
+        new (data_ + size_, x) item_t(new_item);
+      } else {
+        data_[size_] = new_item;
+      }
+      size_++;
     }
 
+    #if OCTET_HAS_MOVE
+      void push_back(item_t &&new_item) {
+        if (size_ == capacity_ && &new_item >= data_ && &new_item < data_ + size_) {
+          item_t tmp(move(new_item));
+          push_back(move(tmp));
+          return;
+        }
+        dynarray_dummy_t x;
+        grow(size_+1);
+        new (data_ + size_, x) item_t(move(new_item));
+        size_++;
+      }
+    #endif
+
     item_t &back() const {
       return data_[size_-1];
     }
@@ -132,10 +227,7 @@ namespace octet {
         size_ = new_length;
       } else if (new_length > capacity_) {
         if (trace) printf("case 2: growing dynarray beyond capacity_\n");
-        int_size_t new_capacity = capacity_ == 0 ? min_capacity : capacity_ * 2;
-        while (new_capacity < new_length) new_capacity *= 2;
-
-        reserve(new_capacity);
+        grow(new_length);
 
         if (use_new_delete) {
           // initialize the rest to default
@@ -162,30 +254,43 @@ namespace octet {
 
     void reserve(int_size_t new_capacity) {
       if (new_capacity >= size_) {
-        dynarray_dummy_t x;
-        item_t *new_data = (item_t *)allocator_t::malloc(sizeof(item_t) * new_capacity);
+        if (relocate) {
+          // realloc may be able to grow the block in place.
+          data_ = (item_t *)allocator_t::realloc(data_, capacity_ * sizeof(item_t), sizeof(item_t) * new_capacity);
+        } else {
+          dynarray_dummy_t x;
+          item_t *new_data = (item_t *)allocator_t::malloc(sizeof(item_t) * new_capacity);
       
-        if (use_new_delete) {
-          // initialize new data_ elements from old ones
+          // move old elements into the new data
           for (int_size_t i = 0; i != size_; ++i) {
-            new (new_data + i, x) item_t(data_[i]);
+            new (new_data + i, x) item_t(move(data_[i]));
             data_[i].~item_t();
           }
-        }
 
-        // free up data_
-        if (data_) {
-          allocator_t::free(data_, capacity_ * sizeof(item_t));
-        }
+          // free up data_
+          if (data_) {
+            allocator_t::free(data_, capacity_ * sizeof(item_t));
+          }
 
-        data_ = new_data;
+          data_ = new_data;
+        }
         capacity_ = new_capacity;
       }
     }
 
+    // make sure there is room for at least new_length elements, doubling the capacity.
+    void grow(int_size_t new_length) {
+      if (new_length > capacity_) {
+        int_size_t new_capacity = capacity_ == 0 ? min_capacity : capacity_ * 2;
+        while (new_capacity < new_length) new_capacity *= 2;
+        reserve(new_capacity);
+      }
+    }
+
     void pop_back() {
       //assert(size_ != 0);
       size_--;
+      if (use_new_delete) data_[size_].~item_t();
     }
 
     void reset() {
@@ -205,7 +310,14 @@ namespace octet {
 
   // dumbarray:
   //   high performance vector does not use new and delete
-  /*template <class item_t, class allocator_t=allocator> class dumbarray : public dynarray<item_t, allocator_t, false> {
-  };*/
+  //   only use this for plain old data (no constructors or destructors)
+  template <class item_t, class allocator_t=allocator> class dumbarray : public dynarray<item_t, allocator_t, false> {
+  public:
+    dumbarray() {
+    }
+
+    dumbarray(unsigned size) : dynarray<item_t, allocator_t, false>(size) {
+    }
+  };
 }
 
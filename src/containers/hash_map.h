@@ -17,6 +17,32 @@
 //   int x = chars_to_int["x"];
 //   int y = chars_to_int["y"];
 //
+// iterate over the slots like this:
+//   for (unsigned i = 0; i != chars_to_int.capacity(); ++i) {
+//     if (chars_to_int.is_used(i)) printf("%s %d\n", chars_to_int.key(i), chars_to_int.value(i));
+//   }
+//
+// This is a "robin hood" hash map. Each slot has a byte which is its distance from
+// its home slot plus one (or zero if the slot is empty). Entries that are far from home
+// take slots from entries that are closer to home, so probes are short and we can
+// stop searching as soon as we find an entry closer to home than we would be.
+// We use SSE2 to check sixteen of these bytes at a time.
+// Erase shifts the following entries back, so there are no tombstones.
+
+#ifndef OCTET_HASH_MAP_SSE2
+  #if defined(OCTET_SSE)
+    #define OCTET_HASH_MAP_SSE2 OCTET_SSE
+  #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define OCTET_HASH_MAP_SSE2 1
+  #else
+    #define OCTET_HASH_MAP_SSE2 0
+  #endif
+#endif
+
+#if OCTET_HASH_MAP_SSE2
+  #include <emmintrin.h>
+#endif
+
 namespace octet {
 
   class hash_map_cmp {
@@ -26,7 +52,7 @@ namespace octet {
     static unsigned get_hash(void *key) { return fuzz_hash((unsigned)(intptr_t)key); }
     static unsigned get_hash(int key) { return fuzz_hash((unsigned)key); }
     static unsigned get_hash(unsigned key) { return fuzz_hash((unsigned)key); }
-    static unsigned get_hash(uint64_t key) { return fuzz_hash((unsigned)(key ^ (key >> 32))); }
+    static unsigned get_hash(uint64_t key) { return fuzz_hash((unsigned)key ^ (unsigned)(key >> 32) * 0x9e3779b1u); }
 
     static bool is_empty(void *key) { return !key; }
     static bool is_empty(int key) { return !key; }
@@ -38,108 +64,295 @@ namespace octet {
     // internal gubbins to implement the hash map
     struct entry_t { key_t key; unsigned hash; value_t value; };
 
+    // entries move around as raw bytes (like dynarray's relocation), so temporaries
+    // are kept in raw storage and never constructed or destroyed.
+    union raw_entry_t {
+      char bytes[sizeof(entry_t)];
+      uint64_t align_u64;
+      double align_double;
+      void *align_ptr;
+      entry_t &get() { return *(entry_t*)bytes; }
+    };
+
+    static void move_entry(entry_t &dest, const entry_t &src) {
+      memcpy((void*)&dest, (const void*)&src, sizeof(entry_t));
+    }
+
+    enum {
+      // number of distance bytes we check at once
+      group_size = 16,
+
+      // smallest table; must be at least group_size
+      min_entries = 16,
+
+      // distances are stored in a byte
+      max_distance = 255,
+    };
+
     entry_t *entries;
+
+    // distance from home + 1 for each slot, 0 if empty.
+    // the first group_size bytes are repeated at the end so that we can read groups that wrap.
+    uint8_t *distances;
+
     unsigned num_entries;
     unsigned max_entries;
 
-    // internal method to find an existing key in the map
-    entry_t *find( const key_t &key, unsigned hash ) {
+    // multiply by the golden ratio to spread out sequential keys and pointers
+    unsigned get_home(unsigned hash) const {
+      return (hash * 0x9e3779b1u >> 7) & (max_entries - 1);
+    }
+
+    void set_distance(unsigned i, unsigned dist) {
+      distances[i] = (uint8_t)dist;
+      if (i < group_size) distances[i + max_entries] = (uint8_t)dist;
+    }
+
+    static unsigned lowest_bit(unsigned bits) {
+      #ifdef WIN32
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return (unsigned)index;
+      #else
+        return (unsigned)__builtin_ctz(bits);
+      #endif
+    }
+
+    // internal method to find an existing key in the map or return null.
+    entry_t *find( const key_t &key, unsigned hash ) const {
       unsigned mask = max_entries - 1;
-      for (unsigned i = 0; i != max_entries; ++i) {
-        entry_t *entry = &entries[ ( i + hash ) & mask ];
-        if (cmp_t::is_empty(entry->key)) {
-          return entry;
+      unsigned pos = get_home(hash);
+      unsigned dist = 1;
+
+      #if OCTET_HASH_MAP_SSE2
+        // the distance each slot in the group would have if it held our key
+        const __m128i ramp = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        for (;;) {
+          __m128i group = _mm_loadu_si128((const __m128i*)(distances + pos));
+          __m128i expected = _mm_adds_epu8(_mm_set1_epi8((char)dist), ramp);
+          __m128i eq = _mm_cmpeq_epi8(group, expected);
+
+          // any slot closer to home than we would be (including empty slots) ends the search
+          __m128i le = _mm_cmpeq_epi8(_mm_min_epu8(group, expected), group);
+          unsigned stop = (unsigned)_mm_movemask_epi8(_mm_andnot_si128(eq, le));
+          unsigned match = (unsigned)_mm_movemask_epi8(eq);
+          if (stop) match &= (stop & (0 - stop)) - 1;
+
+          while (match) {
+            entry_t *entry = &entries[(pos + lowest_bit(match)) & mask];
+            if (entry->hash == hash && entry->key == key) {
+              return entry;
+            }
+            match &= match - 1;
+          }
+
+          if (stop || dist + group_size > max_distance) return 0;
+          pos = (pos + group_size) & mask;
+          dist += group_size;
         }
-        if (entry->hash == hash && entry->key == key) {
-          return entry;
+      #else
+        for (;;) {
+          unsigned d = distances[pos];
+          if (d < dist) return 0;
+          entry_t *entry = &entries[pos];
+          if (d == dist && entry->hash == hash && entry->key == key) {
+            return entry;
+          }
+          pos = (pos + 1) & mask;
+          dist++;
+        }
+      #endif
+    }
+
+    // robin hood insert of an entry that is not in the map.
+    // returns the slot that the entry went into, or -1 if an entry got too far from home.
+    // in this case the displaced entry is returned in new_entry and we must grow the map.
+    int insert(entry_t &new_entry) {
+      unsigned mask = max_entries - 1;
+      unsigned pos = get_home(new_entry.hash);
+      int result = -1;
+      for (unsigned dist = 1; dist <= max_distance; ++dist) {
+        unsigned d = distances[pos];
+        if (d == 0) {
+          move_entry(entries[pos], new_entry);
+          set_distance(pos, dist);
+          return result == -1 ? (int)pos : result;
+        } else if (d < dist) {
+          // steal from the rich: swap with the entry that is closer to home.
+          raw_entry_t tmp;
+          move_entry(tmp.get(), entries[pos]);
+          move_entry(entries[pos], new_entry);
+          move_entry(new_entry, tmp.get());
+          set_distance(pos, dist);
+          dist = d;
+          if (result == -1) result = (int)pos;
         }
+        pos = (pos + 1) & mask;
       }
-      assert(0 && "hash_map: all entries are used. expand() did not get called");
-      return 0;
+      return -1;
     }
-  
-    // increase the size of the map if we have run out of space
-    void expand() {
+
+    void allocate(unsigned new_max_entries) {
+      max_entries = new_max_entries;
+      num_entries = 0;
+      entries = (entry_t*)allocator_t::malloc(sizeof(entry_t) * max_entries);
+      distances = (uint8_t*)allocator_t::malloc(max_entries + group_size);
+      memset(entries, 0, sizeof(entry_t) * max_entries);
+      memset(distances, 0, max_entries + group_size);
+    }
+
+    // change the size of the map
+    void rehash(unsigned new_max_entries) {
       entry_t *old_entries = entries;
+      uint8_t *old_distances = distances;
       unsigned old_max_entries = max_entries;
-      entries = (entry_t *)allocator_t::malloc(sizeof(entry_t) * max_entries*2);
-      memset(entries, 0, sizeof(entry_t) * max_entries*2);
-      max_entries *= 2;
-      for (unsigned i = 0; i != old_max_entries; ++i) {
-        entry_t *old_entry = &old_entries[i];
-        if (!cmp_t::is_empty(old_entry->key)) {
-          entry_t *new_entry = find(old_entry->key, old_entry->hash);
-          *new_entry = *old_entry;
+      for (;;) {
+        allocate(new_max_entries);
+        bool ok = true;
+        for (unsigned i = 0; ok && i != old_max_entries; ++i) {
+          if (old_distances[i]) {
+            raw_entry_t entry;
+            move_entry(entry.get(), old_entries[i]);
+            ok = insert(entry.get()) != -1;
+            num_entries++;
+          }
         }
+        if (ok) break;
+
+        // very unlikely: the hash is so poor that something got too far from home.
+        allocator_t::free(entries, sizeof(entry_t) * max_entries);
+        allocator_t::free(distances, max_entries + group_size);
+        new_max_entries *= 2;
       }
       allocator_t::free(old_entries, sizeof(entry_t) * old_max_entries);
+      allocator_t::free(old_distances, old_max_entries + group_size);
+    }
+
+    // increase the size of the map if we have run out of space
+    void expand() {
+      rehash(max_entries * 2);
+    }
+
+    // run the destructors of a used slot.
+    // entries are moved around bitwise, so this is only done when they leave the map.
+    static void destroy(entry_t &entry) {
+      entry.key.~key_t();
+      entry.value.~value_t();
     }
 
     void release() {
+      for (unsigned i = 0; i != max_entries; ++i) {
+        if (distances[i]) destroy(entries[i]);
+      }
       allocator_t::free(entries, sizeof(entry_t) * max_entries);
+      allocator_t::free(distances, max_entries + group_size);
       entries = 0;
+      distances = 0;
       num_entries = 0;
       max_entries = 0;
     }
 
     void init() {
-      num_entries = 0;
-      max_entries = 4;
-      entries = (entry_t*)allocator_t::malloc(sizeof(entry_t) * max_entries);
-      memset(entries, 0, sizeof(entry_t) * max_entries);
+      allocate(min_entries);
     }
   public:
     // allocate a small map for starters that has a small number of elements.
     hash_map() {
       init();
     }
-  
+
     void clear() {
       release();
       init();
     }
-  
-    // access the 
+
+    // make room for at least this many entries without growing
+    void reserve(unsigned size) {
+      unsigned new_max_entries = max_entries;
+      while (size > new_max_entries / 8 * 7) {
+        new_max_entries *= 2;
+      }
+      if (new_max_entries != max_entries) {
+        rehash(new_max_entries);
+      }
+    }
+
+    // access the
     // eg. my_map["fred"]
     value_t &operator[]( const key_t &key ) {
       unsigned hash = cmp_t::get_hash(key);
       entry_t *entry = find( key, hash );
-      if (cmp_t::is_empty(entry->key)) {
-        // reducing this ratio decreases hot search time at the
-        // expense of size (cold search time).
-        if (num_entries >= max_entries * 3 / 4) {
+      if (entry) {
+        return entry->value;
+      }
+
+      // robin hood maps work well at high load factors.
+      if (num_entries >= max_entries / 8 * 7) {
+        expand();
+      }
+
+      // values start as zero bytes
+      raw_entry_t raw;
+      memset(raw.bytes, 0, sizeof(raw.bytes));
+      entry_t &new_entry = raw.get();
+      new_entry.key = key;
+      new_entry.hash = hash;
+      int index = insert(new_entry);
+      if (index == -1) {
+        // something got too far from home, grow the map and put it back.
+        do {
           expand();
-          entry = find(key, hash);
-        }
-        num_entries++;
-        entry->key = key;
-        entry->hash = hash;
+        } while (insert(new_entry) == -1);
+        entry = find(key, hash);
+      } else {
+        entry = &entries[index];
       }
+      num_entries++;
       return entry->value;
     }
 
+    // remove a key. returns false if the key was not in the map.
+    bool erase(const key_t &key) {
+      entry_t *entry = find(key, cmp_t::get_hash(key));
+      if (!entry) return false;
+      destroy(*entry);
+
+      // shift the following entries back towards home.
+      unsigned mask = max_entries - 1;
+      unsigned pos = (unsigned)(entry - entries);
+      unsigned next = (pos + 1) & mask;
+      while (distances[next] > 1) {
+        move_entry(entries[pos], entries[next]);
+        set_distance(pos, distances[next] - 1);
+        pos = next;
+        next = (next + 1) & mask;
+      }
+      memset(&entries[pos], 0, sizeof(entry_t));
+      set_distance(pos, 0);
+      num_entries--;
+      return true;
+    }
+
     bool contains(const key_t &key) {
-      unsigned hash = cmp_t::get_hash(key);
-      entry_t *entry = find( key, hash );
-      return !cmp_t::is_empty(entry->key);
+      return find(key, cmp_t::get_hash(key)) != 0;
     }
 
+    // return the slot containing key or -1 if it is not in the map.
     int get_index(const key_t &key) {
-      unsigned hash = cmp_t::get_hash(key);
-      entry_t *entry = find( key, hash );
-      return entry ? entry - entries : -1;
+      entry_t *entry = find(key, cmp_t::get_hash(key));
+      return entry ? (int)(entry - entries) : -1;
     }
 
     // bye bye hash map
     ~hash_map() {
-      allocator_t::free(entries, sizeof(entry_t) * max_entries);
-      entries = 0;
-      num_entries = 0;
-      max_entries = 0;
+      release();
     }
 
     // stl-style iterators are bloated. This is a simpler iterator scheme
-    unsigned size() { return max_entries; }
+    // note: iterate from 0 to capacity() and check is_used(i). Empty slots have zero keys and values.
+    unsigned size() const { return num_entries; }
+    unsigned capacity() const { return max_entries; }
+    bool is_used(unsigned i) const { return distances[i] != 0; }
     key_t key(unsigned i) { return entries[i].key; }
     value_t value(unsigned i) { return entries[i].value; }
   };
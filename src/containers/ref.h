@@ -8,8 +8,87 @@
 //
 // These should only be used in long-lived containers, never on the stack.
 //
+// The reference count itself is a policy. plain_ref_count is the fastest, but the
+// object must only be shared by one thread. atomic_ref_count lets ref<>s to the
+// same object be copied and dropped on different threads (a single ref<> still
+// must not be changed by two threads at once).
+//
+// Resources use default_ref_count, which is atomic if OCTET_ATOMIC_REF_COUNT is 1.
+// Other classes can choose for themselves:
+//
+//   class job : public ref_counted<atomic_ref_count> { ... };
+//   ref<job> my_job = new job();
+//
+
+#ifndef OCTET_ATOMIC_REF_COUNT
+  #define OCTET_ATOMIC_REF_COUNT 0
+#endif
 
 namespace octet {
+  // single-threaded reference count
+  class plain_ref_count {
+    int count;
+  public:
+    plain_ref_count() { count = 0; }
+
+    void add_ref() { count++; }
+
+    // return true if that was the last reference
+    bool release() { return --count == 0; }
+
+    int get() const { return count; }
+  };
+
+  // thread-safe reference count
+  class atomic_ref_count {
+    volatile int count;
+  public:
+    atomic_ref_count() { count = 0; }
+
+    // the caller already has a reference, so no ordering is needed
+    void add_ref() { atomic::increment_relaxed(&count); }
+
+    // return true if that was the last reference.
+    // the acquire makes every other thread's writes to the object visible before we delete it.
+    bool release() {
+      if (atomic::decrement_release(&count) == 0) {
+        atomic::acquire_fence();
+        return true;
+      }
+      return false;
+    }
+
+    int get() const { return count; }
+  };
+
+  #if OCTET_ATOMIC_REF_COUNT
+    typedef atomic_ref_count default_ref_count;
+  #else
+    typedef plain_ref_count default_ref_count;
+  #endif
+
+  // base class for things other than resources that live in ref<>s
+  template <class ref_count_t=default_ref_count> class ref_counted {
+    ref_count_t ref_count;
+  public:
+    virtual ~ref_counted() {
+    }
+
+    void add_ref() {
+      ref_count.add_ref();
+    }
+
+    void release() {
+      if (ref_count.release()) {
+        delete this;
+      }
+    }
+
+    int get_ref_count() const {
+      return ref_count.get();
+    }
+  };
+
   template <class item_t, class allocator_t=allocator> class ref {
     // wrapped pointer to the object
     item_t *item;
@@ -20,7 +99,7 @@ namespace octet {
       item = 0;
     }
 
-    ref(ref &rhs) {
+    ref(const ref &rhs) {
       item = rhs.item;
       if (item) item->add_ref();
     }
@@ -68,4 +147,7 @@ namespace octet {
       item = 0;
     }
   };
+
+  // refs can be moved with memcpy without touching the reference count
+  template <class item_t, class allocator_t> struct is_relocatable<ref<item_t, allocator_t> > { enum { value = 1 }; };
 }
@@ -11,20 +11,147 @@
 //   string my_string = "hello world";
 //   printf("%s\n", my_string.c_str());
 //
+// Short strings (up to fifteen characters) are kept inside the string itself,
+// so names, tokens and numbers do not need to go to the allocator at all.
+//
+// A slice is a piece of some other string. It does not own its characters
+// and is not zero terminated, so it is very cheap to make, but the text must
+// outlive the slice. split() makes slices rather than copies.
+//
+//   dynarray<slice> words;
+//   my_string.split(words, " ");
+//   if (words[0] == "hello") printf("%.*s\n", words[1].size(), words[1].data());
+//
 
 namespace octet {
+  // strings and slices can be moved with memcpy (declared early as they use dynarray of themselves)
+  class slice;
+  class string;
+  OCTET_RELOCATABLE(slice)
+  OCTET_RELOCATABLE(string)
+
+  class slice {
+    const char *data_;
+    unsigned size_;
+
+  public:
+    slice() { data_ = ""; size_ = 0; }
+    slice(const char *value) { data_ = value ? value : ""; size_ = (unsigned)strlen(data_); }
+    slice(const char *value, unsigned size) { data_ = value; size_ = size; }
+
+    // note: not zero terminated
+    const char *data() const { return data_; }
+    unsigned size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    char operator[](unsigned i) const { return data_[i]; }
+
+    bool operator==(const slice &rhs) const { return size_ == rhs.size_ && !memcmp(data_, rhs.data_, size_); }
+    bool operator!=(const slice &rhs) const { return !(*this == rhs); }
+
+    // part of this slice
+    slice substr(unsigned pos, unsigned len = ~0u) const {
+      if (pos > size_) pos = size_;
+      if (len > size_ - pos) len = size_ - pos;
+      return slice(data_ + pos, len);
+    }
+
+    // return the position of rhs at or after start, or -1 if it is not there.
+    int find(const slice &rhs, unsigned start = 0) const {
+      if (rhs.size_ == 0) return start <= size_ ? (int)start : -1;
+      for (unsigned i = start; i + rhs.size_ <= size_; ++i) {
+        const char *p = (const char*)memchr(data_ + i, rhs.data_[0], size_ - rhs.size_ + 1 - i);
+        if (!p) break;
+        i = (unsigned)(p - data_);
+        if (!memcmp(p, rhs.data_, rhs.size_)) {
+          return (int)i;
+        }
+      }
+      return -1;
+    }
+
+    // python-style string split. The results point into this slice's text.
+    void split(dynarray<slice> &result, const slice &delimiter) const {
+      result.resize(0);
+      unsigned pos = 0;
+      for (;;) {
+        int next = delimiter.size_ ? find(delimiter, pos) : -1;
+        if (next == -1) break;
+        result.push_back(slice(data_ + pos, next - pos));
+        pos = next + delimiter.size_;
+      }
+      result.push_back(slice(data_ + pos, size_ - pos));
+    }
+  };
+
   class string {
-    char *data_;
+    enum {
+      // characters (including the zero) that fit inside the string
+      local_size = 16,
+    };
+
+    // capacity_ is zero when the text is in local_
+    union {
+      char *heap_;
+      char local_[local_size];
+    };
+    unsigned size_;
+    unsigned capacity_;
 
-    static char *null_string() { static char c; return &c; }
+    char *buffer() { return capacity_ ? heap_ : local_; }
+    const char *buffer() const { return capacity_ ? heap_ : local_; }
+
+    void init() {
+      local_[0] = 0;
+      size_ = 0;
+      capacity_ = 0;
+    }
 
     void release() {
-      if (data_ != null_string()) {
-        allocator::free((void*)data_, size() + 1);
-        data_ = null_string();
+      if (capacity_) {
+        allocator::free((void*)heap_, capacity_ + 1);
       }
+      init();
     }
 
+    // make room for size characters (plus the zero), throwing away the old text.
+    // if the text fits, we keep the old buffer and its characters, but the zero is not written.
+    char *reserve(unsigned size) {
+      unsigned cap = capacity_ ? capacity_ : local_size - 1;
+      if (size > cap) {
+        release();
+        if (size >= local_size) {
+          heap_ = (char*)allocator::malloc(size + 1);
+          capacity_ = size;
+        }
+      }
+      size_ = size;
+      return buffer();
+    }
+
+    // same, with the zero written
+    char *alloc(unsigned size) {
+      char *dest = reserve(size);
+      dest[size] = 0;
+      return dest;
+    }
+
+    // make room for new_size characters (plus the zero), keeping the old text.
+    char *grow(unsigned new_size) {
+      unsigned cap = capacity_ ? capacity_ : local_size - 1;
+      if (new_size > cap) {
+        unsigned new_capacity = cap * 2 > new_size ? cap * 2 : new_size;
+        char *new_data = (char*)allocator::malloc(new_capacity + 1);
+        memcpy(new_data, buffer(), size_ + 1);
+        if (capacity_) {
+          allocator::free((void*)heap_, capacity_ + 1);
+        }
+        heap_ = new_data;
+        capacity_ = new_capacity;
+      }
+      return buffer();
+    }
+
+
     // When dealing with windows or java, we will come across the less popular
     // utf16 encoding scheme. All other sources of text will likely be in UTF8, ANSI or shift-JIS
     // We use UTF8 internally as it is compact and popular.
@@ -136,161 +263,185 @@ namespace octet {
       return num_bytes;
     }
   public:
-    string() { data_ = null_string(); }
+    string() { init(); }
 
-    string(const char *value) { data_ = null_string(); *this = value; }
-    string(const wchar_t *value) { data_ = null_string(); *this = value; }
-    string(const string& rhs) { data_ = null_string(); *this = rhs.c_str(); }
+    string(const char *value) { init(); *this = value; }
+    string(const wchar_t *value) { init(); *this = value; }
+    string(const slice &value) { init(); set(value.data(), value.size()); }
+    string(const string& rhs) { init(); set(rhs.c_str(), rhs.size_); }
 
+    #if OCTET_HAS_MOVE
+      // steal the other string's text
+      string(string &&rhs) {
+        memcpy((void*)this, (void*)&rhs, sizeof(string));
+        rhs.init();
+      }
+    #endif
 
     ~string() { release(); }
 
+    // swap the contents of two strings without allocating
+    void swap(string &rhs) {
+      char tmp[sizeof(string)];
+      memcpy(tmp, (void*)this, sizeof(string));
+      memcpy((void*)this, (void*)&rhs, sizeof(string));
+      memcpy((void*)&rhs, tmp, sizeof(string));
+    }
+
     string &format(const char *fmt, ...) {
-      release();
       va_list v;
       va_start(v, fmt);
       #ifdef WIN32
         int len = _vscprintf(fmt, v);
-        if (len) {
-          data_ = (char*)allocator::malloc(len+1);
-          vsprintf_s(data_, len+1, fmt, v);
+        if (len > 0) {
+          char *dest = alloc(len);
+          vsprintf_s(dest, len+1, fmt, v);
+        } else {
+          release();
         }
       #else
         char tmp[1024];
         vsnprintf(tmp, sizeof(tmp)-1, fmt, v);
         *this = tmp;
       #endif
+      va_end(v);
       return *this;
     }
 
     // decode url strings - to turn them into filenames, for example
     string &urldecode(const char *value) {
-      release();
       if (value) {
+        string tmp;
         unsigned size = urldecode_impl(0, value);
-        if (size) {
-          data_ = (char*)allocator::malloc(size+1);
-          urldecode_impl(data_, value);
-        }
+        urldecode_impl(tmp.alloc(size), value);
+        swap(tmp);
+      } else {
+        release();
       }
       return *this;
     }
 
     // encode url strings - to turn them into filenames, for example
     string &urlencode(const char *value) {
-      release();
       if (value) {
+        string tmp;
         unsigned size = urlencode_impl(0, value);
-        if (size) {
-          data_ = (char*)allocator::malloc(size+1);
-          urlencode_impl(data_, value);
-        }
+        urlencode_impl(tmp.alloc(size), value);
+        swap(tmp);
+      } else {
+        release();
       }
       return *this;
     }
 
     // utf8 strings - unix, mac and the web
     string &operator=(const char *value) {
-      release();
       if (value) {
-        size_t size = strlen(value);
-        if (size) {
-          data_ = (char*)allocator::malloc(size+1);
-          memcpy((char*)data_, value, size+1);
-        }
+        set(value, (unsigned)strlen(value));
+      } else {
+        release();
       }
       return *this;
     }
 
     // utf16 unicode strings - microsoft & java
     string &operator=(const wchar_t *value) {
-      release();
       if (value) {
         unsigned size = utf16_to_utf8(0, value);
-        if (size) {
-          data_ = (char*)allocator::malloc(size+1);
-          utf16_to_utf8(data_, value);
-        }
+        utf16_to_utf8(alloc(size), value);
+      } else {
+        release();
       }
       return *this;
     }
 
-    string &operator=(const string& rhs) { data_ = null_string(); *this = rhs.c_str(); return *this; }
+    string &operator=(const slice &rhs) { return set(rhs.data(), rhs.size()); }
+
+    string &operator=(const string& rhs) { return set(rhs.c_str(), rhs.size_); }
+
+    #if OCTET_HAS_MOVE
+      string &operator=(string &&rhs) {
+        if (this != &rhs) {
+          release();
+          memcpy((void*)this, (void*)&rhs, sizeof(string));
+          rhs.init();
+        }
+        return *this;
+      }
+    #endif
 
     string &set(const char *value, unsigned size) {
-      release();
       if (value) {
-        if (size) {
-          data_ = (char*)allocator::malloc(size+1);
-          memcpy((char*)data_, value, size);
-          data_[size] = 0;
-        }
+        // value may be part of this string (which then fits in the buffer we have),
+        // so move rather than copy and only then write the zero.
+        char *dest = reserve(size);
+        memmove(dest, value, size);
+        dest[size] = 0;
+      } else {
+        release();
       }
       return *this;
     }
 
     string &truncate(int new_len) {
-      int size = (int)strlen(data_);
-      if (new_len < size) {
-        if (data_ == null_string()) {
-          data_ = (char*)allocator::malloc(new_len+1);
-        } else {
-          data_ = (char*)allocator::realloc((void*)data_, size+1, new_len+1);
-        }
-        data_[new_len] = 0;
+      if (new_len >= 0 && (unsigned)new_len < size_) {
+        buffer()[new_len] = 0;
+        size_ = (unsigned)new_len;
       }
       return *this;
     }
 
-    bool operator==(const char *rhs) const { return strcmp(data_, rhs) == 0; }
-    bool operator!=(const char *rhs) const { return strcmp(data_, rhs) != 0; }
-    bool operator<(const char *rhs) const { return strcmp(data_, rhs) < 0; }
-    bool operator>(const char *rhs) const { return strcmp(data_, rhs) > 0; }
+    bool operator==(const char *rhs) const { return strcmp(buffer(), rhs) == 0; }
+    bool operator!=(const char *rhs) const { return strcmp(buffer(), rhs) != 0; }
+    bool operator<(const char *rhs) const { return strcmp(buffer(), rhs) < 0; }
+    bool operator>(const char *rhs) const { return strcmp(buffer(), rhs) > 0; }
 
     string &operator+=(const char *rhs) {
       if (rhs) {
-        size_t data_size = strlen(data_);
-        size_t rhs_size = strlen(rhs);
-        if (data_ == null_string()) {
-          data_ = (char*)allocator::malloc(data_size+rhs_size+1);
-        } else {
-          data_ = (char*)allocator::realloc(data_, data_size + 1, data_size+rhs_size+1);
-        }
-        memcpy(data_ + data_size, rhs, rhs_size+1);
+        // rhs may be part of this string, which could move when we grow.
+        const char *old = buffer();
+        size_t offset = rhs - old;
+        bool inside = rhs >= old && rhs <= old + size_;
+        unsigned rhs_size = (unsigned)strlen(rhs);
+        char *dest = grow(size_ + rhs_size);
+        if (inside) rhs = dest + offset;
+        memcpy(dest + size_, rhs, rhs_size);
+        size_ += rhs_size;
+        dest[size_] = 0;
       }
       return *this;
     }
 
     string &insert(unsigned pos, const char *rhs) {
       if (rhs) {
-        size_t data_size = strlen(data_);
-        size_t rhs_size = strlen(rhs);
-        char *new_data = (char*)allocator::malloc(data_size+rhs_size+1);
-        memcpy(new_data, data_, pos);
-        memcpy(new_data + pos, rhs, rhs_size);
-        memcpy(new_data + pos + rhs_size, data_, data_size - pos + 1);
-        release();
-        data_ = new_data;
+        unsigned rhs_size = (unsigned)strlen(rhs);
+        string tmp;
+        char *dest = tmp.alloc(size_ + rhs_size);
+        memcpy(dest, buffer(), pos);
+        memcpy(dest + pos, rhs, rhs_size);
+        memcpy(dest + pos + rhs_size, buffer() + pos, size_ - pos);
+        swap(tmp);
       }
       return *this;
     }
 
     int find(const char *rhs) const {
-      char *d = strstr(data_, rhs);
+      const char *d = strstr(buffer(), rhs);
       if (d) {
-        return (int)(d - data_);
+        return (int)(d - buffer());
       }
       return -1;
     }
 
     int extension_pos() const {
       int res = -1;
-      for (const char *p = data_; *p; ++p) {
+      const char *data = buffer();
+      for (const char *p = data; *p; ++p) {
         char chr = *p;
         if (chr == '/' || chr == '\\') {
           res = -1;  // note  /usr/fred.jim/harry   has no extension
         } else if (chr == '.') {
-          res = (int)(p - data_);
+          res = (int)(p - data);
         }
       }
       return res;
@@ -298,34 +449,36 @@ namespace octet {
 
     int filename_pos() const  {
       int res = 0;
-      for (const char *p = data_; *p; ++p) {
+      const char *data = buffer();
+      for (const char *p = data; *p; ++p) {
         char chr = *p;
         if (chr == '/' || chr == '\\') {
-          res = (int)(p - data_ + 1);
+          res = (int)(p - data + 1);
         }
       }
       return res;
     }
 
-    int size() { return (int)strlen(data_); }
+    int size() const { return (int)size_; }
 
-    const char *c_str() const { return data_; }
-    operator const char *() { return data_; }
+    const char *c_str() const { return buffer(); }
+    operator const char *() const { return buffer(); }
+    operator slice() const { return slice(buffer(), size_); }
 
-    // python-style string split
-    void split(dynarray<string> &result, const char *delimiter) {
-      result.resize(0);
-      char *cur = data_;
-      unsigned delim_len = (unsigned)strlen(delimiter);
-      for(;;) {
-        char *next = strstr(cur, delimiter);
-        if (!next) break;
-        result.push_back(string());
-        result.back().set(cur, (int)(next - cur));
-        cur = next + delim_len;
+    // python-style string split.
+    // the slices point into this string, so don't change it while you are using them.
+    void split(dynarray<slice> &result, const char *delimiter) const {
+      slice(buffer(), size_).split(result, delimiter);
+    }
+
+    // split into copies of the text
+    void split(dynarray<string> &result, const char *delimiter) const {
+      dynarray<slice> slices;
+      split(slices, delimiter);
+      result.resize(slices.size());
+      for (unsigned i = 0; i != slices.size(); ++i) {
+        result[i] = slices[i];
       }
-      result.push_back(string());
-      result.back() = cur;
     }
   };
 }
@@ -0,0 +1,92 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// hash function for strings and blocks of memory
+//
+// This is xxHash32 (Yann Collet), which is fast and mixes every byte into every bit.
+// Simple shift-xor hashes give lots of collisions on similar names like "node1", "node2"
+//
+// example:
+//
+//   unsigned h = string_hash::calc("fred");
+//
+
+namespace octet {
+  class string_hash {
+    enum {
+      prime1 = 2654435761u,
+      prime2 = 2246822519u,
+      prime3 = 3266489917u,
+      prime4 = 668265263u,
+      prime5 = 374761393u,
+    };
+
+    static unsigned rotl(unsigned x, int r) {
+      return (x << r) | (x >> (32 - r));
+    }
+
+    // unaligned little-endian read
+    static unsigned read32(const uint8_t *p) {
+      unsigned x;
+      memcpy(&x, p, 4);
+      return x;
+    }
+
+    static unsigned round(unsigned acc, unsigned input) {
+      return rotl(acc + input * (unsigned)prime2, 13) * (unsigned)prime1;
+    }
+
+  public:
+    // hash a block of memory
+    static unsigned calc(const void *data, size_t size, unsigned seed = 0) {
+      const uint8_t *p = (const uint8_t *)data;
+      const uint8_t *end = p + size;
+      unsigned h;
+
+      if (size >= 16) {
+        unsigned v1 = seed + (unsigned)prime1 + (unsigned)prime2;
+        unsigned v2 = seed + (unsigned)prime2;
+        unsigned v3 = seed;
+        unsigned v4 = seed - (unsigned)prime1;
+        const uint8_t *limit = end - 16;
+        do {
+          v1 = round(v1, read32(p)); p += 4;
+          v2 = round(v2, read32(p)); p += 4;
+          v3 = round(v3, read32(p)); p += 4;
+          v4 = round(v4, read32(p)); p += 4;
+        } while (p <= limit);
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+      } else {
+        h = seed + (unsigned)prime5;
+      }
+
+      h += (unsigned)size;
+
+      while (p + 4 <= end) {
+        h += read32(p) * (unsigned)prime3;
+        h = rotl(h, 17) * (unsigned)prime4;
+        p += 4;
+      }
+
+      while (p < end) {
+        h += *p++ * (unsigned)prime5;
+        h = rotl(h, 11) * (unsigned)prime1;
+      }
+
+      h ^= h >> 15;
+      h *= (unsigned)prime2;
+      h ^= h >> 13;
+      h *= (unsigned)prime3;
+      h ^= h >> 16;
+      return h;
+    }
+
+    // hash a zero-terminated string
+    static unsigned calc(const char *str) {
+      return calc(str, strlen(str));
+    }
+  };
+}
@@ -0,0 +1,189 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// table of unique strings ("interning")
+//
+// Each different string gets a small integer, its index, which never changes.
+// Comparing indices is much cheaper than comparing strings, so look a string up
+// once and keep the index.
+//
+// The text of the strings is packed into large blocks, so adding a string
+// does not usually go to the allocator and the names stay close together in memory.
+//
+// example:
+//
+//   string_table<> names;
+//   unsigned fred = names.add("fred");
+//   unsigned anne = names.add("anne");
+//   assert(names.add("fred") == fred);
+//   printf("%s\n", names.get_name(anne));
+//
+
+namespace octet {
+  template <class allocator_t=allocator> class string_table {
+    enum {
+      // how much text we allocate at a time
+      chunk_size = 0x1000,
+    };
+
+    // blocks of text are linked together
+    struct chunk {
+      chunk *next;
+      size_t size;
+    };
+
+    struct name_t {
+      const char *str;
+      unsigned length;
+      unsigned hash;
+    };
+
+    // hash table of indices + 1 (0 is empty)
+    unsigned *slots;
+    unsigned max_slots;
+
+    dynarray<name_t, allocator_t> names;
+
+    chunk *chunks;
+    char *ptr;
+    char *max;
+
+    string_table(const string_table &rhs) {
+      // you can't do this at the moment!
+    }
+
+    // find the slot for a string. either it holds the string or it is empty.
+    unsigned *find_slot(const char *key, unsigned length, unsigned hash) const {
+      unsigned mask = max_slots - 1;
+      for (unsigned i = hash & mask; ; i = (i + 1) & mask) {
+        unsigned *slot = &slots[i];
+        if (!*slot) return slot;
+        const name_t &name = names[*slot - 1];
+        if (name.hash == hash && name.length == length && !memcmp(name.str, key, length)) {
+          return slot;
+        }
+      }
+    }
+
+    void rehash(unsigned new_max_slots) {
+      allocator_t::free(slots, sizeof(unsigned) * max_slots);
+      max_slots = new_max_slots;
+      slots = (unsigned*)allocator_t::malloc(sizeof(unsigned) * max_slots);
+      memset(slots, 0, sizeof(unsigned) * max_slots);
+      unsigned mask = max_slots - 1;
+      for (unsigned i = 0; i != names.size(); ++i) {
+        unsigned j = names[i].hash & mask;
+        while (slots[j]) j = (j + 1) & mask;
+        slots[j] = i + 1;
+      }
+    }
+
+    // copy the text of a string into a block
+    const char *store(const char *key, unsigned length) {
+      if (ptr + length + 1 > max) {
+        size_t size = length + 1 > chunk_size ? length + 1 : chunk_size;
+        chunk *c = (chunk*)allocator_t::malloc(sizeof(chunk) + size);
+        c->next = chunks;
+        c->size = size;
+        chunks = c;
+        ptr = (char*)(c + 1);
+        max = ptr + size;
+      }
+      char *result = ptr;
+      memcpy(result, key, length);
+      result[length] = 0;
+      ptr += length + 1;
+      return result;
+    }
+
+    void init() {
+      max_slots = 16;
+      slots = (unsigned*)allocator_t::malloc(sizeof(unsigned) * max_slots);
+      memset(slots, 0, sizeof(unsigned) * max_slots);
+      chunks = 0;
+      ptr = max = 0;
+    }
+
+    void release() {
+      while (chunks) {
+        chunk *next = chunks->next;
+        allocator_t::free(chunks, sizeof(chunk) + chunks->size);
+        chunks = next;
+      }
+      allocator_t::free(slots, sizeof(unsigned) * max_slots);
+      slots = 0;
+      max_slots = 0;
+      names.reset();
+    }
+
+  public:
+    string_table() {
+      init();
+    }
+
+    ~string_table() {
+      release();
+    }
+
+    // return the index of a string, or -1 if it is not in the table.
+    int find(const char *key, unsigned length) const {
+      unsigned *slot = find_slot(key, length, string_hash::calc(key, length));
+      return (int)*slot - 1;
+    }
+
+    int find(const char *key) const {
+      return find(key, (unsigned)strlen(key));
+    }
+
+    // return the index of a string, adding it if necessary.
+    // the key does not need to be zero terminated.
+    unsigned add(const char *key, unsigned length) {
+      unsigned hash = string_hash::calc(key, length);
+      unsigned *slot = find_slot(key, length, hash);
+      if (*slot) {
+        return *slot - 1;
+      }
+
+      unsigned index = names.size();
+      name_t name = { store(key, length), length, hash };
+      names.push_back(name);
+      *slot = index + 1;
+
+      // keep the table at most half full
+      if (names.size() * 2 > max_slots) {
+        rehash(max_slots * 2);
+      }
+      return index;
+    }
+
+    unsigned add(const char *key) {
+      return add(key, (unsigned)strlen(key));
+    }
+
+    // number of strings in the table
+    unsigned size() const {
+      return names.size();
+    }
+
+    const char *get_name(unsigned index) const {
+      return names[index].str;
+    }
+
+    unsigned get_length(unsigned index) const {
+      return names[index].length;
+    }
+
+    unsigned get_hash(unsigned index) const {
+      return names[index].hash;
+    }
+
+    // throw away all the strings
+    void reset() {
+      release();
+      init();
+    }
+  };
+}
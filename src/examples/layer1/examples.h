@@ -9,6 +9,7 @@
 #include "../../platform/platform.h"
 
 #include "../../Box2D/Box2DUnity.h"
+#include "../../raytracer/raytracer.h"
 
 #include "triangle/triangle_app.h"
 #include "texture/texture_app.h"
@@ -22,6 +23,7 @@
 #include "physics/physics_app.h"
 #include "breakout/breakout_app.h"
 #include "shaderplay/shaderplay_app.h"
+#include "raytrace/raytrace_app.h"
 
 
 namespace octet {
@@ -38,11 +40,29 @@ namespace octet {
     else if (!strcmp(name, "physics")) return new physics_app(argc, argv); //  physics sample: continue here to learn how to annimate using physics
     else if (!strcmp(name, "breakout")) return new breakout_app(argc, argv); //  My Breakout Game - Intro to Programming
     else if (!strcmp(name, "shaderplay")) return new shaderplay_app(argc, argv); //  My Shader Experiments
+    else if (!strcmp(name, "raytrace")) return new raytrace_app(argc, argv); //  raytrace sample: draw the duck with the CPU ray tracer
     else return 0;
   }
 
   inline void run_examples(int argc, char **argv) {
     app_utils::prefix("../../");
+
+    // -headless draws the apps with no window, see headless_runner.h
+    if (headless_runner::is_requested(argc, argv)) {
+      headless_runner runner;
+      runner.init(argc, argv);
+      for (int i = 1; i != argc; ++i) {
+        if (argv[i][0] != '-') {
+          app *myapp = app_factory(argv[i], argc, argv);
+          if (myapp) {
+            runner.run(myapp, argv[i]);
+            delete myapp;
+          }
+        }
+      }
+      return;
+    }
+
     app::init_all(argc, argv);
 
     if (argc == 1) {
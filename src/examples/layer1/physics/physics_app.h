@@ -83,6 +83,12 @@ namespace octet {
     // storage for boxes
     dynarray<physics_box> boxes;
 
+    // with no window we draw the boxes with the CPU ray tracer
+    raytracer renderer;
+    ref<scene_node> key_light_node;
+    ref<light_instance> key_light;
+    ref<light_instance> ambient_light;
+
   public:
 
     // this is called when we construct the class
@@ -92,9 +98,10 @@ namespace octet {
     // this is called once OpenGL is initialized
     void app_init() {
       // set up the shader
-      bump_shader_.init();
+      if (!is_headless()) {
+        bump_shader_.init();
+      }
 
-    
       // make a mesh to share amoungst all boxes
       box_mesh.make_cube(0.5f);
       box_mat.make_color(vec4(1, 0, 0, 1), false, false);
@@ -126,6 +133,63 @@ namespace octet {
       }
 
       //lights.add_light(vec4(10, 10, 10, 1), vec4(0, 0, 1, 0).normalize(), vec4(0.3f, 0.3f, 0.3f, 1), vec4(1, 1, 1, 1), vec4(1, 1, 1, 1));
+
+      // the same lights as the shader for the ray tracer
+      key_light_node = new scene_node();
+      key_light_node->access_nodeToParent().rotateY(45);
+      key_light = new light_instance();
+      key_light->set_node(key_light_node);
+      key_light->set_kind(atom_directional);
+      key_light->set_color(vec4(1, 1, 1, 1));
+      ambient_light = new light_instance();
+      ambient_light->set_kind(atom_ambient);
+      ambient_light->set_color(vec4(0.3f, 0.3f, 0.3f, 1));
+    }
+
+    // we can ray trace the boxes instead of using OpenGL
+    bool can_run_headless() {
+      return true;
+    }
+
+    // step the physics and ray trace a frame with no window
+    const uint8_t *draw_headless(int &width, int &height) {
+      enum { image_size = 256 };
+
+      boxes[0].get_modelToWorld(world, cameraToWorld);
+      cameraToWorld.translate(0, 2, 5);
+
+      unsigned num_boxes = boxes.size();
+      dynarray<mat4t> modelToWorld(num_boxes);
+      dynarray<mesh*> meshes(num_boxes);
+      dynarray<material*> materials(num_boxes);
+      for (unsigned i = 0; i != num_boxes; ++i) {
+        boxes[i].get_modelToWorld(world, modelToWorld[i]);
+        meshes[i] = i == num_boxes - 1 ? &floor_mesh : &box_mesh;
+        materials[i] = i == num_boxes - 1 ? &floor_mat : &box_mat;
+      }
+      light_instance *lights[] = { key_light, ambient_light };
+
+      raytracer::context ctxt;
+      ctxt.width = image_size;
+      ctxt.height = image_size;
+      ctxt.texture_handle = 0;
+      ctxt.cameraToWorld = cameraToWorld;
+      ctxt.near_plane = 0.125f;
+      ctxt.far_plane = 256.0f;
+      ctxt.near_plane_xmax = ctxt.near_plane;
+      ctxt.near_plane_ymax = ctxt.near_plane;
+      ctxt.lights = lights;
+      ctxt.num_lights = 2;
+      ctxt.modelToWorld = &modelToWorld[0];
+      ctxt.meshes = &meshes[0];
+      ctxt.materials = &materials[0];
+      ctxt.num_objects = num_boxes;
+      renderer.ray_trace(ctxt);
+
+      world.step(0.016f);
+
+      width = height = image_size;
+      return renderer.get_pixels();
     }
 
     // this is called to draw the world
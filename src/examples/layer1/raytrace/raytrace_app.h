@@ -4,7 +4,7 @@
 //
 // Modular Framework for OpenGLES2 rendering on multiple platforms.
 //
-// cube example: How to draw basic 3D geometry
+// raytrace example: How to draw a scene with a ray tracer
 //
 // Demonstrates:
 //   Basic framework app
@@ -13,171 +13,242 @@
 //   Collada meshes
 //   Transforming meshes
 //   Raytracing using CPU
+//   Progressive path tracing (press P, then turn the duck with the arrow keys)
+//   Running headless: examples raytrace -headless -frames=10 -out=duck%02d.ppm
 //
 
-class raytrace_app : public octet::app {
-  // ray tracing renderer
-  raytracer renderer;
+namespace octet {
+  class raytrace_app : public octet::app {
+    // ray tracing renderer
+    raytracer renderer;
 
-  // size of image
-  enum { image_size = 256 };
+    // size of image
+    enum { image_size = 256 };
 
-  // Matrices to transform points on our triangles to the world space
-  // This allows us to move and rotate our triangles
-  dynarray<mat4t> modelToWorld;
+    // seconds to path trace for each frame in progressive mode
+    float path_trace_budget;
 
-  // meshes for our objects
-  dynarray<mesh*> meshes;
+    // true to path trace, false to ray trace the whole image every frame
+    bool progressive;
+    bool was_p_down;
 
-  // materials for our objects
-  dynarray<material*> materials;
+    // Matrices to transform points on our triangles to the world space
+    // This allows us to move and rotate our triangles
+    dynarray<mat4t> modelToWorld;
 
-  // array of lights
-  lighting lights;
+    // meshes for our objects
+    dynarray<mesh*> meshes;
+
+    // materials for our objects
+    dynarray<material*> materials;
+
+    // lights and the nodes that point them
+    dynarray<light_instance*> lights;
+    ref<light_instance> key_light;
+    ref<light_instance> ambient_light;
+    ref<scene_node> key_light_node;
   
-  // Matrix to transform points in our camera space to the world.
-  // This lets us move our camera
-  mat4t cameraToWorld;
-
-  // shader to draw the final scene
-  texture_shader texture_shader_;
-
-  // mesh for the duck
-  mesh duck_mesh;
-
-  // material for duck.
-  material duck_material;
-
-  // texture for our frame buffer
-  GLuint texture_handle_;
-
-  // container for resources
-  resources dict;
-public:
-
-  // this is called when we construct the class
-  raytrace_app(int argc, char **argv) : app(argc, argv) {
-  }
-
-  // this is called once OpenGL is initialized
-  void app_init() {
-    renderer.init();
-
-    // set up the shader
-    texture_shader_.init();
-
-    // set up the matrices with a camera 5 units from the origin
-    cameraToWorld.loadIdentity();
-    cameraToWorld.translate(0, 0, 5);
-
-    // generate a blank texture
-    glGenTextures(1, &texture_handle_);
-    glBindTexture(GL_TEXTURE_2D, texture_handle_);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image_size, image_size, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    //texture_handle_ = resources::get_texture_handle(GL_RGB, "assets/duckCM.gif");
-
-    collada_builder builder;
-    builder.load_xml("assets/duck_triangulate.dae");
-    //duck_mesh.make_collada_mesh(builder, "LOD3spShape-lib", dict);
-    builder.get_mesh(duck_mesh, "LOD3spShape-lib", dict);
-
-    mat4t mat;
-    mat.loadIdentity();
-    modelToWorld.push_back(mat);
-    meshes.push_back(&duck_mesh);
-    materials.push_back(&duck_material);
-
-    // the original duck is a bit too big, shrink it with a matrix
-    mat4t shrink;
-    shrink.loadIdentity();
-    shrink.translate(0, -50, 0);
-    shrink.scale(0.03f, 0.03f, 0.03f);
-    duck_mesh.transform(attribute_pos, shrink);
-
-    GLuint diffuse = resources::get_texture_handle(GL_RGB, "assets/duckCM.gif");
-    GLuint emission = resources::get_texture_handle(GL_RGB, "#000000");
-    GLuint specular = resources::get_texture_handle(GL_RGB, "#ffffff");
-    GLuint bump = resources::get_texture_handle(GL_RGB, "#0000ff");
-
-    duck_material.init(diffuse, diffuse, emission, specular, bump, 30.0f);
-
-    lights.add_light(vec4(10, 10, 10, 1), vec4(0, 0, 1, 0).normalize(), vec4(0.3f, 0.3f, 0.3f, 1), vec4(1, 1, 1, 1), vec4(1, 1, 1, 1));
-  }
-
-  // this is called to draw the world
-  void draw_world(int x, int y, int w, int h) {
-    // set a viewport - includes whole window area
-    glViewport(x, y, w, h);
-
-    // clear the background to black
-    glClearColor(0, 0, 1, 1);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    // ray trace the scene to the texture
-    raytracer::context ctxt;
-    ctxt.width = image_size;
-    ctxt.height = image_size;
-    ctxt.texture_handle = texture_handle_;
-    ctxt.cameraToWorld = cameraToWorld;
-    ctxt.near_plane = 0.125f;
-    ctxt.far_plane = 128.125f;
-    ctxt.near_plane_xmax = ctxt.near_plane;
-    ctxt.near_plane_ymax = ctxt.near_plane;
-    ctxt.lights = &lights;
-    ctxt.modelToWorld = &modelToWorld[0];
-    ctxt.meshes = &meshes[0];
-    ctxt.materials = &materials[0];
-    ctxt.num_objects = materials.size();
-    renderer.ray_trace(ctxt);
-
-    modelToWorld[0].rotateY(1);
-
-    // set up opengl to draw textured triangles using sampler 0 (GL_TEXTURE0)
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture_handle_);
-
-    // build a projection matrix: model -> world -> camera -> projection
-    // this matrix is used to map the square to fill the screen
-    // in this case we use an "ortho" projection.
-    mat4t modelToProjection;
-    modelToProjection.loadIdentity();
-    modelToProjection.translate(0, 0, 1);
-    modelToProjection.ortho(-1, 1, -1, 1, 0.125f, 128.125);
-    texture_shader_.render(modelToProjection, 0);
-
-    // this is an array of the positions of the corners of the texture in 3D
-    static const float vertices[] = {
-      -1, -1, 0,
-       1, -1, 0,
-       1,  1, 0,
-      -1,  1, 0,
-    };
-
-    // attribute_pos (=0) is position of each corner
-    // each corner has 3 floats (x, y, z)
-    // there is no gap between the 3 floats and hence the stride is 3*sizeof(float)
-    glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)vertices );
-    glEnableVertexAttribArray(attribute_pos);
+    // Matrix to transform points in our camera space to the world.
+    // This lets us move our camera
+    mat4t cameraToWorld;
+
+    // shader to draw the final scene
+    texture_shader texture_shader_;
+
+    // mesh for the duck
+    mesh duck_mesh;
+
+    // material for duck.
+    ref<material> duck_material;
+
+    // texture for our frame buffer
+    GLuint texture_handle_;
+
+    // container for resources
+    resources dict;
+  public:
+
+    // this is called when we construct the class
+    raytrace_app(int argc, char **argv) : app(argc, argv) {
+      progressive = false;
+      was_p_down = false;
+      path_trace_budget = 1.0f / 30;
+
+      // -progressive starts in path tracing mode (eg. for headless runs)
+      for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-progressive")) progressive = true;
+      }
+    }
+
+    // this is called once OpenGL is initialized
+    void app_init() {
+      renderer.init();
+
+      // set up the matrices with a camera 5 units from the origin
+      cameraToWorld.loadIdentity();
+      cameraToWorld.translate(0, 0, 5);
+
+      // with no window we only need the pixels
+      texture_handle_ = 0;
+      if (!is_headless()) {
+        // set up the shader
+        texture_shader_.init();
+
+        // generate a blank texture
+        glGenTextures(1, &texture_handle_);
+        glBindTexture(GL_TEXTURE_2D, texture_handle_);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image_size, image_size, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenerateMipmap(GL_TEXTURE_2D);
+      }
+
+      //texture_handle_ = resources::get_texture_handle(GL_RGB, "assets/duckCM.gif");
+
+      collada_builder builder;
+      builder.load_xml("assets/duck_triangulate.dae");
+      //duck_mesh.make_collada_mesh(builder, "LOD3spShape-lib", dict);
+      builder.get_mesh(duck_mesh, "LOD3spShape-lib", dict);
+      duck_material = new material();
+
+      mat4t mat;
+      mat.loadIdentity();
+      modelToWorld.push_back(mat);
+      meshes.push_back(&duck_mesh);
+      materials.push_back(duck_material);
+
+      // the original duck is a bit too big, shrink it with a matrix
+      mat4t shrink;
+      shrink.loadIdentity();
+      shrink.translate(0, -50, 0);
+      shrink.scale(0.03f, 0.03f, 0.03f);
+      duck_mesh.transform(attribute_pos, shrink);
+
+      param *diffuse = new param(new image("assets/duckCM.gif"));
+      param *emission = new param(vec4(0, 0, 0, 0));
+      param *specular = new param(vec4(1, 1, 1, 1));
+      param *bump = new param(vec4(0.5f, 0.5f, 1, 0));
+      param *shininess = new param(vec4(30.0f/255, 0, 0, 0));
+      duck_material->init(diffuse, diffuse, emission, specular, bump, shininess);
+
+      // a light shining along -z from behind the camera and a little ambient
+      key_light_node = new scene_node();
+      key_light = new light_instance();
+      key_light->set_node(key_light_node);
+      key_light->set_kind(atom_directional);
+      key_light->set_color(vec4(1, 1, 1, 1));
+      ambient_light = new light_instance();
+      ambient_light->set_kind(atom_ambient);
+      ambient_light->set_color(vec4(0.3f, 0.3f, 0.3f, 1));
+      lights.push_back(key_light);
+      lights.push_back(ambient_light);
+    }
+
+    // ray trace the scene to a texture (or just to pixels if texture is 0) and move the duck
+    void trace(GLuint texture) {
+      raytracer::context ctxt;
+      ctxt.width = image_size;
+      ctxt.height = image_size;
+      ctxt.texture_handle = texture;
+      ctxt.cameraToWorld = cameraToWorld;
+      ctxt.near_plane = 0.125f;
+      ctxt.far_plane = 128.125f;
+      ctxt.near_plane_xmax = ctxt.near_plane;
+      ctxt.near_plane_ymax = ctxt.near_plane;
+      ctxt.lights = &lights[0];
+      ctxt.num_lights = lights.size();
+      ctxt.modelToWorld = &modelToWorld[0];
+      ctxt.meshes = &meshes[0];
+      ctxt.materials = &materials[0];
+      ctxt.num_objects = materials.size();
+
+      // P switches between ray tracing and progressive path tracing
+      if (is_key_down('P') && !was_p_down) {
+        progressive = !progressive;
+      }
+      was_p_down = is_key_down('P');
+
+      if (progressive) {
+        // the image gets better while nothing moves
+        renderer.path_trace(ctxt, path_trace_budget);
+        if (is_key_down(key_left)) {
+          modelToWorld[0].rotateY(-2);
+        } else if (is_key_down(key_right)) {
+          modelToWorld[0].rotateY(2);
+        }
+      } else {
+        renderer.ray_trace(ctxt);
+        modelToWorld[0].rotateY(1);
+      }
+    }
+
+    // we only need the CPU to draw this app
+    bool can_run_headless() {
+      return true;
+    }
+
+    // draw a frame with no window and return its pixels
+    const uint8_t *draw_headless(int &width, int &height) {
+      trace(0);
+      width = height = image_size;
+      return renderer.get_pixels();
+    }
+
+    // this is called to draw the world
+    void draw_world(int x, int y, int w, int h) {
+      // set a viewport - includes whole window area
+      glViewport(x, y, w, h);
+
+      // clear the background to black
+      glClearColor(0, 0, 1, 1);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      // ray trace the scene to the texture
+      trace(texture_handle_);
+
+      // set up opengl to draw textured triangles using sampler 0 (GL_TEXTURE0)
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, texture_handle_);
+
+      // build a projection matrix: model -> world -> camera -> projection
+      // this matrix is used to map the square to fill the screen
+      // in this case we use an "ortho" projection.
+      mat4t modelToProjection;
+      modelToProjection.loadIdentity();
+      modelToProjection.translate(0, 0, 1);
+      modelToProjection.ortho(-1, 1, -1, 1, 0.125f, 128.125);
+      texture_shader_.render(modelToProjection, 0);
+
+      // this is an array of the positions of the corners of the texture in 3D
+      static const float vertices[] = {
+        -1, -1, 0,
+         1, -1, 0,
+         1,  1, 0,
+        -1,  1, 0,
+      };
+
+      // attribute_pos (=0) is position of each corner
+      // each corner has 3 floats (x, y, z)
+      // there is no gap between the 3 floats and hence the stride is 3*sizeof(float)
+      glVertexAttribPointer(attribute_pos, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)vertices );
+      glEnableVertexAttribArray(attribute_pos);
     
-    // this is an array of the positions of the corners of the texture in 2D
-    static const float uvs[] = {
-      0, 0,
-      1, 0,
-      1, 1,
-      0, 1,
-    };
-
-    // attribute_uv is position in the texture of each corner
-    // each corner (vertex) has 2 floats (x, y)
-    // there is no gap between the 2 floats and hence the stride is 2*sizeof(float)
-    glVertexAttribPointer(attribute_uv, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)uvs );
-    glEnableVertexAttribArray(attribute_uv);
+      // this is an array of the positions of the corners of the texture in 2D
+      static const float uvs[] = {
+        0, 0,
+        1, 0,
+        1, 1,
+        0, 1,
+      };
+
+      // attribute_uv is position in the texture of each corner
+      // each corner (vertex) has 2 floats (x, y)
+      // there is no gap between the 2 floats and hence the stride is 2*sizeof(float)
+      glVertexAttribPointer(attribute_uv, 2, GL_FLOAT, GL_FALSE, 2*sizeof(float), (void*)uvs );
+      glEnableVertexAttribArray(attribute_uv);
     
-    // finally, draw the texture (3 vertices)
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-  }
-};
+      // finally, draw the texture (3 vertices)
+      glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    }
+  };
+}
@@ -42,6 +42,9 @@ namespace octet {
     // helper for picking objects on the screen
     object_picker picker;
 
+    // draws the scene when there is no window (see headless_runner)
+    raytracer renderer;
+
     // test c/c++ parser
     //cpp_parser parser;
 
@@ -101,8 +104,10 @@ namespace octet {
     // this is called once OpenGL is initialized
     void app_init() {
       // set up the shaders
-      object_shader.init(false);
-      skin_shader.init(true);
+      if (!is_headless()) {
+        object_shader.init(false);
+        skin_shader.init(true);
+      }
 
       const char *filename = 0;
 
@@ -120,9 +125,71 @@ namespace octet {
 
       load_file(filename);
 
-      overlay.init();
-      server.init(&dict);
-      picker.init(this);
+      if (!is_headless()) {
+        overlay.init();
+        server.init(&dict);
+        picker.init(this);
+      }
+    }
+
+    // we can draw the scene with the CPU ray tracer
+    bool can_run_headless() {
+      return true;
+    }
+
+    // animate the scene and ray trace it from the first camera.
+    // skinned meshes are posed on the CPU (see mesh_instance::get_posed_mesh()).
+    const uint8_t *draw_headless(int &width, int &height) {
+      enum { image_size = 256 };
+
+      scene *app_scene = dict.get_active_scene();
+      if (!app_scene || !app_scene->get_num_camera_instances()) {
+        return 0;
+      }
+
+      // update matrices. assume 30 fps.
+      app_scene->update(1.0f/30);
+
+      dynarray<mat4t> modelToWorld;
+      dynarray<mesh*> meshes;
+      dynarray<material*> materials;
+      for (int i = 0; i != app_scene->get_num_mesh_instances(); ++i) {
+        mesh_instance *mi = app_scene->get_mesh_instance(i);
+        if (mi && mi->get_node() && mi->get_mesh() && mi->get_material()) {
+          modelToWorld.push_back(mi->get_node()->get_modelToWorld());
+          meshes.push_back(mi->get_posed_mesh());
+          materials.push_back(mi->get_material());
+        }
+      }
+
+      dynarray<light_instance*> lights;
+      for (int i = 0; i != app_scene->get_num_light_instances(); ++i) {
+        lights.push_back(app_scene->get_light_instance(i));
+      }
+
+      camera_instance *cam = app_scene->get_camera_instance(0);
+      mat4t cameraToWorld = cam->get_node()->get_modelToWorld();
+      cam->set_cameraToWorld(cameraToWorld, 1.0f);
+
+      raytracer::context ctxt;
+      ctxt.width = image_size;
+      ctxt.height = image_size;
+      ctxt.texture_handle = 0;
+      ctxt.cameraToWorld = cameraToWorld;
+      ctxt.near_plane = cam->get_nearVal();
+      ctxt.far_plane = cam->get_farVal();
+      ctxt.near_plane_xmax = ctxt.near_plane * cam->get_xscale();
+      ctxt.near_plane_ymax = ctxt.near_plane * cam->get_yscale();
+      ctxt.lights = lights.size() ? &lights[0] : 0;
+      ctxt.num_lights = lights.size();
+      ctxt.modelToWorld = meshes.size() ? &modelToWorld[0] : 0;
+      ctxt.meshes = meshes.size() ? &meshes[0] : 0;
+      ctxt.materials = meshes.size() ? &materials[0] : 0;
+      ctxt.num_objects = meshes.size();
+      renderer.ray_trace(ctxt);
+
+      width = height = image_size;
+      return renderer.get_pixels();
     }
 
     // this is called to draw the world
@@ -10,6 +10,7 @@
 //
 
 #include "../../platform/platform.h"
+#include "../../raytracer/raytracer.h"
 #include "engine.h"
 
 //
@@ -20,6 +21,15 @@ int main(int argc, char **argv) {
   //octet::unit_test_ray();
 
   octet::app_utils::prefix("../../");
+
+  // engine -headless -frames=30 -out=scene%02d.ppm draws with no window
+  if (octet::headless_runner::is_requested(argc, argv)) {
+    octet::engine app(argc, argv);
+    octet::headless_runner runner;
+    runner.init(argc, argv);
+    return runner.run(&app, "engine") ? 0 : 1;
+  }
+
   octet::app::init_all(argc, argv);
   octet::engine app(argc, argv);
   app.init();
@@ -0,0 +1,216 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Run apps with no window, eg. for tests and timing on machines with no display.
+//
+// example:
+//
+//   examples raytrace -headless -frames=100 -out=frame%04d.ppm
+//
+// options:
+//   -headless      run with no window or OpenGL
+//   -frames=N      number of frames to draw (default 10)
+//   -out=pattern   write each frame to a PPM file, eg. frame%04d.ppm (one %d only)
+//   -raw=file      write all the frames one after another to a file of raw RGB bytes
+//
+// The app must override can_run_headless() and draw_headless(), which updates the
+// world and draws it with the CPU ray tracer. We print the time of each frame.
+//
+// Headless builds (OCTET_HEADLESS, see headless_specific.h) have no window, so they
+// always run this way.
+//
+
+namespace octet {
+  class headless_runner {
+    int num_frames;
+    const char *out_pattern;
+    const char *raw_path;
+    bool keep_frames;
+
+    // seconds for each frame of the last run
+    dynarray<double> frame_times;
+
+    // every frame of the last run if keep_frames is set
+    dynarray<uint8_t> frames;
+    int frame_width;
+    int frame_height;
+
+  public:
+    headless_runner() {
+      num_frames = 10;
+      out_pattern = 0;
+      raw_path = 0;
+      keep_frames = false;
+      frame_width = frame_height = 0;
+    }
+
+    // true if the command line has -headless or this is a headless build
+    static bool is_requested(int argc, char **argv) {
+      if (OCTET_HEADLESS) return true;
+      for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-headless")) return true;
+      }
+      return false;
+    }
+
+    // read -frames, -out and -raw from the command line
+    void init(int argc, char **argv) {
+      for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (!strncmp(arg, "-frames=", 8)) {
+          int value = atoi(arg + 8);
+          if (value > 0) {
+            num_frames = value;
+          } else {
+            printf("%s: needs a positive number of frames, using %d\n", arg, num_frames);
+          }
+        } else if (!strncmp(arg, "-out=", 5)) {
+          out_pattern = arg + 5;
+        } else if (!strncmp(arg, "-raw=", 5)) {
+          raw_path = arg + 5;
+        }
+      }
+    }
+
+    void set_num_frames(int value) {
+      num_frames = value;
+    }
+
+    // true if pattern has exactly one %d (with optional flags and width, eg. %04d)
+    // and no other conversions except %%, so it is safe to pass to snprintf.
+    static bool is_valid_pattern(const char *pattern) {
+      int num_ints = 0;
+      for (const char *p = pattern; *p; ++p) {
+        if (*p != '%') continue;
+        ++p;
+        if (*p == '%') continue;
+        while (*p == '0' || *p == '-' || *p == '+' || *p == ' ') ++p;
+        while (*p >= '0' && *p <= '9') ++p;
+        if (*p != 'd') return false;
+        ++num_ints;
+      }
+      return num_ints == 1;
+    }
+
+    // printf pattern for the file name of each frame or 0 for no files
+    void set_out_pattern(const char *value) {
+      out_pattern = value;
+    }
+
+    // keep the frames in memory, see get_frames()
+    void set_keep_frames(bool value) {
+      keep_frames = value;
+    }
+
+    // call app_init() and draw num_frames frames. false if the app can't run headless.
+    bool run(app_common *the_app, const char *name) {
+      if (!the_app->can_run_headless()) {
+        printf("%s: needs a window, can't run headless\n", name);
+        return false;
+      }
+
+      if (out_pattern && !is_valid_pattern(out_pattern)) {
+        printf("%s: -out=%s needs exactly one %%d for the frame number\n", name, out_pattern);
+        return false;
+      }
+
+      app_common::set_headless(true);
+      double start_time = app_utils::get_time();
+      the_app->app_init();
+      printf("%s: init %.2f ms\n", name, (app_utils::get_time() - start_time) * 1000);
+
+      FILE *raw_file = raw_path ? fopen(raw_path, "wb") : 0;
+      frame_times.resize(0);
+      frames.resize(0);
+      double total = 0, min_time = 1e37, max_time = 0;
+      for (int frame = 0; frame < num_frames; ++frame) {
+        start_time = app_utils::get_time();
+        int width = 0, height = 0;
+        const uint8_t *pixels = the_app->draw_headless(width, height);
+        the_app->inc_frame_number();
+        double time = app_utils::get_time() - start_time;
+        if (!pixels) {
+          printf("%s: frame %d: no image\n", name, frame);
+          break;
+        }
+
+        frame_times.push_back(time);
+        total += time;
+        min_time = min(min_time, time);
+        max_time = max(max_time, time);
+        printf("%s: frame %d: %.2f ms\n", name, frame, time * 1000);
+
+        unsigned size = width * height * 3;
+        if (out_pattern) {
+          char path[256];
+          #ifdef WIN32
+            int len = _snprintf_s(path, sizeof(path), _TRUNCATE, out_pattern, frame);
+          #else
+            int len = snprintf(path, sizeof(path), out_pattern, frame);
+          #endif
+          if (len < 0 || len >= (int)sizeof(path)) {
+            printf("%s: file name too long for frame %d\n", name, frame);
+          } else if (!write_ppm(path, pixels, width, height)) {
+            printf("%s: could not write %s\n", name, path);
+          }
+        }
+        if (raw_file) {
+          fwrite(pixels, 1, size, raw_file);
+        }
+        if (keep_frames) {
+          unsigned offset = frames.size();
+          frames.resize(offset + size);
+          memcpy(&frames[offset], pixels, size);
+        }
+        frame_width = width;
+        frame_height = height;
+      }
+
+      if (raw_file) {
+        fclose(raw_file);
+      }
+
+      unsigned n = frame_times.size();
+      if (n) {
+        printf("%s: %d frames of %dx%d: mean %.2f ms min %.2f ms max %.2f ms\n",
+          name, n, frame_width, frame_height, total * 1000 / n, min_time * 1000, max_time * 1000
+        );
+      }
+      app_common::set_headless(false);
+      return n == (unsigned)num_frames;
+    }
+
+    // seconds for each frame of the last run
+    const dynarray<double> &get_frame_times() const {
+      return frame_times;
+    }
+
+    // RGB bytes of every frame of the last run, one after another (see set_keep_frames)
+    const dynarray<uint8_t> &get_frames() const {
+      return frames;
+    }
+
+    int get_frame_width() const {
+      return frame_width;
+    }
+
+    int get_frame_height() const {
+      return frame_height;
+    }
+
+    // write an RGB image, bottom row first, to a binary PPM file
+    static bool write_ppm(const char *path, const uint8_t *pixels, int width, int height) {
+      FILE *file = fopen(path, "wb");
+      if (!file) return false;
+      fprintf(file, "P6\n%d %d\n255\n", width, height);
+      for (int y = height - 1; y >= 0; --y) {
+        fwrite(pixels + y * width * 3, 1, width * 3, file);
+      }
+      fclose(file);
+      return true;
+    }
+  };
+}
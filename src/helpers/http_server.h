@@ -31,64 +31,73 @@ namespace octet {
     }
 
     void parse_http_request(session &s, char *p) {
-      string header(p);
+      allocator::site_scope site("http_server");
+      // all the pieces of the request are slices of p, so we don't copy any text.
+      slice header(p);
 
-      dynarray<string> lines;
+      dynarray<slice> lines;
       lines.reserve(32);
       header.split(lines, "\n");
       if (lines.size() == 0) return;
 
-      dynarray<string> line0;
+      dynarray<slice> line0;
       lines[0].split(line0, " ");
       if (line0.size() < 3) return;
       if (line0[0] != "GET") return;
 
-      app_utils::log("http get from: %s\n", line0[1].c_str());
+      app_utils::log("http get from: %.*s\n", (int)line0[1].size(), line0[1].data());
 
       // /graph?operation=get_children&id=1
-      dynarray<string> url;
+      dynarray<slice> url;
       line0[1].split(url, "?");
       if (url.size() < 2) return;
 
-      dynarray<string> ops;
+      dynarray<slice> ops;
       url[1].split(ops, "&");
       string id;
       string callback;
       bool get_children = false;
+      bool get_memory = false;
+      bool get_live = false;
+      dynarray<slice> lhsrhs;
       for (unsigned i = 0; i != ops.size(); ++i) {
-        dynarray<string> lhsrhs;
         ops[i].split(lhsrhs, "=");
+        if (lhsrhs.size() < 2) continue;
         if (lhsrhs[0] == "operation") {
           get_children = lhsrhs[1] == "get_children";
+          get_memory = lhsrhs[1] == "get_memory";
+          get_live = lhsrhs[1] == "get_live";
         } else if (lhsrhs[0] == "id") {
           id = lhsrhs[1];
         } else if (lhsrhs[0] == "callback") {
           callback = lhsrhs[1];
         }
-        //app_utils::log("%s = %s\n", lhsrhs[0].c_str(), lhsrhs[1].c_str());
       }
 
-      if (!get_children) return;
+      if (!get_children && !get_memory && !get_live) return;
 
       //dynarray<string> id_parts;
       //id.split(id_parts, ".");
 
-      dynarray<string> response;
-      response.reserve(64);
-      int max_depth = 5;
-      http_writer writer(0, max_depth, response);
-      response.resize(response.size()+1);
-      response.back().format("%s([\n", callback.c_str());
-      dict->visit(writer);
-      response.resize(response.size()+1);
-      response.back().format("])\n");
+      string prefix;
+      prefix.format("%s([\n", callback.c_str());
+      const char suffix[] = "])\n";
+
+      http_writer::response_t response;
+      response.reserve(0x10000);
+      if (get_memory) {
+        write_memory_stats(response);
+      } else if (get_live) {
+        write_live_blocks(response);
+      } else {
+        int max_depth = 5;
+        http_writer writer(0, max_depth, response);
+        dict->visit(writer);
+      }
 
       // With HTTP 1.1 we can keep the connection open and respond to more
       // feeds without the overhead of a new connection.
-      unsigned num_bytes = 0;
-      for (unsigned i = 0; i != response.size(); ++i) {
-        num_bytes += response[i].size();
-      }
+      unsigned num_bytes = prefix.size() + response.size() + sizeof(suffix) - 1;
 
       string response_header;
       response_header.format(
@@ -101,10 +110,44 @@ namespace octet {
 
       send(s.client_socket, response_header.c_str(), response_header.size(), 0);
 
-      for (unsigned i = 0; i != response.size(); ++i) {
-        app_utils::log("send: %s", response[i].c_str());
-        send(s.client_socket, response[i].c_str(), response[i].size(), 0);
+      send(s.client_socket, prefix.c_str(), prefix.size(), 0);
+      if (response.size()) {
+        send(s.client_socket, &response[0], response.size(), 0);
+      }
+      send(s.client_socket, suffix, sizeof(suffix) - 1, 0);
+    }
+
+    // /graph?operation=get_memory&callback=x
+    void write_memory_stats(http_writer::response_t &response) {
+      http_writer::append(response, "{ \"num_bytes\": %d, \"max_bytes\": %d, \"num_live\": %d,\n",
+        allocator::get_num_bytes(), allocator::get_max_bytes(), allocator::get_num_live()
+      );
+      http_writer::append(response, "  \"classes\": [\n");
+      for (int i = 0; i != allocator::get_num_classes(); ++i) {
+        allocator::class_stats cs = allocator::get_class_stats(i);
+        http_writer::append(response, "    { \"size\": %d, \"blocks\": %d, \"max_blocks\": %d, \"allocs\": %d }%s\n",
+          cs.block_size, cs.num_blocks, cs.max_blocks, cs.num_allocs, i == allocator::get_num_classes() - 1 ? "" : ","
+        );
       }
+      http_writer::append(response, "  ],\n  \"sites\": [\n");
+      for (int i = 0; i != allocator::get_num_sites(); ++i) {
+        allocator::site_stats ss = allocator::get_site_stats(i);
+        http_writer::append(response, "    { \"name\": \"%s\", \"bytes\": %d, \"max_bytes\": %d, \"allocs\": %d, \"total_bytes\": %d }%s\n",
+          ss.name, ss.num_bytes, ss.max_bytes, ss.num_allocs, ss.total_bytes, i == allocator::get_num_sites() - 1 ? "" : ","
+        );
+      }
+      http_writer::append(response, "  ]\n}\n");
+    }
+
+    static void append_live_block(void *context, void *ptr, size_t size, const char *site) {
+      // the response is in the frame arena, so this does not touch the allocator's locks.
+      http_writer::append(*(http_writer::response_t*)context, "  [\"%p\", %d, \"%s\"],\n", ptr, (int)size, site);
+    }
+
+    // /graph?operation=get_live&callback=x
+    void write_live_blocks(http_writer::response_t &response) {
+      allocator::for_each_live(append_live_block, (void*)&response);
+      http_writer::append(response, "  null\n");
     }
 
   public:
@@ -96,7 +96,7 @@ namespace octet {
     }
 
     // convert a string like "1.2 3.4 43.12" into an array of float values
-    void atofv(dynarray<float> &values, const char *src) {  
+    template <class allocator_t> void atofv(dynarray<float, allocator_t> &values, const char *src) {
       values.resize(0);
       if (!src) return;
 
@@ -127,7 +127,7 @@ namespace octet {
     }
 
     // convert an ascii sequence of integers like "1 3 9 12 34" to an array of integers
-    void atoiv(dynarray<int> &values, const char *src) {  
+    template <class allocator_t> void atoiv(dynarray<int, allocator_t> &values, const char *src) {
       values.resize(0);
       if (!src) return;
 
@@ -141,23 +141,16 @@ namespace octet {
       }
     }
 
-    // convert an ascii sequence of integers like "fred bert harry" into an array of strings
-    void atonv(dynarray<string> &values, const char *src) {
+    // convert an ascii sequence of names like "fred bert harry" into an array of slices of src
+    void atonv(dynarray<slice> &values, const char *src) {
       values.resize(0);
       if (!src) return;
 
       while (*src != 0 && *src <= ' ') ++src;
       while(*src != 0) {
-        int index = (int)values.size();
-        values.resize(index + 1);
-        char tmp[128];
-        int i = 0;
-        while (*src != 0 && *src != ' ') {
-          if (i < sizeof(tmp)-1) tmp[i++] = *src;
-          src++;
-        }
-        tmp[i] = 0;
-        values[index] = tmp;
+        const char *start = src;
+        while (*src < 0 || *src > ' ') ++src;
+        values.push_back(slice(start, (unsigned)(src - start)));
         while (*src != 0 && *src <= ' ') ++src;
       }
     }
@@ -179,11 +172,12 @@ namespace octet {
     };
 
     // a structure to keep track of the complex COLLADA <input> tags
+    // the arrays are temporary, so they come from the load arena.
     struct parse_input_state {
       mesh *s;
-      dynarray<int> p;
-      dynarray<float> vertices;
-      dynarray<unsigned> indices;
+      dynarray<int, load_allocator> p;
+      dynarray<float, load_allocator> vertices;
+      dynarray<unsigned, load_allocator> indices;
       unsigned attr_offset;
       unsigned attr_stride;
       unsigned input_offset;
@@ -292,7 +286,7 @@ namespace octet {
         state.s->add_attribute(attr, size, GL_FLOAT, state.attr_offset * 4);
         state.attr_offset += size;
       } else if (state.pass == 2) {
-        dynarray<float> accessor_floats;
+        dynarray<float, load_allocator> accessor_floats;
         if (!strcmp(accessor_source_elem->Value(), "float_array")) {
           atofv(accessor_floats, accessor_source_elem->GetText());
         }
@@ -332,7 +326,7 @@ namespace octet {
             state.skinst->raw_indices[i] = src_idx;
           }
         } else if (!strcmp(semantic, "WEIGHT")) {
-          dynarray<float> accessor_floats;
+          dynarray<float, load_allocator> accessor_floats;
           atofv(accessor_floats, accessor_source_elem->GetText());
           assert(state.skinst->raw_weights.size() >= num_vertices);
           for (unsigned i = 0; i != num_vertices; ++i) {
@@ -693,13 +687,14 @@ namespace octet {
 
         skin *mesh_skin = new skin(modelToBind);
 
-        dynarray<string> joints;
+        // the joint names are slices of skinst.joints
+        dynarray<slice> joints;
         atonv(joints, skinst.joints);
 
         for (unsigned i = 0; i != joints.size(); ++i) {
           mat4t bindToModel;
           bindToModel.init_transpose(&skinst.inv_bind_matrices[i*16]);
-          mesh_skin->add_joint(bindToModel, app_utils::get_atom(joints[i]));
+          mesh_skin->add_joint(bindToModel, app_utils::get_atom(joints[i].data(), joints[i].size()));
         }
 
         TiXmlElement *vertex_weights = child(skin_elem, "vertex_weights");
@@ -774,7 +769,7 @@ namespace octet {
           if (sampler_elem) {
             dynarray<float> times;
             dynarray<float> values;
-            //dynarray<string> interpolation;
+            //dynarray<slice> interpolation;
 
             TiXmlElement *input = child(sampler_elem, "input");
             while (input) {
@@ -903,7 +898,7 @@ namespace octet {
 
     // if we have a vcount element (polylist), we build polygons out of triangles
     // and hope they are convex!
-    unsigned convert_polygons_to_triangles(parse_input_state &state, dynarray<int> &vcount) {
+    unsigned convert_polygons_to_triangles(parse_input_state &state, dynarray<int, load_allocator> &vcount) {
       unsigned num_indices = 0;
       for (unsigned i = 0; i != vcount.size(); ++i) {
         unsigned nv = vcount[i];
@@ -964,6 +959,8 @@ namespace octet {
       app_utils::log("created mesh %s\n", id);
       dict.set_resource(mesh_url, mesh);
 
+      // all the temporary arrays are thrown away when we are done with this mesh
+      load_allocator::scope scope;
       parse_input_state state;
       state.s = mesh;
       atoiv(state.p, pelem->GetText());
@@ -1055,7 +1052,7 @@ namespace octet {
       unsigned num_indices = 0;
       if (vcount_elem) {
         // polygons
-        dynarray<int> vcount;
+        dynarray<int, load_allocator> vcount;
         atoiv(vcount, vcount_elem->GetText());
         num_indices = convert_polygons_to_triangles(state, vcount);
       } else {
@@ -1221,6 +1218,7 @@ namespace octet {
 
     // public function to load a collada file
     bool load_xml(const char *url) {
+      allocator::site_scope site("collada");
       doc_path = url;
       doc_path.truncate(doc_path.filename_pos());
       doc.LoadFile(app_utils::get_path(url));
@@ -1270,6 +1268,8 @@ namespace octet {
 
     // extract resources from the collada file into a collection.
     void get_resources(resources &dict) {
+      allocator::site_scope site("collada");
+
       add_images(dict);
 
       add_materials(dict);
@@ -48,12 +48,13 @@ namespace octet {
     }
 
     aabb get_transform(const mat4t &mat) const {
-      vec3 half =
-        half_extent.x() * abs(mat.x().xyz()) +
-        half_extent.y() * abs(mat.y().xyz()) +
-        half_extent.z() * abs(mat.z().xyz())
+      // work in vec4s so that this uses SIMD when it is available
+      vec4 half =
+        abs(mat.x()) * half_extent.x() +
+        abs(mat.y()) * half_extent.y() +
+        abs(mat.z()) * half_extent.z()
       ;
-      return aabb((center.xyz1() * mat).xyz(), half);
+      return aabb(mat.lmul(center.xyz1()).xyz(), half.xyz());
     }
 
     const char *toString() const {
@@ -74,5 +75,7 @@ namespace octet {
       return all(diff <= limit);
     }
   };
+
+  OCTET_RELOCATABLE(aabb)
 }
 
@@ -17,14 +17,26 @@ namespace octet {
     bvec4(bool x, bool y, bool z, bool w) { v[0] = x ? -1 : 0; v[1] = y ? -1 : 0; v[2] = z ? -1 : 0; v[3] = w ? -1 : 0; };
     bvec4(int x, int y, int z, int w) { v[0] = x; v[1] = y; v[2] = z; v[3] = w; };
 
+    #if OCTET_SIMD
+      // from a SIMD compare mask
+      explicit bvec4(simd4 m) { simd_store(v, m); }
+      simd4 get_simd() const { return simd_load(v); }
+    #endif
+
     int &operator[](int i) { return v[i]; }
     const int &operator[](int i) const { return v[i]; }
     bvec4 operator&(int r) const { return bvec4(v[0]&r, v[1]&r, v[2]&r, v[3]&r); }
     bvec4 operator|(int r) const { return bvec4(v[0]|r, v[1]|r, v[2]|r, v[3]|r); }
     bvec4 operator^(int r) const { return bvec4(v[0]^r, v[1]^r, v[2]^r, v[3]^r); }
-    bvec4 operator&(const bvec4 &r) const { return bvec4(v[0]&r.v[0], v[1]&r.v[1], v[2]&r.v[2], v[3]&r.v[3]); }
-    bvec4 operator|(const bvec4 &r) const { return bvec4(v[0]|r.v[0], v[1]|r.v[1], v[2]|r.v[2], v[3]|r.v[3]); }
-    bvec4 operator^(const bvec4 &r) const { return bvec4(v[0]^r.v[0], v[1]^r.v[1], v[2]^r.v[2], v[3]^r.v[3]); }
+    #if OCTET_SIMD
+      bvec4 operator&(const bvec4 &r) const { return bvec4(simd_and(get_simd(), r.get_simd())); }
+      bvec4 operator|(const bvec4 &r) const { return bvec4(simd_or(get_simd(), r.get_simd())); }
+      bvec4 operator^(const bvec4 &r) const { return bvec4(simd_xor(get_simd(), r.get_simd())); }
+    #else
+      bvec4 operator&(const bvec4 &r) const { return bvec4(v[0]&r.v[0], v[1]&r.v[1], v[2]&r.v[2], v[3]&r.v[3]); }
+      bvec4 operator|(const bvec4 &r) const { return bvec4(v[0]|r.v[0], v[1]|r.v[1], v[2]|r.v[2], v[3]|r.v[3]); }
+      bvec4 operator^(const bvec4 &r) const { return bvec4(v[0]^r.v[0], v[1]^r.v[1], v[2]^r.v[2], v[3]^r.v[3]); }
+    #endif
     bvec4 &operator&=(const bvec4 &r) { v[0] &= r.v[0]; v[1] &= r.v[1]; v[2] &= r.v[2]; v[3] &= r.v[3]; return *this; }
     bvec4 &operator|=(const bvec4 &r) { v[0] |= r.v[0]; v[1] |= r.v[1]; v[2] |= r.v[2]; v[3] |= r.v[3]; return *this; }
     bvec4 &operator^=(const bvec4 &r) { v[0] ^= r.v[0]; v[1] ^= r.v[1]; v[2] ^= r.v[2]; v[3] ^= r.v[3]; return *this; }
@@ -42,19 +54,38 @@ namespace octet {
     int w() const { return v[3]; }
   };
 
-  inline bvec4 operator>(const vec4 &lhs, const vec4 &rhs) { return bvec4(fgt(lhs.x(), rhs.x()), fgt(lhs.y(), rhs.y()), fgt(lhs.z(), rhs.z()), fgt(lhs.w(), rhs.w())); }
-  inline bvec4 operator<(const vec4 &lhs, const vec4 &rhs) { return bvec4(flt(lhs.x(), rhs.x()), flt(lhs.y(), rhs.y()), flt(lhs.z(), rhs.z()), flt(lhs.w(), rhs.w())); }
-  inline bvec4 operator>=(const vec4 &lhs, const vec4 &rhs) { return bvec4(fge(lhs.x(), rhs.x()), fge(lhs.y(), rhs.y()), fge(lhs.z(), rhs.z()), fge(lhs.w(), rhs.w())); }
-  inline bvec4 operator<=(const vec4 &lhs, const vec4 &rhs) { return bvec4(fle(lhs.x(), rhs.x()), fle(lhs.y(), rhs.y()), fle(lhs.z(), rhs.z()), fle(lhs.w(), rhs.w())); }
-  inline bvec4 operator==(const vec4 &lhs, const vec4 &rhs) { return bvec4(feq(lhs.x(), rhs.x()), feq(lhs.y(), rhs.y()), feq(lhs.z(), rhs.z()), feq(lhs.w(), rhs.w())); }
-  inline bvec4 operator!=(const vec4 &lhs, const vec4 &rhs) { return bvec4(fne(lhs.x(), rhs.x()), fne(lhs.y(), rhs.y()), fne(lhs.z(), rhs.z()), fne(lhs.w(), rhs.w())); }
+  #if OCTET_SIMD
+    inline bvec4 operator>(const vec4 &lhs, const vec4 &rhs) { return bvec4(simd_cmpgt(lhs.get_simd(), rhs.get_simd())); }
+    inline bvec4 operator<(const vec4 &lhs, const vec4 &rhs) { return bvec4(simd_cmplt(lhs.get_simd(), rhs.get_simd())); }
+    inline bvec4 operator>=(const vec4 &lhs, const vec4 &rhs) { return bvec4(simd_cmpge(lhs.get_simd(), rhs.get_simd())); }
+    inline bvec4 operator<=(const vec4 &lhs, const vec4 &rhs) { return bvec4(simd_cmple(lhs.get_simd(), rhs.get_simd())); }
+    inline bvec4 operator==(const vec4 &lhs, const vec4 &rhs) { return bvec4(simd_cmpeq(lhs.get_simd(), rhs.get_simd())); }
+    inline bvec4 operator!=(const vec4 &lhs, const vec4 &rhs) { return bvec4(simd_cmpne(lhs.get_simd(), rhs.get_simd())); }
+
+    inline bool all(const bvec4 &b) {
+      return simd_movemask(b.get_simd()) == 15;
+    }
+
+    inline bool any(const bvec4 &b) {
+      return simd_movemask(b.get_simd()) != 0;
+    }
+  #else
+    inline bvec4 operator>(const vec4 &lhs, const vec4 &rhs) { return bvec4(fgt(lhs.x(), rhs.x()), fgt(lhs.y(), rhs.y()), fgt(lhs.z(), rhs.z()), fgt(lhs.w(), rhs.w())); }
+    inline bvec4 operator<(const vec4 &lhs, const vec4 &rhs) { return bvec4(flt(lhs.x(), rhs.x()), flt(lhs.y(), rhs.y()), flt(lhs.z(), rhs.z()), flt(lhs.w(), rhs.w())); }
+    inline bvec4 operator>=(const vec4 &lhs, const vec4 &rhs) { return bvec4(fge(lhs.x(), rhs.x()), fge(lhs.y(), rhs.y()), fge(lhs.z(), rhs.z()), fge(lhs.w(), rhs.w())); }
+    inline bvec4 operator<=(const vec4 &lhs, const vec4 &rhs) { return bvec4(fle(lhs.x(), rhs.x()), fle(lhs.y(), rhs.y()), fle(lhs.z(), rhs.z()), fle(lhs.w(), rhs.w())); }
+    inline bvec4 operator==(const vec4 &lhs, const vec4 &rhs) { return bvec4(feq(lhs.x(), rhs.x()), feq(lhs.y(), rhs.y()), feq(lhs.z(), rhs.z()), feq(lhs.w(), rhs.w())); }
+    inline bvec4 operator!=(const vec4 &lhs, const vec4 &rhs) { return bvec4(fne(lhs.x(), rhs.x()), fne(lhs.y(), rhs.y()), fne(lhs.z(), rhs.z()), fne(lhs.w(), rhs.w())); }
+
+    inline bool all(const bvec4 &b) {
+      return (b.x() & b.y() & b.z() & b.w()) < 0;
+    }
 
-  bool all(const bvec4 &b) {
-    return (b.x() & b.y() & b.z() & b.w()) < 0;
-  }
+    inline bool any(const bvec4 &b) {
+      return (b.x() | b.y() | b.z() | b.w()) < 0;
+    }
+  #endif
 
-  bool any(const bvec4 &b) {
-    return (b.x() | b.y() | b.z() | b.w()) < 0;
-  }
+  OCTET_RELOCATABLE(bvec4)
 }
 
@@ -0,0 +1,144 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// View frustum for culling bounding boxes that are off the screen
+//
+// The six planes come straight from a worldToProjection matrix: a point is on
+// the screen if -w <= x, y, z <= w after the projection, so each plane is the w
+// column of the matrix plus or minus one of the others.
+//
+// example:
+//
+//   frustum view(worldToCamera * cameraToProjection);
+//   if (view.is_visible(modelToWorld_box)) {
+//     ... draw it
+//   }
+//
+// test_aabbs() checks a whole array of boxes. With SIMD it tests four planes at once.
+//
+
+namespace octet {
+  class frustum {
+    // the planes are nx * x + ny * y + nz * z + d >= 0 on the inside.
+    // we keep eight (the last two repeat the first two) in structure of arrays
+    // so that SIMD can do two groups of four.
+    enum { num_planes = 6, padded_planes = 8 };
+    float nx[padded_planes], ny[padded_planes], nz[padded_planes], d[padded_planes];
+
+    // abs(n) for the box radius
+    float ax[padded_planes], ay[padded_planes], az[padded_planes];
+
+    void set_plane(int i, const vec4 &plane) {
+      // scale to a unit normal so that distances are in world units
+      float len = plane.xyz().length();
+      float scale = len > 0 ? 1.0f / len : 0.0f;
+      nx[i] = plane.x() * scale;
+      ny[i] = plane.y() * scale;
+      nz[i] = plane.z() * scale;
+      d[i] = plane.w() * scale;
+      ax[i] = fabsf(nx[i]);
+      ay[i] = fabsf(ny[i]);
+      az[i] = fabsf(nz[i]);
+    }
+
+  public:
+    // results of classify()
+    enum { outside, intersecting, inside };
+
+    // a frustum that contains everything
+    frustum() {
+      for (int i = 0; i != padded_planes; ++i) {
+        set_plane(i, vec4(0, 0, 0, 1));
+      }
+    }
+
+    explicit frustum(const mat4t &worldToProjection) {
+      init(worldToProjection);
+    }
+
+    // get the planes from a world to projection matrix, eg. from a camera_instance.
+    void init(const mat4t &worldToProjection) {
+      vec4 x = worldToProjection.colx();
+      vec4 y = worldToProjection.coly();
+      vec4 z = worldToProjection.colz();
+      vec4 w = worldToProjection.colw();
+      set_plane(0, w + x);
+      set_plane(1, w - x);
+      set_plane(2, w + y);
+      set_plane(3, w - y);
+      set_plane(4, w + z);
+      set_plane(5, w - z);
+      set_plane(6, w + x);
+      set_plane(7, w - x);
+    }
+
+    // plane i as (nx, ny, nz, d)
+    vec4 get_plane(int i) const {
+      return vec4(nx[i], ny[i], nz[i], d[i]);
+    }
+
+    // false if the box is completely outside one of the planes.
+    // boxes near the corners can be kept when they are really off the screen, which is safe.
+    bool is_visible(const aabb &box) const {
+      vec3 c = box.get_center(), h = box.get_half_extent();
+      for (int i = 0; i != num_planes; ++i) {
+        float dist = nx[i] * c.x() + ny[i] * c.y() + nz[i] * c.z() + d[i];
+        float radius = ax[i] * h.x() + ay[i] * h.y() + az[i] * h.z();
+        if (dist + radius < 0) return false;
+      }
+      return true;
+    }
+
+    // is the box min..max outside, inside or crossing the frustum? (eg. for bvh nodes)
+    int classify(const float *min, const float *max) const {
+      float cx = (min[0] + max[0]) * 0.5f, cy = (min[1] + max[1]) * 0.5f, cz = (min[2] + max[2]) * 0.5f;
+      float hx = (max[0] - min[0]) * 0.5f, hy = (max[1] - min[1]) * 0.5f, hz = (max[2] - min[2]) * 0.5f;
+      int result = inside;
+      for (int i = 0; i != num_planes; ++i) {
+        float dist = nx[i] * cx + ny[i] * cy + nz[i] * cz + d[i];
+        float radius = ax[i] * hx + ay[i] * hy + az[i] * hz;
+        if (dist + radius < 0) return outside;
+        if (dist - radius < 0) result = intersecting;
+      }
+      return result;
+    }
+
+    // set visible[i] to 1 for boxes that may be on the screen and 0 for the others.
+    // returns the number of visible boxes.
+    unsigned test_aabbs(uint8_t *visible, const aabb *boxes, unsigned count) const {
+      unsigned num_visible = 0;
+      #if OCTET_SIMD
+        simd4 nx0 = simd_load(nx), ny0 = simd_load(ny), nz0 = simd_load(nz), d0 = simd_load(d);
+        simd4 nx1 = simd_load(nx + 4), ny1 = simd_load(ny + 4), nz1 = simd_load(nz + 4), d1 = simd_load(d + 4);
+        simd4 ax0 = simd_load(ax), ay0 = simd_load(ay), az0 = simd_load(az);
+        simd4 ax1 = simd_load(ax + 4), ay1 = simd_load(ay + 4), az1 = simd_load(az + 4);
+        simd4 zero = simd_zero();
+        for (unsigned i = 0; i != count; ++i) {
+          vec3 c = boxes[i].get_center(), h = boxes[i].get_half_extent();
+          simd4 cx = simd_splat(c.x()), cy = simd_splat(c.y()), cz = simd_splat(c.z());
+          simd4 hx = simd_splat(h.x()), hy = simd_splat(h.y()), hz = simd_splat(h.z());
+
+          // dist + radius for planes 0-3 and 4-7
+          simd4 e0 = simd_add(simd_add(simd_mul(nx0, cx), simd_mul(ny0, cy)), simd_add(simd_mul(nz0, cz), d0));
+          e0 = simd_add(e0, simd_add(simd_add(simd_mul(ax0, hx), simd_mul(ay0, hy)), simd_mul(az0, hz)));
+          simd4 e1 = simd_add(simd_add(simd_mul(nx1, cx), simd_mul(ny1, cy)), simd_add(simd_mul(nz1, cz), d1));
+          e1 = simd_add(e1, simd_add(simd_add(simd_mul(ax1, hx), simd_mul(ay1, hy)), simd_mul(az1, hz)));
+
+          int out = simd_movemask(simd_or(simd_cmplt(e0, zero), simd_cmplt(e1, zero)));
+          visible[i] = out == 0;
+          num_visible += out == 0;
+        }
+      #else
+        for (unsigned i = 0; i != count; ++i) {
+          bool is_in = is_visible(boxes[i]);
+          visible[i] = is_in;
+          num_visible += is_in;
+        }
+      #endif
+      return num_visible;
+    }
+  };
+}
@@ -52,5 +52,6 @@ namespace octet {
     int w() const { return v[3]; }
   };
 
+  OCTET_RELOCATABLE(ivec4)
 }
 
@@ -118,9 +118,19 @@ namespace octet {
     mat4t operator*(const mat4t &r) const
     {
       mat4t res;
-      for (int i = 0; i != 4; ++i) {
-        res.v[i] = r[0] * v[i][0] + r[1] * v[i][1] + r[2] * v[i][2] + r[3] * v[i][3];
-      }
+      #if OCTET_SIMD
+        simd4 r0 = r.v[0].get_simd(), r1 = r.v[1].get_simd(), r2 = r.v[2].get_simd(), r3 = r.v[3].get_simd();
+        for (int i = 0; i != 4; ++i) {
+          simd4 a = v[i].get_simd();
+          simd4 t = simd_add(simd_mul(r0, simd_shuffle<0, 0, 0, 0>(a)), simd_mul(r1, simd_shuffle<1, 1, 1, 1>(a)));
+          t = simd_add(t, simd_mul(r2, simd_shuffle<2, 2, 2, 2>(a)));
+          res.v[i] = vec4(simd_add(t, simd_mul(r3, simd_shuffle<3, 3, 3, 3>(a))));
+        }
+      #else
+        for (int i = 0; i != 4; ++i) {
+          res.v[i] = r[0] * v[i][0] + r[1] * v[i][1] + r[2] * v[i][2] + r[3] * v[i][3];
+        }
+      #endif
       return res;
     }
   
@@ -213,34 +223,70 @@ namespace octet {
     // multiply by vector on the left
     // [l[0],l[1],l[2],l[3]] * [v[0],v[1],v[2],v[3]]
     vec4 lmul(const vec4 &l) const {
-      return v[0] * l[0] + v[1] * l[1] + v[2] * l[2] + v[3] * l[3];
+      #if OCTET_SIMD
+        simd4 a = l.get_simd();
+        simd4 t = simd_add(simd_mul(v[0].get_simd(), simd_shuffle<0, 0, 0, 0>(a)), simd_mul(v[1].get_simd(), simd_shuffle<1, 1, 1, 1>(a)));
+        t = simd_add(t, simd_mul(v[2].get_simd(), simd_shuffle<2, 2, 2, 2>(a)));
+        return vec4(simd_add(t, simd_mul(v[3].get_simd(), simd_shuffle<3, 3, 3, 3>(a))));
+      #else
+        return v[0] * l[0] + v[1] * l[1] + v[2] * l[2] + v[3] * l[3];
+      #endif
     }
   
     // multiply by vector on the right
     // [v[0],v[1],v[2],v[3]] * [r[0],r[1],r[2],r[3]]
     vec4 rmul(const vec4 &r) const {
-      return vec4(
-        v[0].dot(r),
-        v[1].dot(r),
-        v[2].dot(r),
-        v[3].dot(r)
-      );
+      #if OCTET_SIMD
+        // four dot products at once: multiply, transpose and add up the columns.
+        simd4 b = r.get_simd();
+        simd4 p0 = simd_mul(v[0].get_simd(), b), p1 = simd_mul(v[1].get_simd(), b);
+        simd4 p2 = simd_mul(v[2].get_simd(), b), p3 = simd_mul(v[3].get_simd(), b);
+        simd_transpose(p0, p1, p2, p3);
+        return vec4(simd_add(simd_add(simd_add(p0, p1), p2), p3));
+      #else
+        return vec4(
+          v[0].dot(r),
+          v[1].dot(r),
+          v[2].dot(r),
+          v[3].dot(r)
+        );
+      #endif
     }
   
     // quick invert, assumes the matrix is a rotate and translate only.
     // works for orthonormal rotation component matrices
     void invertQuick(mat4t &d) const {
-      // transpose x, y, z
-      for (int i = 0; i != 3; ++i) {
-        d[i] = vec4(v[0][i], v[1][i], v[2][i], 0);
-      }
-      d[3] = vec4(0, 0, 0, 1);
-      // translate by new matrix
-      d[3] = d.lmul(vec4(-v[3][0], -v[3][1], -v[3][2], 1));
+      #if OCTET_SIMD
+        // transpose x, y, z (w comes out as zero)
+        simd4 x = v[0].get_simd(), y = v[1].get_simd(), z = v[2].get_simd(), w = simd_zero();
+        simd_transpose(x, y, z, w);
+        d[0] = vec4(x);
+        d[1] = vec4(y);
+        d[2] = vec4(z);
+        // translate by new matrix
+        simd4 t = simd_neg(v[3].get_simd());
+        simd4 res = simd_add(simd_mul(x, simd_shuffle<0, 0, 0, 0>(t)), simd_mul(y, simd_shuffle<1, 1, 1, 1>(t)));
+        res = simd_add(res, simd_mul(z, simd_shuffle<2, 2, 2, 2>(t)));
+        d[3] = vec4(simd_add(res, simd_set(0, 0, 0, 1)));
+      #else
+        // transpose x, y, z
+        for (int i = 0; i != 3; ++i) {
+          d[i] = vec4(v[0][i], v[1][i], v[2][i], 0);
+        }
+        d[3] = vec4(0, 0, 0, 1);
+        // translate by new matrix
+        d[3] = d.lmul(vec4(-v[3][0], -v[3][1], -v[3][2], 1));
+      #endif
     }
 
     mat4t transpose4x4() const {
-      return mat4t( colx(), coly(), colz(), colw() );
+      #if OCTET_SIMD
+        simd4 x = v[0].get_simd(), y = v[1].get_simd(), z = v[2].get_simd(), w = v[3].get_simd();
+        simd_transpose(x, y, z, w);
+        return mat4t(vec4(x), vec4(y), vec4(z), vec4(w));
+      #else
+        return mat4t( colx(), coly(), colz(), colw() );
+      #endif
     }
 
     mat4t inverse4x4() const {
@@ -402,12 +448,7 @@ namespace octet {
 
     // postmultiply vector
     vec4 operator*(const vec4 &r) const {
-      return vec4(
-        v[0].dot(r),
-        v[1].dot(r),
-        v[2].dot(r),
-        v[3].dot(r)
-      );
+      return rmul(r);
     }
 
     // convert rotation matrix to quaternion
@@ -555,4 +596,6 @@ namespace octet {
       lhs * rhs.w()
     );
   }
+
+  OCTET_RELOCATABLE(mat4t)
 }
@@ -20,5 +20,6 @@ namespace octet {
     vec4 rotate(const vec4 &r) const { return (*this * r) * conjugate(); }
   };
 
+  OCTET_RELOCATABLE(quat)
 }
 
@@ -88,6 +88,14 @@ namespace octet {
       return min(ax, ay, az);
     }
 
+    const vec3 &get_origin() const {
+      return origin;
+    }
+
+    const vec3 &get_distance() const {
+      return distance;
+    }
+
     vec3 get_start() {
       return origin;
     }
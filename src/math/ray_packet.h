@@ -0,0 +1,221 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Packets of four or eight rays traced together
+//
+// Rays that start close together and point the same way (like camera rays for
+// neighbouring pixels) visit the same boxes and triangles. A packet tests all of
+// its rays against a box or triangle at once, four lanes to a SIMD register.
+//
+// example:
+//
+//   ray_packet<8> packet;
+//   for (unsigned i = 0; i != 8; ++i) {
+//     packet.set(i, the_camera->get_ray(x[i], y[i]));
+//   }
+//   the_scene->get_bvh().closest_hit(packet);
+//   if (packet.triangle[0] != -1) ...
+//
+// Lanes are structure of arrays so that we can load four rays of x at once.
+// Unused lanes have t = -1 and never hit anything. N must be a multiple of four.
+//
+
+namespace octet {
+  template <int N> class ray_packet {
+    // the SIMD loops go four lanes at a time. this fails to compile if N is not a multiple of 4.
+    typedef char n_must_be_a_multiple_of_four[N % 4 == 0 ? 1 : -1];
+
+  public:
+    enum { size = N };
+
+    float ox[N], oy[N], oz[N];     // origins
+    float dx[N], dy[N], dz[N];     // directions
+    float idx[N], idy[N], idz[N];  // 1 / direction, filled in by finish()
+    float t[N];                    // nearest hit so far (or the end of the ray)
+    float u[N], v[N];              // barycentrics of the hit
+    int triangle[N];               // -1 if no hit
+    int instance[N];               // -1 if no hit
+
+    ray_packet() {
+      clear();
+    }
+
+    // make all the lanes unused
+    void clear() {
+      for (int i = 0; i != N; ++i) {
+        ox[i] = oy[i] = oz[i] = 0;
+        dx[i] = dy[i] = dz[i] = 1;
+        t[i] = -1;
+        u[i] = v[i] = 0;
+        triangle[i] = instance[i] = -1;
+      }
+    }
+
+    // origin + dir * t for 0 <= t < tmax
+    void set(unsigned lane, const vec3 &origin, const vec3 &dir, float tmax) {
+      ox[lane] = origin.x(); oy[lane] = origin.y(); oz[lane] = origin.z();
+      dx[lane] = dir.x(); dy[lane] = dir.y(); dz[lane] = dir.z();
+      t[lane] = tmax;
+      triangle[lane] = instance[lane] = -1;
+    }
+
+    // t is 0 at the start of the ray and 1 at the end
+    void set(unsigned lane, const ray &the_ray) {
+      set(lane, the_ray.get_origin(), the_ray.get_distance(), 1.0f);
+    }
+
+    // work out 1 / direction for the slab test (the bvh classes do this for you).
+    // 1/0 is inf, which the slab test handles.
+    void finish() {
+      for (int i = 0; i != N; ++i) {
+        idx[i] = 1.0f / dx[i];
+        idy[i] = 1.0f / dy[i];
+        idz[i] = 1.0f / dz[i];
+      }
+    }
+
+    // the same rays in another space (eg. model space) with the same t.
+    // t does not change if we transform the direction too.
+    void transform(ray_packet &dest, const mat4t &mat) const {
+      transform_batch::points_soa(dest.ox, dest.oy, dest.oz, ox, oy, oz, N, mat);
+      transform_batch::normals_soa(dest.dx, dest.dy, dest.dz, dx, dy, dz, N, mat);
+      for (int i = 0; i != N; ++i) {
+        dest.t[i] = t[i];
+        dest.triangle[i] = -1;
+      }
+    }
+
+    vec3 get_origin(unsigned lane) const {
+      return vec3(ox[lane], oy[lane], oz[lane]);
+    }
+
+    vec3 get_dir(unsigned lane) const {
+      return vec3(dx[lane], dy[lane], dz[lane]);
+    }
+
+    #if OCTET_SIMD
+      // entry and exit of one slab. a ray that runs along the plane of a slab gives
+      // 0 * inf = NaN. we don't leave that to min and max, whose NaN rules differ
+      // between instruction sets, but make the slab (-inf, inf) so that it keeps the box.
+      static void slab(simd4 &enter, simd4 &leave, simd4 a, simd4 b) {
+        simd4 is_number = simd_and(simd_cmpeq(a, a), simd_cmpeq(b, b));
+        enter = simd_select(is_number, simd_min(a, b), simd_splat(-1e37f));
+        leave = simd_select(is_number, simd_max(a, b), simd_splat(1e37f));
+      }
+    #endif
+
+    // slab test of every lane against a box for 0 <= t <= the lane's t.
+    // returns one bit per lane that hits and where it enters in tnear.
+    unsigned hit_box(const float *min, const float *max, float *tnear) const {
+      unsigned mask = 0;
+      #if OCTET_SIMD
+        simd4 minx = simd_splat(min[0]), miny = simd_splat(min[1]), minz = simd_splat(min[2]);
+        simd4 maxx = simd_splat(max[0]), maxy = simd_splat(max[1]), maxz = simd_splat(max[2]);
+        for (int i = 0; i != N; i += 4) {
+          simd4 x = simd_load(ox + i), y = simd_load(oy + i), z = simd_load(oz + i);
+          simd4 ix = simd_load(idx + i), iy = simd_load(idy + i), iz = simd_load(idz + i);
+          simd4 nx, fx, ny, fy, nz, fz;
+          slab(nx, fx, simd_mul(simd_sub(minx, x), ix), simd_mul(simd_sub(maxx, x), ix));
+          slab(ny, fy, simd_mul(simd_sub(miny, y), iy), simd_mul(simd_sub(maxy, y), iy));
+          slab(nz, fz, simd_mul(simd_sub(minz, z), iz), simd_mul(simd_sub(maxz, z), iz));
+
+          simd4 t0 = simd_max(simd_max(nx, ny), simd_max(nz, simd_zero()));
+          simd4 t1 = simd_min(simd_min(fx, fy), simd_min(fz, simd_load(t + i)));
+          simd_store(tnear + i, t0);
+          mask |= simd_movemask(simd_cmple(t0, t1)) << i;
+        }
+      #else
+        for (int i = 0; i != N; ++i) {
+          float o[3] = { ox[i], oy[i], oz[i] };
+          float inv[3] = { idx[i], idy[i], idz[i] };
+          float t0 = 0, t1 = t[i];
+          for (int j = 0; j != 3; ++j) {
+            float ta = (min[j] - o[j]) * inv[j];
+            float tb = (max[j] - o[j]) * inv[j];
+            // NaN: the ray runs along this slab's plane, which keeps the box (as above)
+            if (ta != ta || tb != tb) continue;
+            t0 = octet::max(t0, octet::min(ta, tb));
+            t1 = octet::min(t1, octet::max(ta, tb));
+          }
+          tnear[i] = t0;
+          mask |= (t0 <= t1) << i;
+        }
+      #endif
+      return mask;
+    }
+
+    // Moller-Trumbore of every lane against the triangle p0, p0 + e1, p0 + e2.
+    // lanes that hit nearer than their t get t, u, v and the triangle index.
+    // returns one bit per lane that hit.
+    unsigned hit_triangle(const vec3 &p0, const vec3 &e1, const vec3 &e2, int index) {
+      unsigned mask = 0;
+      #if OCTET_SIMD
+        simd4 p0x = simd_splat(p0.x()), p0y = simd_splat(p0.y()), p0z = simd_splat(p0.z());
+        simd4 e1x = simd_splat(e1.x()), e1y = simd_splat(e1.y()), e1z = simd_splat(e1.z());
+        simd4 e2x = simd_splat(e2.x()), e2y = simd_splat(e2.y()), e2z = simd_splat(e2.z());
+        simd4 zero = simd_zero(), one = simd_splat(1.0f);
+        for (int i = 0; i != N; i += 4) {
+          simd4 x = simd_load(dx + i), y = simd_load(dy + i), z = simd_load(dz + i);
+          simd4 px = simd_sub(simd_mul(y, e2z), simd_mul(z, e2y));
+          simd4 py = simd_sub(simd_mul(z, e2x), simd_mul(x, e2z));
+          simd4 pz = simd_sub(simd_mul(x, e2y), simd_mul(y, e2x));
+          simd4 det = simd_add(simd_add(simd_mul(e1x, px), simd_mul(e1y, py)), simd_mul(e1z, pz));
+          simd4 inv_det = simd_div(one, det);
+
+          simd4 tx = simd_sub(simd_load(ox + i), p0x);
+          simd4 ty = simd_sub(simd_load(oy + i), p0y);
+          simd4 tz = simd_sub(simd_load(oz + i), p0z);
+          simd4 lu = simd_mul(simd_add(simd_add(simd_mul(tx, px), simd_mul(ty, py)), simd_mul(tz, pz)), inv_det);
+
+          simd4 qx = simd_sub(simd_mul(ty, e1z), simd_mul(tz, e1y));
+          simd4 qy = simd_sub(simd_mul(tz, e1x), simd_mul(tx, e1z));
+          simd4 qz = simd_sub(simd_mul(tx, e1y), simd_mul(ty, e1x));
+          simd4 lv = simd_mul(simd_add(simd_add(simd_mul(x, qx), simd_mul(y, qy)), simd_mul(z, qz)), inv_det);
+          simd4 lt = simd_mul(simd_add(simd_add(simd_mul(e2x, qx), simd_mul(e2y, qy)), simd_mul(e2z, qz)), inv_det);
+
+          // compares with NaN are false, so parallel rays drop out here too.
+          simd4 old_t = simd_load(t + i);
+          simd4 hit = simd_cmpge(simd_abs(det), simd_splat(1e-20f));
+          hit = simd_and(hit, simd_and(simd_cmpge(lu, zero), simd_cmpge(lv, zero)));
+          hit = simd_and(hit, simd_cmple(simd_add(lu, lv), one));
+          hit = simd_and(hit, simd_and(simd_cmpge(lt, zero), simd_cmplt(lt, old_t)));
+
+          int bits = simd_movemask(hit);
+          if (bits) {
+            simd_store(t + i, simd_select(hit, lt, old_t));
+            simd_store(u + i, simd_select(hit, lu, simd_load(u + i)));
+            simd_store(v + i, simd_select(hit, lv, simd_load(v + i)));
+            for (int j = 0; j != 4; ++j) {
+              if (bits & (1 << j)) triangle[i + j] = index;
+            }
+            mask |= bits << i;
+          }
+        }
+      #else
+        for (int i = 0; i != N; ++i) {
+          vec3 dir(dx[i], dy[i], dz[i]);
+          vec3 pvec = dir.cross(e2);
+          float det = e1.dot(pvec);
+          if (fabsf(det) < 1e-20f) continue;
+          float inv_det = 1.0f / det;
+          vec3 tvec = vec3(ox[i], oy[i], oz[i]) - p0;
+          float lu = tvec.dot(pvec) * inv_det;
+          vec3 qvec = tvec.cross(e1);
+          float lv = dir.dot(qvec) * inv_det;
+          float lt = e2.dot(qvec) * inv_det;
+          if (lu >= 0 && lv >= 0 && lu + lv <= 1 && lt >= 0 && lt < t[i]) {
+            t[i] = lt;
+            u[i] = lu;
+            v[i] = lv;
+            triangle[i] = index;
+            mask |= 1 << i;
+          }
+        }
+      #endif
+      return mask;
+    }
+  };
+}
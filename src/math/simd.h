@@ -0,0 +1,168 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// SIMD building blocks for vec4, mat4t and bvec4
+//
+// simd4 is four floats in a register: __m128 with OCTET_SSE and float32x4_t with OCTET_NEON.
+// Masks from compares are simd4s with all bits set in the true lanes.
+//
+// example:
+//
+//   simd4 a = simd_load(my_vec.get());
+//   simd4 b = simd_mul(a, simd_splat(2.0f));
+//   simd_store(my_vec.get(), simd_add(a, b));
+//
+// Loads and stores do not need aligned memory, so vec4 is still just four floats
+// and can live anywhere. If neither OCTET_SSE nor OCTET_NEON is set, OCTET_SIMD is 0
+// and the maths classes use plain C++.
+//
+
+#if OCTET_SSE || OCTET_NEON
+  #define OCTET_SIMD 1
+#else
+  #define OCTET_SIMD 0
+#endif
+
+namespace octet {
+  #if OCTET_SSE
+    typedef __m128 simd4;
+
+    inline simd4 simd_load(const float *p) { return _mm_loadu_ps(p); }
+    inline void simd_store(float *p, simd4 a) { _mm_storeu_ps(p, a); }
+    inline simd4 simd_load(const int *p) { return _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)p)); }
+    inline void simd_store(int *p, simd4 a) { _mm_storeu_si128((__m128i*)p, _mm_castps_si128(a)); }
+
+    inline simd4 simd_set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+    inline simd4 simd_splat(float f) { return _mm_set1_ps(f); }
+    inline simd4 simd_zero() { return _mm_setzero_ps(); }
+    inline float simd_get_x(simd4 a) { return _mm_cvtss_f32(a); }
+
+    inline simd4 simd_add(simd4 a, simd4 b) { return _mm_add_ps(a, b); }
+    inline simd4 simd_sub(simd4 a, simd4 b) { return _mm_sub_ps(a, b); }
+    inline simd4 simd_mul(simd4 a, simd4 b) { return _mm_mul_ps(a, b); }
+    inline simd4 simd_div(simd4 a, simd4 b) { return _mm_div_ps(a, b); }
+
+    // a < b ? a : b and a >= b ? a : b (including NaNs)
+    inline simd4 simd_min(simd4 a, simd4 b) { return _mm_min_ps(a, b); }
+    inline simd4 simd_max(simd4 a, simd4 b) { return _mm_max_ps(a, b); }
+
+    inline simd4 simd_neg(simd4 a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+    inline simd4 simd_abs(simd4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+    // bitwise operations. andnot is ~a & b
+    inline simd4 simd_and(simd4 a, simd4 b) { return _mm_and_ps(a, b); }
+    inline simd4 simd_or(simd4 a, simd4 b) { return _mm_or_ps(a, b); }
+    inline simd4 simd_xor(simd4 a, simd4 b) { return _mm_xor_ps(a, b); }
+    inline simd4 simd_andnot(simd4 a, simd4 b) { return _mm_andnot_ps(a, b); }
+
+    inline simd4 simd_cmpgt(simd4 a, simd4 b) { return _mm_cmpgt_ps(a, b); }
+    inline simd4 simd_cmpge(simd4 a, simd4 b) { return _mm_cmpge_ps(a, b); }
+    inline simd4 simd_cmplt(simd4 a, simd4 b) { return _mm_cmplt_ps(a, b); }
+    inline simd4 simd_cmple(simd4 a, simd4 b) { return _mm_cmple_ps(a, b); }
+    inline simd4 simd_cmpeq(simd4 a, simd4 b) { return _mm_cmpeq_ps(a, b); }
+    inline simd4 simd_cmpne(simd4 a, simd4 b) { return _mm_cmpneq_ps(a, b); }
+
+    // one bit for the sign of each lane
+    inline int simd_movemask(simd4 a) { return _mm_movemask_ps(a); }
+
+    // eg. simd_shuffle<3, 3, 3, 3>(a) is a.wwww
+    template <int x, int y, int z, int w> inline simd4 simd_shuffle(simd4 a) {
+      return _mm_shuffle_ps(a, a, _MM_SHUFFLE(w, z, y, x));
+    }
+
+    // turn four rows into four columns
+    inline void simd_transpose(simd4 &a, simd4 &b, simd4 &c, simd4 &d) {
+      _MM_TRANSPOSE4_PS(a, b, c, d);
+    }
+  #elif OCTET_NEON
+    typedef float32x4_t simd4;
+
+    inline simd4 simd_load(const float *p) { return vld1q_f32(p); }
+    inline void simd_store(float *p, simd4 a) { vst1q_f32(p, a); }
+    inline simd4 simd_load(const int *p) { return vreinterpretq_f32_s32(vld1q_s32(p)); }
+    inline void simd_store(int *p, simd4 a) { vst1q_s32(p, vreinterpretq_s32_f32(a)); }
+
+    inline simd4 simd_set(float x, float y, float z, float w) { float t[4] = { x, y, z, w }; return vld1q_f32(t); }
+    inline simd4 simd_splat(float f) { return vdupq_n_f32(f); }
+    inline simd4 simd_zero() { return vdupq_n_f32(0); }
+    inline float simd_get_x(simd4 a) { return vgetq_lane_f32(a, 0); }
+
+    inline simd4 simd_add(simd4 a, simd4 b) { return vaddq_f32(a, b); }
+    inline simd4 simd_sub(simd4 a, simd4 b) { return vsubq_f32(a, b); }
+    inline simd4 simd_mul(simd4 a, simd4 b) { return vmulq_f32(a, b); }
+    inline simd4 simd_div(simd4 a, simd4 b) {
+      #ifdef __aarch64__
+        return vdivq_f32(a, b);
+      #else
+        // estimate and two newton-raphson steps
+        simd4 r = vrecpeq_f32(b);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        r = vmulq_f32(vrecpsq_f32(b, r), r);
+        return vmulq_f32(a, r);
+      #endif
+    }
+
+    inline simd4 simd_bits(uint32x4_t a) { return vreinterpretq_f32_u32(a); }
+    inline uint32x4_t simd_bits(simd4 a) { return vreinterpretq_u32_f32(a); }
+
+    inline simd4 simd_min(simd4 a, simd4 b) { return simd_bits(vbslq_u32(vcltq_f32(a, b), simd_bits(a), simd_bits(b))); }
+    inline simd4 simd_max(simd4 a, simd4 b) { return simd_bits(vbslq_u32(vcgeq_f32(a, b), simd_bits(a), simd_bits(b))); }
+
+    inline simd4 simd_neg(simd4 a) { return vnegq_f32(a); }
+    inline simd4 simd_abs(simd4 a) { return vabsq_f32(a); }
+
+    inline simd4 simd_and(simd4 a, simd4 b) { return simd_bits(vandq_u32(simd_bits(a), simd_bits(b))); }
+    inline simd4 simd_or(simd4 a, simd4 b) { return simd_bits(vorrq_u32(simd_bits(a), simd_bits(b))); }
+    inline simd4 simd_xor(simd4 a, simd4 b) { return simd_bits(veorq_u32(simd_bits(a), simd_bits(b))); }
+    inline simd4 simd_andnot(simd4 a, simd4 b) { return simd_bits(vbicq_u32(simd_bits(b), simd_bits(a))); }
+
+    inline simd4 simd_cmpgt(simd4 a, simd4 b) { return simd_bits(vcgtq_f32(a, b)); }
+    inline simd4 simd_cmpge(simd4 a, simd4 b) { return simd_bits(vcgeq_f32(a, b)); }
+    inline simd4 simd_cmplt(simd4 a, simd4 b) { return simd_bits(vcltq_f32(a, b)); }
+    inline simd4 simd_cmple(simd4 a, simd4 b) { return simd_bits(vcleq_f32(a, b)); }
+    inline simd4 simd_cmpeq(simd4 a, simd4 b) { return simd_bits(vceqq_f32(a, b)); }
+    inline simd4 simd_cmpne(simd4 a, simd4 b) { return simd_bits(vmvnq_u32(vceqq_f32(a, b))); }
+
+    inline int simd_movemask(simd4 a) {
+      uint32x4_t s = vshrq_n_u32(simd_bits(a), 31);
+      return (int)(vgetq_lane_u32(s, 0) | vgetq_lane_u32(s, 1) << 1 | vgetq_lane_u32(s, 2) << 2 | vgetq_lane_u32(s, 3) << 3);
+    }
+
+    template <int x, int y, int z, int w> inline simd4 simd_shuffle(simd4 a) {
+      simd4 r = vdupq_n_f32(vgetq_lane_f32(a, x));
+      r = vsetq_lane_f32(vgetq_lane_f32(a, y), r, 1);
+      r = vsetq_lane_f32(vgetq_lane_f32(a, z), r, 2);
+      return vsetq_lane_f32(vgetq_lane_f32(a, w), r, 3);
+    }
+
+    inline void simd_transpose(simd4 &a, simd4 &b, simd4 &c, simd4 &d) {
+      float32x4x2_t ab = vtrnq_f32(a, b);
+      float32x4x2_t cd = vtrnq_f32(c, d);
+      a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+      b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+      c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+      d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+    }
+  #endif
+
+  #if OCTET_SIMD
+    // sum of the four lanes in every lane
+    inline simd4 simd_sum(simd4 a) {
+      simd4 t = simd_add(a, simd_shuffle<1, 0, 3, 2>(a));
+      return simd_add(t, simd_shuffle<2, 3, 0, 1>(t));
+    }
+
+    // mask ? a : b for each lane
+    inline simd4 simd_select(simd4 mask, simd4 a, simd4 b) {
+      return simd_or(simd_and(mask, a), simd_andnot(mask, b));
+    }
+
+    // a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w in every lane
+    inline simd4 simd_dot(simd4 a, simd4 b) {
+      return simd_sum(simd_mul(a, b));
+    }
+  #endif
+}
@@ -0,0 +1,187 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// transform lots of points, normals or bounding boxes at once
+//
+// Going through vec4 * mat4t one vertex at a time reloads the matrix for every vertex.
+// These functions keep the matrix in registers and stream through the data.
+//
+// Points and normals can be in a strided array, like the positions in a vertex buffer:
+//
+//   // transform the positions in a vertex buffer in place
+//   transform_batch::points(vp + pos_offset, stride, vp + pos_offset, stride, num_vertices, modelToWorld);
+//
+// or a "structure of arrays", which lets us do four points at a time:
+//
+//   transform_batch::points_soa(x, y, z, x, y, z, num_points, modelToWorld);
+//
+// Strides are in bytes. The source and destination may be the same.
+//
+// With one matrix, strided points, normals and boxes are gathered into blocks of
+// x, y and z arrays and go through the same four-at-a-time kernel as points_soa.
+// The versions with a matrix per element go one at a time (with vec4 SIMD).
+//
+
+namespace octet {
+  class transform_batch {
+    enum {
+      // strided data is gathered this many at a time
+      block_size = 64,
+    };
+
+    static const float *at(const void *base, unsigned stride, unsigned i) {
+      return (const float*)((const uint8_t*)base + stride * i);
+    }
+
+    static float *at(void *base, unsigned stride, unsigned i) {
+      return (float*)((uint8_t*)base + stride * i);
+    }
+
+    // x, y, z of vertex i with the w we want
+    static vec4 load3(const void *base, unsigned stride, unsigned i, float w) {
+      const float *src = at(base, stride, i);
+      return vec4(src[0], src[1], src[2], w);
+    }
+
+    static void store3(void *base, unsigned stride, unsigned i, const vec4 &value) {
+      float *dest = at(base, stride, i);
+      dest[0] = value[0]; dest[1] = value[1]; dest[2] = value[2];
+    }
+
+    // structure of arrays: do four at a time. w is 1 for points and 0 for normals.
+    // if dw is not null, the w results go there too (eg. for a projection).
+    static void soa(float *dx, float *dy, float *dz, const float *sx, const float *sy, const float *sz, unsigned count, const mat4t &mat, float w, float *dw=0) {
+      unsigned i = 0;
+      #if OCTET_SIMD
+        simd4 m00 = simd_splat(mat[0][0]), m01 = simd_splat(mat[0][1]), m02 = simd_splat(mat[0][2]), m03 = simd_splat(mat[0][3]);
+        simd4 m10 = simd_splat(mat[1][0]), m11 = simd_splat(mat[1][1]), m12 = simd_splat(mat[1][2]), m13 = simd_splat(mat[1][3]);
+        simd4 m20 = simd_splat(mat[2][0]), m21 = simd_splat(mat[2][1]), m22 = simd_splat(mat[2][2]), m23 = simd_splat(mat[2][3]);
+        simd4 m30 = simd_splat(mat[3][0] * w), m31 = simd_splat(mat[3][1] * w), m32 = simd_splat(mat[3][2] * w), m33 = simd_splat(mat[3][3] * w);
+        for (; i + 4 <= count; i += 4) {
+          simd4 x = simd_load(sx + i), y = simd_load(sy + i), z = simd_load(sz + i);
+          simd4 rx = simd_add(simd_add(simd_add(simd_mul(x, m00), simd_mul(y, m10)), simd_mul(z, m20)), m30);
+          simd4 ry = simd_add(simd_add(simd_add(simd_mul(x, m01), simd_mul(y, m11)), simd_mul(z, m21)), m31);
+          simd4 rz = simd_add(simd_add(simd_add(simd_mul(x, m02), simd_mul(y, m12)), simd_mul(z, m22)), m32);
+          if (dw) {
+            simd4 rw = simd_add(simd_add(simd_add(simd_mul(x, m03), simd_mul(y, m13)), simd_mul(z, m23)), m33);
+            simd_store(dw + i, rw);
+          }
+          simd_store(dx + i, rx);
+          simd_store(dy + i, ry);
+          simd_store(dz + i, rz);
+        }
+      #endif
+      for (; i != count; ++i) {
+        vec4 r = mat.lmul(vec4(sx[i], sy[i], sz[i], w));
+        dx[i] = r[0]; dy[i] = r[1]; dz[i] = r[2];
+        if (dw) dw[i] = r[3];
+      }
+    }
+
+    // gather a block of x, y, z from strided data
+    static void gather(float *x, float *y, float *z, const void *src, unsigned src_stride, unsigned first, unsigned n) {
+      for (unsigned i = 0; i != n; ++i) {
+        const float *s = at(src, src_stride, first + i);
+        x[i] = s[0]; y[i] = s[1]; z[i] = s[2];
+      }
+    }
+
+    // strided data through the soa kernel a block at a time
+    static void strided(void *dest, unsigned dest_stride, const void *src, unsigned src_stride, unsigned count, const mat4t &mat, float w) {
+      float x[block_size], y[block_size], z[block_size];
+      for (unsigned first = 0; first < count; first += block_size) {
+        unsigned n = min(count - first, (unsigned)block_size);
+        gather(x, y, z, src, src_stride, first, n);
+        soa(x, y, z, x, y, z, n, mat, w);
+        for (unsigned i = 0; i != n; ++i) {
+          float *d = at(dest, dest_stride, first + i);
+          d[0] = x[i]; d[1] = y[i]; d[2] = z[i];
+        }
+      }
+    }
+
+  public:
+    // transform count (x, y, z, 1) points by one matrix
+    static void points(void *dest, unsigned dest_stride, const void *src, unsigned src_stride, unsigned count, const mat4t &mat) {
+      const mat4t m = mat; // a local copy can stay in registers as dest can't point at it.
+      strided(dest, dest_stride, src, src_stride, count, m, 1);
+    }
+
+    // transform each point by its own matrix, eg. one point per instance.
+    static void points(void *dest, unsigned dest_stride, const void *src, unsigned src_stride, unsigned count, const mat4t *mats) {
+      for (unsigned i = 0; i != count; ++i) {
+        store3(dest, dest_stride, i, mats[i].lmul(load3(src, src_stride, i, 1)));
+      }
+    }
+
+    // transform count (x, y, z, 1) points to full vec4s, eg. for a projection matrix.
+    static void points(vec4 *dest, const void *src, unsigned src_stride, unsigned count, const mat4t &mat) {
+      const mat4t m = mat;
+      float x[block_size], y[block_size], z[block_size], w[block_size];
+      for (unsigned first = 0; first < count; first += block_size) {
+        unsigned n = min(count - first, (unsigned)block_size);
+        gather(x, y, z, src, src_stride, first, n);
+        soa(x, y, z, x, y, z, n, m, 1, w);
+        for (unsigned i = 0; i != n; ++i) {
+          dest[first + i] = vec4(x[i], y[i], z[i], w[i]);
+        }
+      }
+    }
+
+    // transform count (x, y, z, 0) directions, such as normals, by one matrix.
+    // note: if the matrix has a non-uniform scale, use the inverse transpose for normals.
+    static void normals(void *dest, unsigned dest_stride, const void *src, unsigned src_stride, unsigned count, const mat4t &mat) {
+      const mat4t m = mat;
+      strided(dest, dest_stride, src, src_stride, count, m, 0);
+    }
+
+    // transform each direction by its own matrix
+    static void normals(void *dest, unsigned dest_stride, const void *src, unsigned src_stride, unsigned count, const mat4t *mats) {
+      for (unsigned i = 0; i != count; ++i) {
+        store3(dest, dest_stride, i, mats[i].lmul(load3(src, src_stride, i, 0)));
+      }
+    }
+
+    // transform points held as separate x, y and z arrays
+    static void points_soa(float *dx, float *dy, float *dz, const float *sx, const float *sy, const float *sz, unsigned count, const mat4t &mat) {
+      soa(dx, dy, dz, sx, sy, sz, count, mat, 1);
+    }
+
+    // transform directions held as separate x, y and z arrays
+    static void normals_soa(float *dx, float *dy, float *dz, const float *sx, const float *sy, const float *sz, unsigned count, const mat4t &mat) {
+      soa(dx, dy, dz, sx, sy, sz, count, mat, 0);
+    }
+
+    // transform count bounding boxes by one matrix
+    // the centers are transformed as points and the half extents by abs(mat) as directions.
+    static void aabbs(aabb *dest, const aabb *src, unsigned count, const mat4t &mat) {
+      const mat4t m = mat;
+      mat4t abs_m(abs(m.x()), abs(m.y()), abs(m.z()), vec4(0, 0, 0, 0));
+      float cx[block_size], cy[block_size], cz[block_size];
+      float hx[block_size], hy[block_size], hz[block_size];
+      for (unsigned first = 0; first < count; first += block_size) {
+        unsigned n = min(count - first, (unsigned)block_size);
+        for (unsigned i = 0; i != n; ++i) {
+          vec3 c = src[first + i].get_center(), h = src[first + i].get_half_extent();
+          cx[i] = c.x(); cy[i] = c.y(); cz[i] = c.z();
+          hx[i] = h.x(); hy[i] = h.y(); hz[i] = h.z();
+        }
+        soa(cx, cy, cz, cx, cy, cz, n, m, 1);
+        soa(hx, hy, hz, hx, hy, hz, n, abs_m, 0);
+        for (unsigned i = 0; i != n; ++i) {
+          dest[first + i] = aabb(vec3(cx[i], cy[i], cz[i]), vec3(hx[i], hy[i], hz[i]));
+        }
+      }
+    }
+
+    // transform each bounding box by its own matrix, eg. mesh instances to world space.
+    static void aabbs(aabb *dest, const aabb *src, unsigned count, const mat4t *mats) {
+      for (unsigned i = 0; i != count; ++i) {
+        dest[i] = src[i].get_transform(mats[i]);
+      }
+    }
+  };
+}
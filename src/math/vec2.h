@@ -205,5 +205,7 @@ namespace octet {
   inline vec2 abs(const vec2 &lhs) {
      return lhs.abs(); 
   }
+
+  OCTET_RELOCATABLE(vec2)
 }
 
@@ -264,5 +264,7 @@ namespace octet {
   inline vec3 operator/(float lhs, const vec3 &rhs) {
     return rhs / lhs;
   }
+
+  OCTET_RELOCATABLE(vec3)
 }
 
@@ -6,6 +6,9 @@
 //
 // Vector class
 //
+// With OCTET_SSE or OCTET_NEON the arithmetic is done four floats at a time (see simd.h).
+// The storage is still four floats, so vec4 has the same size and alignment either way.
+//
 
 namespace octet {
   class mat4t;
@@ -31,6 +34,18 @@ namespace octet {
       v[0] = xyz.x(); v[1] = xyz.y(); v[2] = xyz.z(); v[3] = w;
     };
 
+    #if OCTET_SIMD
+      // construct from a SIMD register
+      explicit vec4(simd4 m) {
+        simd_store(v, m);
+      }
+
+      // get the vector in a SIMD register
+      simd4 get_simd() const {
+        return simd_load(v);
+      }
+    #endif
+
     // index accessor [0] [1] [2] [3]
     float &operator[](int i) { return v[i]; }
 
@@ -40,85 +55,162 @@ namespace octet {
     }
 
     // vector - scalar operators
-    vec4 operator+(float r) const {
-      return vec4(v[0]+r, v[1]+r, v[2]+r, v[3]+r);
-    }
-    vec4 operator-(float r) const {
-      return vec4(v[0]-r, v[1]-r, v[2]-r, v[3]-r);
-    }
-    vec4 operator*(float r) const {
-      return vec4(v[0]*r, v[1]*r, v[2]*r, v[3]*r);
-    }
-    vec4 operator/(float r) const {
-       float rcp = 1.0f / r; return vec4(v[0]*rcp, v[1]*rcp, v[2]*rcp, v[3]*rcp);
-    }
+    #if OCTET_SIMD
+      vec4 operator+(float r) const {
+        return vec4(simd_add(get_simd(), simd_splat(r)));
+      }
+      vec4 operator-(float r) const {
+        return vec4(simd_sub(get_simd(), simd_splat(r)));
+      }
+      vec4 operator*(float r) const {
+        return vec4(simd_mul(get_simd(), simd_splat(r)));
+      }
+      vec4 operator/(float r) const {
+        return vec4(simd_mul(get_simd(), simd_splat(1.0f / r)));
+      }
+    #else
+      vec4 operator+(float r) const {
+        return vec4(v[0]+r, v[1]+r, v[2]+r, v[3]+r);
+      }
+      vec4 operator-(float r) const {
+        return vec4(v[0]-r, v[1]-r, v[2]-r, v[3]-r);
+      }
+      vec4 operator*(float r) const {
+        return vec4(v[0]*r, v[1]*r, v[2]*r, v[3]*r);
+      }
+      vec4 operator/(float r) const {
+         float rcp = 1.0f / r; return vec4(v[0]*rcp, v[1]*rcp, v[2]*rcp, v[3]*rcp);
+      }
+    #endif
 
     // premultiply matrix operator (forward declared as matrix uses vector)
     vec4 operator*(const mat4t &r) const;
 
-    // vector operators
-    vec4 operator+(const vec4 &r) const {
-      return vec4(v[0]+r.v[0], v[1]+r.v[1], v[2]+r.v[2], v[3]+r.v[3]);
-    }
-    vec4 operator-(const vec4 &r) const {
-      return vec4(v[0]-r.v[0], v[1]-r.v[1], v[2]-r.v[2], v[3]-r.v[3]);
-    }
-    vec4 operator*(const vec4 &r) const {
-      return vec4(v[0]*r.v[0], v[1]*r.v[1], v[2]*r.v[2], v[3]*r.v[3]);
-    }
-    vec4 operator-() const {
-      return vec4(-v[0], -v[1], -v[2], -v[3]);
-    }
-
-    // in-place vector operators
-    vec4 &operator+=(const vec4 &r) {
-      v[0] += r.v[0]; v[1] += r.v[1]; v[2] += r.v[2]; v[3] += r.v[3];
-      return *this;
-    }
-    vec4 &operator-=(const vec4 &r) {
-      v[0] -= r.v[0]; v[1] -= r.v[1]; v[2] -= r.v[2]; v[3] -= r.v[3];
-      return *this;
-    }
-    vec4 &operator*=(const vec4 &r) {
-      v[0] *= r.v[0]; v[1] *= r.v[1]; v[2] *= r.v[2]; v[3] *= r.v[3];
-      return *this;
-    }
-
-    // quaternion conjugate
-    vec4 qconj() const {
-      return vec4(-v[0], -v[1], -v[2], v[3]);
-    }
-
-    // dot product
-    float dot(const vec4 &r) const {
-      return v[0] * r.v[0] + v[1] * r.v[1] + v[2] * r.v[2] + v[3] * r.v[3];
-    }
-
-    // sum of terms
-    float sum() const {
-      return v[0] + v[1] + v[2] + v[3];
-    }
-
-    // after perspective transform, use this to find x, y, z in the cube.
-    vec4 perspectiveDivide() const {
-      float r = 1.0f / v[3];
-      return vec4(v[0]*r, v[1]*r, v[2]*r, v[3]*r);
-    }
+    #if OCTET_SIMD
+      // vector operators
+      vec4 operator+(const vec4 &r) const {
+        return vec4(simd_add(get_simd(), r.get_simd()));
+      }
+      vec4 operator-(const vec4 &r) const {
+        return vec4(simd_sub(get_simd(), r.get_simd()));
+      }
+      vec4 operator*(const vec4 &r) const {
+        return vec4(simd_mul(get_simd(), r.get_simd()));
+      }
+      vec4 operator-() const {
+        return vec4(simd_neg(get_simd()));
+      }
+
+      // in-place vector operators
+      vec4 &operator+=(const vec4 &r) {
+        simd_store(v, simd_add(get_simd(), r.get_simd()));
+        return *this;
+      }
+      vec4 &operator-=(const vec4 &r) {
+        simd_store(v, simd_sub(get_simd(), r.get_simd()));
+        return *this;
+      }
+      vec4 &operator*=(const vec4 &r) {
+        simd_store(v, simd_mul(get_simd(), r.get_simd()));
+        return *this;
+      }
+
+      // quaternion conjugate
+      vec4 qconj() const {
+        return vec4(simd_xor(get_simd(), simd_set(-0.0f, -0.0f, -0.0f, 0.0f)));
+      }
+
+      // dot product
+      float dot(const vec4 &r) const {
+        return simd_get_x(simd_dot(get_simd(), r.get_simd()));
+      }
+
+      // sum of terms
+      float sum() const {
+        return simd_get_x(simd_sum(get_simd()));
+      }
+
+      // after perspective transform, use this to find x, y, z in the cube.
+      vec4 perspectiveDivide() const {
+        return vec4(simd_mul(get_simd(), simd_splat(1.0f / v[3])));
+      }
+    #else
+      // vector operators
+      vec4 operator+(const vec4 &r) const {
+        return vec4(v[0]+r.v[0], v[1]+r.v[1], v[2]+r.v[2], v[3]+r.v[3]);
+      }
+      vec4 operator-(const vec4 &r) const {
+        return vec4(v[0]-r.v[0], v[1]-r.v[1], v[2]-r.v[2], v[3]-r.v[3]);
+      }
+      vec4 operator*(const vec4 &r) const {
+        return vec4(v[0]*r.v[0], v[1]*r.v[1], v[2]*r.v[2], v[3]*r.v[3]);
+      }
+      vec4 operator-() const {
+        return vec4(-v[0], -v[1], -v[2], -v[3]);
+      }
+
+      // in-place vector operators
+      vec4 &operator+=(const vec4 &r) {
+        v[0] += r.v[0]; v[1] += r.v[1]; v[2] += r.v[2]; v[3] += r.v[3];
+        return *this;
+      }
+      vec4 &operator-=(const vec4 &r) {
+        v[0] -= r.v[0]; v[1] -= r.v[1]; v[2] -= r.v[2]; v[3] -= r.v[3];
+        return *this;
+      }
+      vec4 &operator*=(const vec4 &r) {
+        v[0] *= r.v[0]; v[1] *= r.v[1]; v[2] *= r.v[2]; v[3] *= r.v[3];
+        return *this;
+      }
+
+      // quaternion conjugate
+      vec4 qconj() const {
+        return vec4(-v[0], -v[1], -v[2], v[3]);
+      }
+
+      // dot product
+      float dot(const vec4 &r) const {
+        return v[0] * r.v[0] + v[1] * r.v[1] + v[2] * r.v[2] + v[3] * r.v[3];
+      }
+
+      // sum of terms
+      float sum() const {
+        return v[0] + v[1] + v[2] + v[3];
+      }
+
+      // after perspective transform, use this to find x, y, z in the cube.
+      vec4 perspectiveDivide() const {
+        float r = 1.0f / v[3];
+        return vec4(v[0]*r, v[1]*r, v[2]*r, v[3]*r);
+      }
+    #endif
 
     // make the length equal to 1
     vec4 normalize() const {
       return *this * lengthRecip();
     }
 
-    // minumum of two vectors
-    vec4 min(const vec4 &r) const {
-      return vec4(v[0] < r[0] ? v[0] : r[0], v[1] < r[1] ? v[1] : r[1], v[2] < r[2] ? v[2] : r[2], v[3] < r[3] ? v[3] : r[3]);
-    }
-
-    // maximum of two vectors
-    vec4 max(const vec4 &r) const {
-      return vec4(v[0] >= r[0] ? v[0] : r[0], v[1] >= r[1] ? v[1] : r[1], v[2] >= r[2] ? v[2] : r[2], v[3] >= r[3] ? v[3] : r[3]);
-    }
+    #if OCTET_SIMD
+      // minumum of two vectors
+      vec4 min(const vec4 &r) const {
+        return vec4(simd_min(get_simd(), r.get_simd()));
+      }
+
+      // maximum of two vectors
+      vec4 max(const vec4 &r) const {
+        return vec4(simd_max(get_simd(), r.get_simd()));
+      }
+    #else
+      // minumum of two vectors
+      vec4 min(const vec4 &r) const {
+        return vec4(v[0] < r[0] ? v[0] : r[0], v[1] < r[1] ? v[1] : r[1], v[2] < r[2] ? v[2] : r[2], v[3] < r[3] ? v[3] : r[3]);
+      }
+
+      // maximum of two vectors
+      vec4 max(const vec4 &r) const {
+        return vec4(v[0] >= r[0] ? v[0] : r[0], v[1] >= r[1] ? v[1] : r[1], v[2] >= r[2] ? v[2] : r[2], v[3] >= r[3] ? v[3] : r[3]);
+      }
+    #endif
 
     // euclidean length of a vector
     float length() const {
@@ -137,7 +229,11 @@ namespace octet {
 
     // make all values positive.
     vec4 abs() const {
-      return vec4(fabsf(v[0]), fabsf(v[1]), fabsf(v[2]), fabsf(v[3]));
+      #if OCTET_SIMD
+        return vec4(simd_abs(get_simd()));
+      #else
+        return vec4(fabsf(v[0]), fabsf(v[1]), fabsf(v[2]), fabsf(v[3]));
+      #endif
     }
 
     // get xy
@@ -205,25 +301,51 @@ namespace octet {
       return v[3];
     }
 
-    // quaternion multiply
-    vec4 qmul(const vec4 &r) const {
-      return vec4(
-	      v[0] * r.v[3] + v[3] * r.v[0] + v[1] * r.v[2] - v[2] * r.v[1],
-		    v[1] * r.v[3] + v[3] * r.v[1] + v[2] * r.v[0] - v[0] * r.v[2],
-		    v[2] * r.v[3] + v[3] * r.v[2] + v[0] * r.v[1] - v[1] * r.v[0],
-		    v[3] * r.v[3] - v[0] * r.v[0] - v[1] * r.v[1] - v[2] * r.v[2]
-      );
-    }
-
-    // cross product
-    vec4 cross(const vec4 &r) const {
-      return vec4(
-        v[1] * r.v[2] - v[2] * r.v[1],
-	      v[2] * r.v[0] - v[0] * r.v[2],
-	      v[0] * r.v[1] - v[1] * r.v[0],
-	      0
-	    );
-    }
+    #if OCTET_SIMD
+      // quaternion multiply
+      vec4 qmul(const vec4 &r) const {
+        simd4 a = get_simd(), b = r.get_simd();
+        // the middle two terms are subtracted in w
+        simd4 sign = simd_set(0.0f, 0.0f, 0.0f, -0.0f);
+        simd4 t0 = simd_mul(a, simd_shuffle<3, 3, 3, 3>(b));
+        simd4 t1 = simd_mul(simd_shuffle<3, 3, 3, 0>(a), simd_shuffle<0, 1, 2, 0>(b));
+        simd4 t2 = simd_mul(simd_shuffle<1, 2, 0, 1>(a), simd_shuffle<2, 0, 1, 1>(b));
+        simd4 t3 = simd_mul(simd_shuffle<2, 0, 1, 2>(a), simd_shuffle<1, 2, 0, 2>(b));
+        return vec4(simd_sub(simd_add(simd_add(t0, simd_xor(t1, sign)), simd_xor(t2, sign)), t3));
+      }
+
+      // cross product
+      vec4 cross(const vec4 &r) const {
+        simd4 a = get_simd(), b = r.get_simd();
+        simd4 res = simd_sub(
+          simd_mul(simd_shuffle<1, 2, 0, 3>(a), simd_shuffle<2, 0, 1, 3>(b)),
+          simd_mul(simd_shuffle<2, 0, 1, 3>(a), simd_shuffle<1, 2, 0, 3>(b))
+        );
+        // w is a.w * b.w - a.w * b.w, which is not zero for infinities, so mask it off.
+        simd4 xyz_mask = simd_cmpgt(simd_set(1, 1, 1, 0), simd_zero());
+        return vec4(simd_and(res, xyz_mask));
+      }
+    #else
+      // quaternion multiply
+      vec4 qmul(const vec4 &r) const {
+        return vec4(
+	        v[0] * r.v[3] + v[3] * r.v[0] + v[1] * r.v[2] - v[2] * r.v[1],
+		      v[1] * r.v[3] + v[3] * r.v[1] + v[2] * r.v[0] - v[0] * r.v[2],
+		      v[2] * r.v[3] + v[3] * r.v[2] + v[0] * r.v[1] - v[1] * r.v[0],
+		      v[3] * r.v[3] - v[0] * r.v[0] - v[1] * r.v[1] - v[2] * r.v[2]
+        );
+      }
+
+      // cross product
+      vec4 cross(const vec4 &r) const {
+        return vec4(
+          v[1] * r.v[2] - v[2] * r.v[1],
+	        v[2] * r.v[0] - v[0] * r.v[2],
+	        v[0] * r.v[1] - v[1] * r.v[0],
+	        0
+	      );
+      }
+    #endif
 
     // access the floating point numbers
     float *get() { return &v[0]; }
@@ -313,5 +435,7 @@ namespace octet {
   inline vec4 operator/(float lhs, const vec4 &rhs) {
     return rhs / lhs;
   }
+
+  OCTET_RELOCATABLE(vec4)
 }
 
@@ -25,6 +25,12 @@ namespace octet {
     attribute_tangent = 14,
     attribute_bitangent = 15,
     attribute_binormal = 15,
+
+    // per instance matrices for instanced drawing (see render_queue).
+    // these share slots with specular, tessfactor, psize and texcoord sets 1-4,
+    // so meshes with any of those are never drawn instanced.
+    attribute_instance_modelToCamera = 4,       // mat3 in 4-6
+    attribute_instance_modelToProjection = 9,   // mat4 in 9-12
   };
 
   enum key {
@@ -80,6 +86,12 @@ namespace octet {
     // queue of files to load
     dynarray<string> load_queue;
 
+    // true when there is no window or OpenGL (see headless_runner)
+    static bool &headless() {
+      static bool value = false;
+      return value;
+    }
+
   public:
     app_common() {
       // this memset writes 0 to every byte of keys[]
@@ -95,6 +107,26 @@ namespace octet {
     virtual void draw_world(int x, int y, int w, int h) = 0;
     virtual void app_init() = 0;
 
+    // apps that can run with no window or OpenGL return true here and override draw_headless()
+    virtual bool can_run_headless() {
+      return false;
+    }
+
+    // update the world by one frame and draw it without OpenGL.
+    // return an RGB image, bottom row first.
+    virtual const uint8_t *draw_headless(int &width, int &height) {
+      return 0;
+    }
+
+    // headless apps must not call OpenGL, eg. in app_init()
+    static bool is_headless() {
+      return headless();
+    }
+
+    static void set_headless(bool value) {
+      headless() = value;
+    }
+
     // returns true if a key is down
     bool is_key_down(unsigned key) {
       return keys[key & 0xff] == 1;
@@ -120,6 +152,9 @@ namespace octet {
 
     void inc_frame_number() {
       frame_number++;
+
+      // throw away this frame's temporary data, including the worker threads'
+      frame_allocator::reset_all();
     }
 
     dynarray<string> &access_load_queue() {
@@ -134,7 +134,7 @@ namespace octet {
     static void timer(int value) {
       glutTimerFunc(16, timer, 1);
       map_t &m = map();
-      for (int i = 0; i != m.size(); ++i) {
+      for (int i = 0; i != m.capacity(); ++i) {
         if (m.key(i)) {
           glutSetWindow(m.key(i));
           glutPostRedisplay();
@@ -159,7 +159,7 @@ namespace octet {
 
     static void run_all_apps() {
       map_t &m = map();
-      for (int i = 0; i != m.size(); ++i) {
+      for (int i = 0; i != m.capacity(); ++i) {
         if (m.key(i)) {
           glutSetWindow(m.key(i));
           glutDisplayFunc(display);
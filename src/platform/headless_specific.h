@@ -0,0 +1,86 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Headless platform: no window, OpenGL or sound device.
+//
+// Used on platforms with no GLUT (eg. Linux build servers) or with -DOCTET_HEADLESS=1.
+// OpenGL calls go to the skeleton in gl3.h and sound to the fake OpenAL in al_defs.h,
+// so apps compile unchanged but can only draw through headless_runner.
+//
+
+// some standard c++ definitions
+#include <stdlib.h>
+
+#ifdef WIN32
+  #define WIN32_LEAN_AND_MEAN 1
+  #include <winsock2.h>
+  #undef min
+  #undef max
+  #pragma comment(lib, "Ws2_32.lib")
+  #define OCTET_HOT __forceinline
+#else
+  #include <unistd.h>
+  #include <sys/socket.h>
+  #include <sys/ioctl.h>
+  #include <fcntl.h>
+  #include <netinet/in.h>
+  #define OCTET_HOT __attribute__( ( always_inline ) )
+  #define ioctlsocket ioctl
+  #define closesocket close
+#endif
+
+#include "gl_skeleton.h"
+#include "al_defs.h"
+
+// OpenGL 1.x names that some examples still use, not in gl3.h
+#define GL_QUADS 0x0007
+#define GL_ALPHA_TEST 0x0BC0
+
+inline void glAlphaFunc(GLenum func, GLclampf ref) {
+}
+
+// include cross platform app helpers, such as texture loaders
+#include "app_common.h"
+
+namespace octet {
+  // this is the class that all apps are derived from.
+  class app : public app_common {
+    // state for the OpenGL skeleton
+    static gl_context &context() { static gl_context instance; return instance; }
+
+  public:
+    app(int argc, char **argv) {
+      gl_ctxt(&context());
+      set_headless(true);
+    }
+
+    void init() {
+      app_init();
+    }
+
+    void render() {
+    }
+
+    ~app() {
+    }
+
+    static void init_all(int &argc, char **argv) {
+      gl_ctxt(&context());
+      set_headless(true);
+      alcMakeContextCurrent(alcCreateContext(alcOpenDevice(NULL), NULL));
+    }
+
+    // there is no window to run the apps in
+    static void run_all_apps() {
+      printf("headless build: use -headless to draw the apps (see headless_runner.h)\n");
+    }
+
+    static void error(const char *msg) {
+      printf("%s - exiting\n", msg);
+      exit(1);
+    }
+  };
+}
@@ -26,6 +26,26 @@
   #define OCTET_OPENCL 0
 #endif
 
+// no window or OpenGL: platforms with no GLUT (eg. Linux) or -DOCTET_HEADLESS=1.
+// see headless_specific.h
+#ifndef OCTET_HEADLESS
+  #if defined(WIN32) || defined(SN_TARGET_PSP2) || defined(__APPLE__)
+    #define OCTET_HEADLESS 0
+  #else
+    #define OCTET_HEADLESS 1
+  #endif
+#endif
+
+// instanced drawing needs glDrawElementsInstanced and glVertexAttribDivisor (GLES3 or GL 3.3).
+// on windows we get these with wglGetProcAddress and check them at run time.
+#ifndef OCTET_INSTANCING
+  #if defined(WIN32) && !OCTET_HEADLESS
+    #define OCTET_INSTANCING 1
+  #else
+    #define OCTET_INSTANCING 0
+  #endif
+#endif
+
 // use <> to include from standard directories
 // use "" to include from our own project
 #include <stdio.h>
@@ -36,6 +56,30 @@
 #include <math.h>
 #include <assert.h>
 
+// SIMD maths: SSE2 on x86 and x64, NEON on ARM.
+// define OCTET_SSE=0 and OCTET_NEON=0 to use plain C++ everywhere.
+#ifndef OCTET_SSE
+  #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define OCTET_SSE 1
+  #else
+    #define OCTET_SSE 0
+  #endif
+#endif
+
+#ifndef OCTET_NEON
+  #if !OCTET_SSE && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+    #define OCTET_NEON 1
+  #else
+    #define OCTET_NEON 0
+  #endif
+#endif
+
+#if OCTET_SSE
+  #include <emmintrin.h>
+#elif OCTET_NEON
+  #include <arm_neon.h>
+#endif
+
 // xml library
 #include "../tinyxml/tinystr.cpp"
 #include "../tinyxml/tinyxml.cpp"
@@ -51,11 +95,15 @@ void *operator new(size_t size, void *place, dynarray_dummy_t x) { return place;
 // dummy placement delete operator, allows destruction at "place"
 void operator delete(void *ptr, void *place, dynarray_dummy_t x) {}
 
+#include "../containers/atomic.h"
 #include "../containers/allocator.h"
-#include "../containers/dictionary.h"
+#include "../containers/arena_allocator.h"
 #include "../containers/hash_map.h"
 #include "../containers/double_list.h"
 #include "../containers/dynarray.h"
+#include "../containers/string_hash.h"
+#include "../containers/string_table.h"
+#include "../containers/dictionary.h"
 #include "../containers/string.h"
 #include "../containers/ptr.h"
 #include "../containers/ref.h"
@@ -68,7 +116,9 @@ static char *get_sprintf_buffer() {
   return tmp[i++ & 3];
 }
 
-#ifdef WIN32
+#if OCTET_HEADLESS
+  #include "headless_specific.h"
+#elif defined(WIN32)
   #include "windows_specific.h"
   //#include "glut_specific.h"
 #elif defined(SN_TARGET_PSP2)
@@ -85,7 +135,10 @@ static char *get_sprintf_buffer() {
   #include "glut_specific.h"
 #endif
 
+#include "thread_pool.h"
+
 #include "../math/scalar.h"
+#include "../math/simd.h"
 #include "../math/rational.h"
 #include "../math/vec2.h"
 #include "../math/vec3.h"
@@ -97,7 +150,10 @@ static char *get_sprintf_buffer() {
 #include "../math/bvec3.h"
 #include "../math/bvec4.h"
 #include "../math/aabb.h"
+#include "../math/transform_batch.h"
 #include "../math/ray.h"
+#include "../math/ray_packet.h"
+#include "../math/frustum.h"
 #include "../math/random.h"
 
 // CG, GLSL, C++ compiler
@@ -145,10 +201,15 @@ static char *get_sprintf_buffer() {
 
 // scene
 #include "../scene/scene_node.h"
+#include "../scene/transform_hierarchy.h"
 #include "../scene/skin.h"
 #include "../scene/skeleton.h"
 #include "../scene/animation.h"
 #include "../scene/mesh.h"
+#include "../scene/skinned_mesh.h"
+#include "../scene/bvh_builder.h"
+#include "../scene/mesh_bvh.h"
+#include "../scene/scene_bvh.h"
 #include "../scene/image.h"
 #include "../scene/param.h"
 #include "../scene/material.h"
@@ -156,6 +217,8 @@ static char *get_sprintf_buffer() {
 #include "../scene/light_instance.h"
 #include "../scene/mesh_instance.h"
 #include "../scene/animation_instance.h"
+#include "../scene/animation_mixer.h"
+#include "../scene/render_queue.h"
 #include "../scene/scene.h"
 #include "../scene/displacement_map.h"
 #include "../scene/indexer.h"
@@ -168,6 +231,7 @@ static char *get_sprintf_buffer() {
 #include "../helpers/http_server.h"
 #include "../helpers/text_overlay.h"
 #include "../helpers/object_picker.h"
+#include "../helpers/headless_runner.h"
 
 // asset loaders
 #include "../loaders/collada_builder.h"
@@ -0,0 +1,220 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// run lots of small tasks on all the cores
+//
+// The worker threads are started the first time they are needed and sleep
+// until there is work. The calling thread works too, so run() returns when
+// every task is finished.
+//
+// example:
+//
+//   static void do_tile(void *context, unsigned index) {
+//     my_renderer *r = (my_renderer*)context;
+//     r->render_tile(index);
+//   }
+//
+//   thread_pool::run(do_tile, &renderer, num_tiles);
+//
+// Tasks may call run() themselves (on any thread, including the one that started
+// the job), but the inner tasks run serially on the thread that calls it.
+//
+
+#ifndef WIN32
+  #include <pthread.h>
+  #include <unistd.h>
+#endif
+
+namespace octet {
+  // counting semaphore: wait() blocks until someone calls post().
+  class semaphore {
+    #ifdef WIN32
+      HANDLE handle;
+    #else
+      pthread_mutex_t mutex;
+      pthread_cond_t cond;
+      int count;
+    #endif
+
+    semaphore(const semaphore &rhs) {
+      // you can't do this!
+    }
+  public:
+    semaphore() {
+      #ifdef WIN32
+        handle = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+      #else
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&cond, NULL);
+        count = 0;
+      #endif
+    }
+
+    ~semaphore() {
+      #ifdef WIN32
+        CloseHandle(handle);
+      #else
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+      #endif
+    }
+
+    // let n waiting threads go
+    void post(int n = 1) {
+      #ifdef WIN32
+        ReleaseSemaphore(handle, n, NULL);
+      #else
+        pthread_mutex_lock(&mutex);
+        count += n;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&mutex);
+      #endif
+    }
+
+    void wait() {
+      #ifdef WIN32
+        WaitForSingleObject(handle, INFINITE);
+      #else
+        pthread_mutex_lock(&mutex);
+        while (count == 0) {
+          pthread_cond_wait(&cond, &mutex);
+        }
+        count--;
+        pthread_mutex_unlock(&mutex);
+      #endif
+    }
+  };
+
+  class thread_pool {
+  public:
+    // a task gets the context from run() and its index, 0 .. num_tasks-1
+    typedef void (*task_fn)(void *context, unsigned index);
+
+  private:
+    enum { max_threads = 64 };
+
+    // the current job
+    task_fn fn;
+    void *context;
+    int num_tasks;
+    volatile int next_task;
+
+    // workers wait on "start" and post "finished" when they run out of tasks.
+    semaphore start;
+    semaphore finished;
+    int num_workers;
+
+    // never destroyed: the workers are still waiting on the semaphores at exit.
+    static thread_pool &state() {
+      static thread_pool *the_pool = new thread_pool();
+      return *the_pool;
+    }
+
+    // true on our worker threads, and on the calling thread while it works on a job,
+    // so that nested run() calls don't deadlock or overwrite the job.
+    static bool &in_job() {
+      static OCTET_THREAD_LOCAL bool value;
+      return value;
+    }
+
+    static unsigned get_num_cores() {
+      #ifdef WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        int n = (int)info.dwNumberOfProcessors;
+      #else
+        int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+      #endif
+      return n < 1 ? 1 : n > max_threads ? max_threads : n;
+    }
+
+    // take tasks until there are none left
+    void do_tasks() {
+      for (;;) {
+        int index = atomic::add(&next_task, 1) - 1;
+        if (index >= num_tasks) break;
+        fn(context, (unsigned)index);
+      }
+    }
+
+    void worker() {
+      in_job() = true;
+      for (;;) {
+        start.wait();
+        do_tasks();
+        finished.post();
+      }
+    }
+
+    #ifdef WIN32
+      static DWORD WINAPI thread_main(LPVOID param) {
+        ((thread_pool*)param)->worker();
+        return 0;
+      }
+    #else
+      static void *thread_main(void *param) {
+        ((thread_pool*)param)->worker();
+        return NULL;
+      }
+    #endif
+
+    thread_pool() {
+      fn = NULL;
+      context = NULL;
+      num_tasks = 0;
+      next_task = 0;
+
+      // the calling thread makes up the numbers
+      num_workers = 0;
+      for (unsigned i = 1; i < get_num_cores(); ++i) {
+        #ifdef WIN32
+          HANDLE handle = CreateThread(NULL, 0, thread_main, (LPVOID)this, 0, NULL);
+          if (!handle) break;
+          CloseHandle(handle);
+        #else
+          pthread_t thread;
+          if (pthread_create(&thread, NULL, thread_main, (void*)this)) break;
+          pthread_detach(thread);
+        #endif
+        num_workers++;
+      }
+    }
+
+  public:
+    // number of threads that run tasks, including the caller
+    static unsigned get_num_threads() {
+      return state().num_workers + 1;
+    }
+
+    // call fn(context, i) for i in 0 .. num_tasks-1 and wait until they are all done.
+    // only one thread (eg. the main thread) should start jobs at a time.
+    static void run(task_fn fn, void *context, unsigned num_tasks) {
+      thread_pool &p = state();
+      if (in_job() || p.num_workers == 0 || num_tasks <= 1) {
+        for (unsigned i = 0; i != num_tasks; ++i) {
+          fn(context, i);
+        }
+        return;
+      }
+
+      p.fn = fn;
+      p.context = context;
+      p.num_tasks = (int)num_tasks;
+      atomic::exchange(&p.next_task, 0);
+
+      // every worker we wake posts "finished" exactly once, so after the waits
+      // nobody is looking at the job any more.
+      int num_woken = (int)num_tasks - 1 < p.num_workers ? (int)num_tasks - 1 : p.num_workers;
+      p.start.post(num_woken);
+      in_job() = true;
+      p.do_tasks();
+      for (int i = 0; i != num_woken; ++i) {
+        p.finished.wait();
+      }
+      in_job() = false;
+    }
+  };
+}
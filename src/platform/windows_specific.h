@@ -69,9 +69,6 @@
 // A limited number uses per program is recommended.
 #define OCTET_HOT __forceinline
 
-#define OCTET_SSE 0
-#include <xmmintrin.h>
-
 namespace octet {
   class HWND_cmp {
   public:
@@ -288,7 +285,7 @@ namespace octet {
         // waste some time. (do not do this in real games!)
         Sleep(1000/30);
 
-        for (int i = 0; i != m.size(); ++i) {
+        for (int i = 0; i != m.capacity(); ++i) {
           // note: because Win8 generates an invisible window, we need to check m.value(i)
           if (m.key(i) && m.value(i)) m.value(i)->render();
         }
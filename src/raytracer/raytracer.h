@@ -4,272 +4,894 @@
 //
 // Ray tracing renderer
 //
+// Fill in a raytracer::context with the camera, lights and objects and call ray_trace()
+// every frame to get an RGB image in context::texture_handle.
+//
+// With OCTET_OPENCL this uses the GPU (work in progress), otherwise it traces on the CPU.
+//
 
+namespace octet {
 #if OCTET_OPENCL
-class raytracer {
-public:
-  struct context {
-    int width;
-    int height;
-    GLuint texture_handle;
-
-    mat4t cameraToWorld;
-    float near_plane;
-    float far_plane;
-    float near_plane_xmax;
-    float near_plane_ymax;
-
-    lighting *lights;
-
-    int num_objects;
-    mat4t *modelToWorld;
-    mesh **meshes;
-    material **materials;
-  };
+  class raytracer {
+  public:
+    struct context {
+      int width;
+      int height;
+      GLuint texture_handle;
+
+      mat4t cameraToWorld;
+      float near_plane;
+      float far_plane;
+      float near_plane_xmax;
+      float near_plane_ymax;
+
+      light_instance **lights;
+      int num_lights;
+
+      int num_objects;
+      mat4t *modelToWorld;
+      mesh **meshes;
+      material **materials;
+    };
+
+    struct tri_context {
+      int dom_axis;
+      float xplane, yplane, zplane;
+      float pxa,  pya,  dxdya,  pxb,  pyb,  dxdyb;
+      int x0p, x1p;
+      int x0, x1, x2;
+      int xmin, xmax;
+      unsigned triangle;
+      mesh *mesh;
+    };
+
+  private:
+    context ctxt;
+    dynarray<unsigned char> image;
+    tri_context tc;
+    cl_context cl;
+    cl_command_queue queue;
+    cl_program prog;
+    cl_kernel gen_voxels;
+    dynarray<unsigned char> src;
+
+  public:
+    raytracer() {
+      // in case of disaster, clear variables
+      cl = 0;
+      queue = 0;
+      prog = 0;
+      gen_voxels = 0;
+    }
+
+    void init() {
+      // set up OpenCL
+      cl_platform_id platform;
+      if (clGetPlatformIDs(1, &platform, NULL)) { app::error("clGetPlatformIDs"); }
+
+      cl_device_id devices[32];
+      cl_uint devices_size;
+      if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 32, devices, &devices_size)) { app::error("clGetDeviceIDs"); }
+      cl_device_id device = devices[0];
+
+      /*int image_support = 0;
+      clGetDeviceInfo(devices[0], CL_DEVICE_IMAGE_SUPPORT, sizeof(int), &image_support, 0);
+      printf("image_support=%d\n", image_support);*/
+
+      cl_int error = 0;
+
+      #if 0
+      // Create CL context properties, add WGL context & handle to DC 
+      cl_context_properties properties[] = { 
+        CL_GL_CONTEXT_KHR,   (cl_context_properties)wglGetCurrentContext(), // WGL Context 
+        //CL_WGL_HDC_KHR,      (cl_context_properties)wglGetCurrentDC(),      // WGL HDC
+        //CL_CONTEXT_PLATFORM, (cl_context_properties)platform,               // OpenCL platform
+        0
+      };
+
+      /*clGetGLContextInfoKHR_fn clGetGLContextInfoKHR =
+        (clGetGLContextInfoKHR_fn)clGetExtensionFunctionAddress("clGetGLContextInfoKHR")
+      ;
+
+      // Find CL capable devices in the current GL context 
+      cl_device_id devices[32];
+      size_t size = 0;
+      clGetGLContextInfoKHR(
+        properties, CL_DEVICES_FOR_GL_CONTEXT_KHR, sizeof(devices), devices, &size
+      );*/
+      #endif
+
+      // Create a context using the supported devices
+      //int count = size / sizeof(cl_device_id);
+      //cl_context context = clCreateContext(properties, count, devices, NULL, 0, 0);
+      cl = clCreateContext(0, 1, &device, NULL, NULL, &error);
+      if (error) { app::error("clCreateContext"); }
+
+      queue = clCreateCommandQueue(cl, device, 0, &error);
+      if (error) { app::error("clCreateCommandQueue"); }
+
+      // build the program
+      app_utils::get_url(src, "assets/opencl/raytracer.cl");
+      size_t src_size = src.size();
+      const char *src_addr = (const char*)&src[0];
+      if (!src_size) { app::error("assets/opencl/raytracer.cl not found - check launch directory"); }
+      prog = clCreateProgramWithSource(cl, 1, &src_addr, &src_size, &error);
+      if (error) { app::error("clCreateProgramWithSource"); }
+
+      error = clBuildProgram(prog, 1, &device, 0, 0, 0);
+
+      size_t log_size = 0;
+      clGetProgramBuildInfo(prog, device, CL_PROGRAM_BUILD_LOG, 0, 0, &log_size);
+      dynarray<char> log((int)log_size+1);
+
+      clGetProgramBuildInfo(prog, device, CL_PROGRAM_BUILD_LOG, log_size, &log[0], &log_size);
+      if (log_size) {
+        log[(int)log_size] = 0;
+        printf("log: %s\n", &log[0]);
+        fflush(stdout);
+      }
+      if (error) { app::error("clBuildProgram"); }
+
+      #if 0
+      // you can use this code to get the LLVM asm generated by the compiler
+      size_t bin_size;
+      clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(bin_size), &bin_size, 0);
+      dynarray<unsigned char> binary(bin_size);
+      unsigned char *bin = &binary[0];
+      clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(bin), &bin, 0);
+
+      FILE *file = fopen("c:/tmp/disasm.txt", "wb");
+      fwrite(bin + 12, 1, (unsigned&)bin[4], file);
+      /*fprintf(file, "\n");
+      fprintf(file, "\n");
+      for (int i = 0; i < bin_size; ++i) {
+        fprintf(file, "%02x%c", bin[i], i % 16 == 15 ? '\n' : ' ');
+      }
+      fprintf(file, "\n");*/
+      fclose(file);
+      #endif
+
+      gen_voxels = clCreateKernel(prog, "gen_voxels", &error);
+      if (error) { app::error("clCreateKernel - gen_voxels"); }
+
+    }
+
+    ~raytracer() {
+      clReleaseKernel(gen_voxels);
+      clReleaseProgram(prog);
+      clReleaseCommandQueue(queue);
+      clReleaseContext(cl);
+    }
 
-  struct tri_context {
-    int dom_axis;
-    float xplane, yplane, zplane;
-    float pxa,  pya,  dxdya,  pxb,  pyb,  dxdyb;
-    int x0p, x1p;
-    int x0, x1, x2;
-    int xmin, xmax;
-    unsigned triangle;
-    mesh *mesh;
+    // public interface
+    void ray_trace(const context &ctxt) {
+      this->ctxt = ctxt;
+      image.resize(ctxt.width * ctxt.height * 3);
+      memset(&image[0], 0x80, ctxt.width * ctxt.height * 3);
+
+
+      /*for (int i = 0; i != ctxt.num_objects; ++i) {
+        mat4t modelToWorld = ctxt.modelToWorld[i];
+        mesh *mesh = ctxt.meshes[i];
+        vec4 min, max;
+        modelToWorld.translate(3, 3, 3);
+        modelToWorld.scale(8, 8, 8);
+        const float *vertices = (const float *)mesh->get_vertices();
+        const unsigned short *indices = (const unsigned short *)mesh->get_indices();
+        unsigned stride = mesh->get_stride();
+        vec4 pos0a = mesh->get_value(0, 141*3);
+        vec4 pos1a = mesh->get_value(0, 141*3+1);
+        vec4 pos2a = mesh->get_value(0, 141*3+2);
+        vec4 pos0 = (vec4&)vertices[stride/4*(141*3+0)];
+        vec4 pos1 = (vec4&)vertices[stride/4*(141*3+1)];
+        vec4 pos2 = (vec4&)vertices[stride/4*(141*3+2)];
+        //printf("%d %d %d\n", indices[141*3+0], indices[141*3+1], indices[141*3+2]);
+        printf("%s\n", pos0a.toString());
+        printf("%s\n", pos1a.toString());
+        printf("%s\n", pos2a.toString());
+        printf("%s\n", pos0.toString());
+        printf("%s\n", pos1.toString());
+        printf("%s\n", pos2.toString());
+      }*/
+
+
+      cl_int error;
+      //cl_mem image_mem = clCreateFromGLTexture2D(cl, CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0, ctxt.texture_handle, &error);
+      cl_mem image_mem = clCreateBuffer(cl, CL_MEM_READ_WRITE|CL_MEM_USE_HOST_PTR, ctxt.width * ctxt.height * 3, &image[0], &error);
+      if (error) app::error("clCreateFromGLTexture2D");
+
+      dynarray<unsigned> octree(0x100000);
+      memset(&octree[0], 0, octree.size()*sizeof(octree[0]));
+      octree[0] = 1 + 8 + 4; // allocator + addr*8 + normal
+      cl_mem octree_mem = clCreateBuffer(cl, CL_MEM_READ_WRITE|CL_MEM_USE_HOST_PTR, octree.size()*sizeof(octree[0]), (void*)&octree[0], &error);
+      if (error) app::error("clCreateBuffer - octree");
+
+      for (int i = 0; i != ctxt.num_objects; ++i) {
+        mat4t modelToWorld = ctxt.modelToWorld[i];
+        mesh *mesh = ctxt.meshes[i];
+        vec4 min, max;
+        // adjust size of voxels
+        modelToWorld.scale(32, 32, 32);
+        // add offset to make all numbers positive. Note: this is not the same as translate()
+        modelToWorld.w() += vec4(128, 128, 128, 0);
+
+        cl_mem vertices_mem = clCreateBuffer(cl, CL_MEM_READ_ONLY|CL_MEM_USE_HOST_PTR, mesh->get_vertices_size(), (void*)mesh->get_vertices(), &error);
+        if (error) app::error("clCreateBuffer");
+
+        cl_mem indices_mem = clCreateBuffer(cl, CL_MEM_READ_ONLY|CL_MEM_USE_HOST_PTR, mesh->get_indices_size(), (void*)mesh->get_indices(), &error);
+        if (error) app::error("clCreateBuffer - indices");
+
+
+        int num_indices = mesh->get_num_indices();
+        int stride = mesh->get_stride() / 4;
+
+        if (
+          clSetKernelArg(gen_voxels, 0, sizeof(image_mem), &image_mem)
+          | clSetKernelArg(gen_voxels, 1, sizeof(ctxt.width), &ctxt.width)
+          | clSetKernelArg(gen_voxels, 2, sizeof(ctxt.height), &ctxt.height)
+          | clSetKernelArg(gen_voxels, 3, sizeof(vertices_mem), &vertices_mem)
+          | clSetKernelArg(gen_voxels, 4, sizeof(indices_mem), &indices_mem)
+          | clSetKernelArg(gen_voxels, 5, sizeof(num_indices), &num_indices)
+          | clSetKernelArg(gen_voxels, 6, sizeof(stride), &stride)
+          | clSetKernelArg(gen_voxels, 7, sizeof(modelToWorld), &modelToWorld)
+          | clSetKernelArg(gen_voxels, 8, sizeof(octree_mem), &octree_mem)
+        ) app::error("clSetKernelArg");
+
+        const int work_size = 32;
+        size_t local = 1;
+        size_t global = (num_indices / 3) / work_size + 1;
+        static int times;
+        if (times++ == 0) error = clEnqueueNDRangeKernel(queue, gen_voxels, 1, NULL, &global, &local, 0, 0, 0);
+        if (error) app::error("running gen_voxels");
+
+        clReleaseMemObject(vertices_mem);
+        clReleaseMemObject(indices_mem);
+      }
+      clFinish(queue);
+
+
+      glBindTexture(GL_TEXTURE_2D, ctxt.texture_handle);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ctxt.width, ctxt.height, GL_RGB, GL_UNSIGNED_BYTE, &image[0]);
+
+      clReleaseMemObject(image_mem);
+
+      dump_octree(&octree[0], 1, 0, 0, 0, 0);
+      exit(1);
+
+      clReleaseMemObject(octree_mem);
+    }
+
+    // no progressive mode on the GPU yet
+    void path_trace(const context &ctxt, float time_budget) {
+      ray_trace(ctxt);
+    }
+
+    unsigned get_num_samples() const {
+      return 1;
+    }
+
+    const uint8_t *get_pixels() const {
+      return image.size() ? &image[0] : 0;
+    }
+
+    void dump_octree(unsigned *ptr, unsigned index, int depth, int x, int y, int z) {
+      printf("%*s@%04x %02x %02x %02x\n", depth*2, "", index, x, y, z);
+      int half = 128 >> depth;
+      for (int i = 0; i != 8; ++i) {
+        if (ptr[index+i]) {
+          dump_octree(ptr, ptr[index+i], depth+1, i&1?x+half:x, i&2?y+half:y, i&4?z+half:z);
+        }
+      }
+    }
   };
 
-private:
-  context ctxt;
-  dynarray<unsigned char> image;
-  tri_context tc;
-  cl_context cl;
-  cl_command_queue queue;
-  cl_program prog;
-  cl_kernel gen_voxels;
-  dynarray<unsigned char> src;
-
-public:
-  raytracer() {
-    // in case of disaster, clear variables
-    cl = 0;
-    queue = 0;
-    prog = 0;
-    gen_voxels = 0;
-  }
-
-  void init() {
-    // set up OpenCL
-    cl_platform_id platform;
-    if (clGetPlatformIDs(1, &platform, NULL)) { app::error("clGetPlatformIDs"); }
-
-    cl_device_id devices[32];
-    cl_uint devices_size;
-    if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 32, devices, &devices_size)) { app::error("clGetDeviceIDs"); }
-    cl_device_id device = devices[0];
-
-    /*int image_support = 0;
-    clGetDeviceInfo(devices[0], CL_DEVICE_IMAGE_SUPPORT, sizeof(int), &image_support, 0);
-    printf("image_support=%d\n", image_support);*/
-
-    cl_int error = 0;
-
-    #if 0
-    // Create CL context properties, add WGL context & handle to DC 
-    cl_context_properties properties[] = { 
-      CL_GL_CONTEXT_KHR,   (cl_context_properties)wglGetCurrentContext(), // WGL Context 
-      //CL_WGL_HDC_KHR,      (cl_context_properties)wglGetCurrentDC(),      // WGL HDC
-      //CL_CONTEXT_PLATFORM, (cl_context_properties)platform,               // OpenCL platform
-      0
+#else
+  // CPU ray tracer
+  //
+  // The objects go into a scene_bvh, which refits every frame and keeps one tree per mesh.
+  // The image is split into tiles which are traced on all cores with the thread_pool.
+  // Camera rays are traced in packets of 4x2 pixels, shadow rays one at a time.
+  // Each hit casts a shadow ray towards every light.
+  //
+  // path_trace() is a progressive alternative to ray_trace(). It adds diffuse bounces,
+  // averages samples over many frames and only starts again when something moves.
+  class raytracer {
+  public:
+    struct context {
+      int width;
+      int height;
+      GLuint texture_handle;
+
+      mat4t cameraToWorld;
+      float near_plane;
+      float far_plane;
+      float near_plane_xmax;
+      float near_plane_ymax;
+
+      light_instance **lights;
+      int num_lights;
+
+      int num_objects;
+      mat4t *modelToWorld;
+      mesh **meshes;
+      material **materials;
+    };
+
+  private:
+    enum {
+      tile_size = 32,
+      packet_width = 4,
+      packet_height = 2,
+    };
+
+    // where to find the vertices of an object for shading
+    struct object {
+      const uint8_t *vertices;
+      unsigned stride;
+      unsigned pos_offset;
+      int normal_offset;
+      int uv_offset;
+      const uint8_t *indices;
+      bool short_indices;
+    };
+
+    // a directional light in world space
+    struct light {
+      vec3 direction;
+      vec3 color;
     };
 
-    /*clGetGLContextInfoKHR_fn clGetGLContextInfoKHR =
-      (clGetGLContextInfoKHR_fn)clGetExtensionFunctionAddress("clGetGLContextInfoKHR")
-    ;
-
-    // Find CL capable devices in the current GL context 
-    cl_device_id devices[32];
-    size_t size = 0;
-    clGetGLContextInfoKHR(
-      properties, CL_DEVICES_FOR_GL_CONTEXT_KHR, sizeof(devices), devices, &size
-    );*/
-    #endif
-
-    // Create a context using the supported devices
-    //int count = size / sizeof(cl_device_id);
-    //cl_context context = clCreateContext(properties, count, devices, NULL, 0, 0);
-    cl = clCreateContext(0, 1, &device, NULL, NULL, &error);
-    if (error) { app::error("clCreateContext"); }
-
-    queue = clCreateCommandQueue(cl, device, 0, &error);
-    if (error) { app::error("clCreateCommandQueue"); }
-
-    // build the program
-    app_utils::get_url(src, "assets/opencl/raytracer.cl");
-    size_t src_size = src.size();
-    const char *src_addr = (const char*)&src[0];
-    if (!src_size) { app::error("assets/opencl/raytracer.cl not found - check launch directory"); }
-    prog = clCreateProgramWithSource(cl, 1, &src_addr, &src_size, &error);
-    if (error) { app::error("clCreateProgramWithSource"); }
-
-    error = clBuildProgram(prog, 1, &device, 0, 0, 0);
-
-    size_t log_size = 0;
-    clGetProgramBuildInfo(prog, device, CL_PROGRAM_BUILD_LOG, 0, 0, &log_size);
-    dynarray<char> log((int)log_size+1);
-
-    clGetProgramBuildInfo(prog, device, CL_PROGRAM_BUILD_LOG, log_size, &log[0], &log_size);
-    if (log_size) {
-      log[(int)log_size] = 0;
-      printf("log: %s\n", &log[0]);
-      fflush(stdout);
-    }
-    if (error) { app::error("clBuildProgram"); }
-
-    #if 0
-    // you can use this code to get the LLVM asm generated by the compiler
-    size_t bin_size;
-    clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(bin_size), &bin_size, 0);
-    dynarray<unsigned char> binary(bin_size);
-    unsigned char *bin = &binary[0];
-    clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(bin), &bin, 0);
-
-    FILE *file = fopen("c:/tmp/disasm.txt", "wb");
-    fwrite(bin + 12, 1, (unsigned&)bin[4], file);
-    /*fprintf(file, "\n");
-    fprintf(file, "\n");
-    for (int i = 0; i < bin_size; ++i) {
-      fprintf(file, "%02x%c", bin[i], i % 16 == 15 ? '\n' : ' ');
-    }
-    fprintf(file, "\n");*/
-    fclose(file);
-    #endif
-
-    gen_voxels = clCreateKernel(prog, "gen_voxels", &error);
-    if (error) { app::error("clCreateKernel - gen_voxels"); }
-
-  }
-
-  ~raytracer() {
-    clReleaseKernel(gen_voxels);
-    clReleaseProgram(prog);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(cl);
-  }
-
-  // public interface
-  void ray_trace(const context &ctxt) {
-    this->ctxt = ctxt;
-    image.resize(ctxt.width * ctxt.height * 3);
-    memset(&image[0], 0x80, ctxt.width * ctxt.height * 3);
-
-
-    /*for (int i = 0; i != ctxt.num_objects; ++i) {
-      mat4t modelToWorld = ctxt.modelToWorld[i];
-      mesh *mesh = ctxt.meshes[i];
-      vec4 min, max;
-      modelToWorld.translate(3, 3, 3);
-      modelToWorld.scale(8, 8, 8);
-      const float *vertices = (const float *)mesh->get_vertices();
-      const unsigned short *indices = (const unsigned short *)mesh->get_indices();
-      unsigned stride = mesh->get_stride();
-      vec4 pos0a = mesh->get_value(0, 141*3);
-      vec4 pos1a = mesh->get_value(0, 141*3+1);
-      vec4 pos2a = mesh->get_value(0, 141*3+2);
-      vec4 pos0 = (vec4&)vertices[stride/4*(141*3+0)];
-      vec4 pos1 = (vec4&)vertices[stride/4*(141*3+1)];
-      vec4 pos2 = (vec4&)vertices[stride/4*(141*3+2)];
-      //printf("%d %d %d\n", indices[141*3+0], indices[141*3+1], indices[141*3+2]);
-      printf("%s\n", pos0a.toString());
-      printf("%s\n", pos1a.toString());
-      printf("%s\n", pos2a.toString());
-      printf("%s\n", pos0.toString());
-      printf("%s\n", pos1.toString());
-      printf("%s\n", pos2.toString());
-    }*/
-
-
-    cl_int error;
-    //cl_mem image_mem = clCreateFromGLTexture2D(cl, CL_MEM_READ_WRITE, GL_TEXTURE_2D, 0, ctxt.texture_handle, &error);
-    cl_mem image_mem = clCreateBuffer(cl, CL_MEM_READ_WRITE|CL_MEM_USE_HOST_PTR, ctxt.width * ctxt.height * 3, &image[0], &error);
-    if (error) app::error("clCreateFromGLTexture2D");
-
-    dynarray<unsigned> octree(0x100000);
-    memset(&octree[0], 0, octree.size()*sizeof(octree[0]));
-    octree[0] = 1 + 8 + 4; // allocator + addr*8 + normal
-    cl_mem octree_mem = clCreateBuffer(cl, CL_MEM_READ_WRITE|CL_MEM_USE_HOST_PTR, octree.size()*sizeof(octree[0]), (void*)&octree[0], &error);
-    if (error) app::error("clCreateBuffer - octree");
-
-    for (int i = 0; i != ctxt.num_objects; ++i) {
-      mat4t modelToWorld = ctxt.modelToWorld[i];
-      mesh *mesh = ctxt.meshes[i];
-      vec4 min, max;
-      // adjust size of voxels
-      modelToWorld.scale(32, 32, 32);
-      // add offset to make all numbers positive. Note: this is not the same as translate()
-      modelToWorld.w() += vec4(128, 128, 128, 0);
-
-      cl_mem vertices_mem = clCreateBuffer(cl, CL_MEM_READ_ONLY|CL_MEM_USE_HOST_PTR, mesh->get_vertices_size(), (void*)mesh->get_vertices(), &error);
-      if (error) app::error("clCreateBuffer");
-
-      cl_mem indices_mem = clCreateBuffer(cl, CL_MEM_READ_ONLY|CL_MEM_USE_HOST_PTR, mesh->get_indices_size(), (void*)mesh->get_indices(), &error);
-      if (error) app::error("clCreateBuffer - indices");
-
-
-      int num_indices = mesh->get_num_indices();
-      int stride = mesh->get_stride() / 4;
-
-      if (
-        clSetKernelArg(gen_voxels, 0, sizeof(image_mem), &image_mem)
-        | clSetKernelArg(gen_voxels, 1, sizeof(ctxt.width), &ctxt.width)
-        | clSetKernelArg(gen_voxels, 2, sizeof(ctxt.height), &ctxt.height)
-        | clSetKernelArg(gen_voxels, 3, sizeof(vertices_mem), &vertices_mem)
-        | clSetKernelArg(gen_voxels, 4, sizeof(indices_mem), &indices_mem)
-        | clSetKernelArg(gen_voxels, 5, sizeof(num_indices), &num_indices)
-        | clSetKernelArg(gen_voxels, 6, sizeof(stride), &stride)
-        | clSetKernelArg(gen_voxels, 7, sizeof(modelToWorld), &modelToWorld)
-        | clSetKernelArg(gen_voxels, 8, sizeof(octree_mem), &octree_mem)
-      ) app::error("clSetKernelArg");
-
-      const int work_size = 32;
-      size_t local = 1;
-      size_t global = (num_indices / 3) / work_size + 1;
-      static int times;
-      if (times++ == 0) error = clEnqueueNDRangeKernel(queue, gen_voxels, 1, NULL, &global, &local, 0, 0, 0);
-      if (error) app::error("running gen_voxels");
-
-      clReleaseMemObject(vertices_mem);
-      clReleaseMemObject(indices_mem);
-    }
-    clFinish(queue);
-
-
-    glBindTexture(GL_TEXTURE_2D, ctxt.texture_handle);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ctxt.width, ctxt.height, GL_RGB, GL_UNSIGNED_BYTE, &image[0]);
-
-    clReleaseMemObject(image_mem);
-
-    dump_octree(&octree[0], 1, 0, 0, 0, 0);
-    exit(1);
-
-    clReleaseMemObject(octree_mem);
-  }
-
-  void dump_octree(unsigned *ptr, unsigned index, int depth, int x, int y, int z) {
-    printf("%*s@%04x %02x %02x %02x\n", depth*2, "", index, x, y, z);
-    int half = 128 >> depth;
-    for (int i = 0; i != 8; ++i) {
-      if (ptr[index+i]) {
-        dump_octree(ptr, ptr[index+i], depth+1, i&1?x+half:x, i&2?y+half:y, i&4?z+half:z);
+    context ctxt;
+    dynarray<uint8_t> pixels;
+    int num_tiles_x;
+    int num_tiles_y;
+
+    scene_bvh bvh;
+    dynarray<object> objects;
+    dynarray<light> lights;
+    vec3 ambient;
+
+    // camera in world space
+    vec3 eye;
+    vec3 camera_x;
+    vec3 camera_y;
+    vec3 camera_z;
+
+    // progressive path tracing: the first passes are low resolution previews
+    enum { num_preview_passes = 3, preview_block = 8 };
+    dynarray<float> accum;      // sum of the samples for each pixel
+    unsigned num_passes;        // passes finished
+    unsigned next_tile;         // next tile of this pass
+    unsigned first_task_tile;   // tile for task 0 of thread_pool::run
+    unsigned max_bounces;
+
+    // what we path traced last time, so we can tell if anything moved
+    int last_width;
+    int last_height;
+    mat4t last_cameraToWorld;
+    dynarray<mat4t> last_modelToWorld;
+    dynarray<mesh*> last_meshes;
+    dynarray<material*> last_materials;
+
+    // the buffers of each mesh and their versions, so that edited or re-posed
+    // (skinned_mesh) vertices also start the image again
+    struct mesh_state {
+      gl_resource *vertices;
+      gl_resource *indices;
+      unsigned vertex_version;
+      unsigned index_version;
+
+      bool operator!=(const mesh_state &rhs) const {
+        return vertices != rhs.vertices || indices != rhs.indices || vertex_version != rhs.vertex_version || index_version != rhs.index_version;
+      }
+    };
+    dynarray<mesh_state> last_mesh_states;
+
+    static mesh_state get_mesh_state(const mesh *m) {
+      mesh_state s;
+      s.vertices = m ? m->get_vertices() : 0;
+      s.indices = m ? m->get_indices() : 0;
+      s.vertex_version = s.vertices ? s.vertices->get_version() : 0;
+      s.index_version = s.indices ? s.indices->get_version() : 0;
+      return s;
+    }
+    dynarray<light> last_lights;
+    vec3 last_ambient;
+
+    void add_object(int obj) {
+      mesh *m = ctxt.meshes[obj];
+      object &o = objects[obj];
+      memset(&o, 0, sizeof(o));
+      if (!m) return;
+
+      // the bvh ignores objects without positions, so we never shade them.
+      unsigned pos_slot = m->get_slot(attribute_pos);
+      o.vertices = (const uint8_t *)m->get_vertices()->lock_read_only();
+      o.stride = m->get_stride();
+      o.pos_offset = pos_slot == ~0u ? 0 : m->get_offset(pos_slot);
+
+      // missing normals or uvs are -1 and we use the face normal and uv 0, 0
+      unsigned normal_slot = m->get_slot(attribute_normal);
+      bool has_normals = normal_slot != ~0u && m->get_kind(normal_slot) == GL_FLOAT && m->get_size(normal_slot) >= 3;
+      o.normal_offset = has_normals ? (int)m->get_offset(normal_slot) : -1;
+      unsigned uv_slot = m->get_slot(attribute_uv);
+      bool has_uvs = uv_slot != ~0u && m->get_kind(uv_slot) == GL_FLOAT && m->get_size(uv_slot) >= 2;
+      o.uv_offset = has_uvs ? (int)m->get_offset(uv_slot) : -1;
+
+      gl_resource *index_buffer = m->get_indices();
+      o.indices = index_buffer ? (const uint8_t *)index_buffer->lock_read_only() : 0;
+      o.short_indices = m->get_index_type() == GL_UNSIGNED_SHORT;
+      m->get_vertices()->unlock_read_only();
+      if (index_buffer) index_buffer->unlock_read_only();
+
+      // load textures now, not in the worker threads
+      material *mat = ctxt.materials[obj];
+      param *params[] = { mat->get_diffuse(), mat->get_ambient(), mat->get_emission(), mat->get_specular(), mat->get_shininess() };
+      for (unsigned j = 0; j != sizeof(params)/sizeof(params[0]); ++j) {
+        if (params[j]) params[j]->load_texels();
       }
     }
-  }
-};
 
-#else
-class raytracer {
-public:
-  void init() {
-  }
-};
+    // like the shaders, every light is directional along its node's z axis.
+    void add_lights() {
+      lights.resize(0);
+      ambient = vec3(0, 0, 0);
+      int num_ambient = 0;
+      for (int i = 0; i != ctxt.num_lights; ++i) {
+        light_instance *li = ctxt.lights[i];
+        if (li->get_kind() == atom_ambient) {
+          ambient += li->get_color().xyz();
+          num_ambient++;
+        } else if (li->get_node()) {
+          light l;
+          l.direction = li->get_node()->calcModelToWorld().z().xyz().normalize();
+          l.color = li->get_color().xyz();
+          lights.push_back(l);
+        }
+      }
+      if (num_ambient == 0) {
+        ambient = vec3(0.5f, 0.5f, 0.5f);
+      }
+    }
 
+    unsigned get_index(const object &o, unsigned i) const {
+      return !o.indices ? i : o.short_indices ? ((const uint16_t*)o.indices)[i] : ((const uint32_t*)o.indices)[i];
+    }
+
+    const float *get_attr(const object &o, unsigned vertex, unsigned offset) const {
+      return (const float*)(o.vertices + o.stride * vertex + offset);
+    }
+
+    static vec4 get_texel(param *p, const vec2 &uv, const vec4 &missing) {
+      return p ? p->get_texel(uv.x(), uv.y()) : missing;
+    }
+
+    // what we need to know to light a point on a surface
+    struct surface {
+      vec3 pos;
+      vec3 normal;          // facing the viewer
+      vec3 view;            // towards the viewer
+      vec3 shadow_origin;   // pos, lifted off the surface
+      vec4 diffuse;
+      vec4 ambient;
+      vec4 emission;
+      vec4 specular;
+      float shininess;
+    };
+
+    // find the position, normal and material colors of a hit seen along dir from origin
+    void get_surface(surface &s, const vec3 &origin, const vec3 &dir, const scene_bvh::hit &h) const {
+      const object &o = objects[h.instance];
+      const mat4t &modelToWorld = ctxt.modelToWorld[h.instance];
+      unsigned idx[3];
+      for (int j = 0; j != 3; ++j) {
+        idx[j] = get_index(o, h.triangle * 3 + j);
+      }
+
+      float w = 1.0f - h.u - h.v;
+      vec3 n;
+      if (o.normal_offset >= 0) {
+        const float *n0 = get_attr(o, idx[0], o.normal_offset);
+        const float *n1 = get_attr(o, idx[1], o.normal_offset);
+        const float *n2 = get_attr(o, idx[2], o.normal_offset);
+        n = vec3(n0[0], n0[1], n0[2]) * w + vec3(n1[0], n1[1], n1[2]) * h.u + vec3(n2[0], n2[1], n2[2]) * h.v;
+      } else {
+        const float *p0 = get_attr(o, idx[0], o.pos_offset);
+        const float *p1 = get_attr(o, idx[1], o.pos_offset);
+        const float *p2 = get_attr(o, idx[2], o.pos_offset);
+        vec3 e1(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]);
+        vec3 e2(p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]);
+        n = e1.cross(e2);
+      }
+      n = (vec4(n, 0) * modelToWorld).xyz().normalize();
+      s.view = -dir.normalize();
+      if (n.dot(s.view) < 0) {
+        n = -n;
+      }
+      s.normal = n;
+
+      vec2 uv(0, 0);
+      if (o.uv_offset >= 0) {
+        const float *uv0 = get_attr(o, idx[0], o.uv_offset);
+        const float *uv1 = get_attr(o, idx[1], o.uv_offset);
+        const float *uv2 = get_attr(o, idx[2], o.uv_offset);
+        uv = vec2(uv0[0] * w + uv1[0] * h.u + uv2[0] * h.v, uv0[1] * w + uv1[1] * h.u + uv2[1] * h.v);
+      }
+
+      material *mat = ctxt.materials[h.instance];
+      s.diffuse = get_texel(mat->get_diffuse(), uv, vec4(0.5f, 0.5f, 0.5f, 1));
+      s.ambient = get_texel(mat->get_ambient(), uv, s.diffuse);
+      s.emission = get_texel(mat->get_emission(), uv, vec4(0, 0, 0, 0));
+      s.specular = get_texel(mat->get_specular(), uv, vec4(0, 0, 0, 0));
+      s.shininess = get_texel(mat->get_shininess(), uv, vec4(30.0f/255, 0, 0, 0))[0] * 255.0f;
+
+      // start shadow rays a little way off the surface so they don't hit it
+      s.pos = origin + dir * h.t;
+      s.shadow_origin = s.pos + n * (1e-4f * h.t * dir.length());
+    }
+
+    // diffuse and specular light from the lights that can see the surface
+    vec3 direct_light(const surface &s) const {
+      vec3 diffuse_light = vec3(0, 0, 0);
+      vec3 specular_light = vec3(0, 0, 0);
+      for (unsigned i = 0; i != lights.size(); ++i) {
+        const light &l = lights[i];
+        float diffuse_factor = s.normal.dot(l.direction);
+        scene_bvh::hit shadow;
+        if (diffuse_factor > 0 && !bvh.any_hit(shadow, s.shadow_origin, l.direction, ctxt.far_plane)) {
+          vec3 half_direction = (l.direction + s.view).normalize();
+          float specular_factor = powf(max(s.normal.dot(half_direction), 0.0f), s.shininess);
+          diffuse_light += l.color * diffuse_factor;
+          specular_light += l.color * specular_factor;
+        }
+      }
+      return diffuse_light * s.diffuse.xyz() + specular_light * s.specular.xyz();
+    }
+
+    // the color of a hit seen along dir from origin
+    vec3 shade(const vec3 &origin, const vec3 &dir, const scene_bvh::hit &h) const {
+      surface s;
+      get_surface(s, origin, dir, h);
+      return s.emission.xyz() + ambient * s.ambient.xyz() + direct_light(s);
+    }
+
+    static uint8_t to_byte(float value) {
+      return (uint8_t)(min(max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    static void trace_tile(void *context, unsigned index) {
+      ((raytracer*)context)->trace_tile(index);
+    }
+
+    void trace_tile(unsigned index) {
+      int tx0 = (index % num_tiles_x) * tile_size;
+      int ty0 = (index / num_tiles_x) * tile_size;
+      int tx1 = min(tx0 + (int)tile_size, ctxt.width);
+      int ty1 = min(ty0 + (int)tile_size, ctxt.height);
+
+      // dir reaches the near plane at t = 1
+      float tmax = ctxt.far_plane / ctxt.near_plane;
+      float xscale = ctxt.near_plane_xmax * 2.0f / ctxt.width;
+      float yscale = ctxt.near_plane_ymax * 2.0f / ctxt.height;
+
+      // camera rays go in packets of packet_width x packet_height pixels
+      ray_packet<packet_width * packet_height> packet;
+      for (int y0 = ty0; y0 < ty1; y0 += packet_height) {
+        for (int x0 = tx0; x0 < tx1; x0 += packet_width) {
+          packet.clear();
+          for (int lane = 0; lane != packet.size; ++lane) {
+            int x = x0 + lane % packet_width, y = y0 + lane / packet_width;
+            if (x < tx1 && y < ty1) {
+              vec3 dir =
+                camera_y * ((y + 0.5f) * yscale - ctxt.near_plane_ymax) - camera_z * ctxt.near_plane +
+                camera_x * ((x + 0.5f) * xscale - ctxt.near_plane_xmax)
+              ;
+              packet.set(lane, eye, dir, tmax);
+            }
+          }
+
+          bvh.closest_hit(packet);
+
+          for (int lane = 0; lane != packet.size; ++lane) {
+            int x = x0 + lane % packet_width, y = y0 + lane / packet_width;
+            if (x >= tx1 || y >= ty1) continue;
+            vec3 color(0, 0, 0);
+            if (packet.instance[lane] != -1) {
+              color = shade(eye, packet.get_dir(lane), get_hit(packet, lane));
+            }
+            uint8_t *dest = &pixels[(y * ctxt.width + x) * 3];
+            for (int j = 0; j != 3; ++j) {
+              dest[j] = to_byte(color[j]);
+            }
+          }
+        }
+      }
+    }
+
+    template <class packet_t> static scene_bvh::hit get_hit(const packet_t &packet, int lane) {
+      scene_bvh::hit h;
+      h.t = packet.t[lane];
+      h.u = packet.u[lane];
+      h.v = packet.v[lane];
+      h.triangle = packet.triangle[lane];
+      h.instance = packet.instance[lane];
+      return h;
+    }
+
+    // xorshift: quick, and good enough for choosing directions
+    static float next_random(unsigned &state) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      return (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // a direction around n, more likely near n (cosine weighted)
+    static vec3 cosine_direction(const vec3 &n, float r1, float r2) {
+      float phi = 6.28318531f * r1;
+      float r = sqrtf(r2);
+      vec3 a = fabsf(n.x()) > 0.5f ? vec3(0, 1, 0) : vec3(1, 0, 0);
+      vec3 b1 = a.cross(n).normalize();
+      vec3 b2 = n.cross(b1);
+      return b1 * (r * cosf(phi)) + b2 * (r * sinf(phi)) + n * sqrtf(1.0f - r2);
+    }
+
+    // follow a path from a camera hit, bouncing off the diffuse color of each surface.
+    // paths that escape see the ambient light, so corners come out darker.
+    vec3 trace_path(const vec3 &origin, const vec3 &dir, const scene_bvh::hit &first_hit, unsigned &rng) const {
+      vec3 color(0, 0, 0);
+      vec3 throughput(1, 1, 1);
+      vec3 ray_origin = origin;
+      vec3 ray_dir = dir;
+      scene_bvh::hit h = first_hit;
+      for (unsigned bounce = 0; ; ++bounce) {
+        surface s;
+        get_surface(s, ray_origin, ray_dir, h);
+        color += throughput * (s.emission.xyz() + direct_light(s));
+        if (bounce == max_bounces) break;
+
+        // the cosines of the surface and the sampling cancel, leaving the diffuse color
+        float r1 = next_random(rng);
+        float r2 = next_random(rng);
+        throughput = throughput * s.diffuse.xyz();
+        ray_origin = s.shadow_origin;
+        ray_dir = cosine_direction(s.normal, r1, r2);
+        if (!bvh.closest_hit(h, ray_origin, ray_dir, ctxt.far_plane)) {
+          color += throughput * ambient;
+          break;
+        }
+      }
+      return color;
+    }
+
+    static void path_trace_tile(void *context, unsigned index) {
+      raytracer *r = (raytracer*)context;
+      r->path_trace_tile(r->first_task_tile + index);
+    }
+
+    // one path for every block x block pixels of a tile. the preview passes use big
+    // blocks and just fill them in. after that every pass adds one sample per pixel.
+    void path_trace_tile(unsigned index) {
+      int tx0 = (index % num_tiles_x) * tile_size;
+      int ty0 = (index / num_tiles_x) * tile_size;
+      int tx1 = min(tx0 + (int)tile_size, ctxt.width);
+      int ty1 = min(ty0 + (int)tile_size, ctxt.height);
+
+      float tmax = ctxt.far_plane / ctxt.near_plane;
+      float xscale = ctxt.near_plane_xmax * 2.0f / ctxt.width;
+      float yscale = ctxt.near_plane_ymax * 2.0f / ctxt.height;
+
+      bool preview = num_passes < num_preview_passes;
+      int block = preview ? preview_block >> num_passes : 1;
+      float inv_samples = preview ? 1.0f : 1.0f / (num_passes - num_preview_passes + 1);
+
+      // different random numbers for every tile and pass, but the same on any number of threads
+      unsigned rng = ((index + 1) * 0x9e3779b9u) ^ ((num_passes + 1) * 0x85ebca6bu);
+      if (rng == 0) rng = 1;
+
+      ray_packet<packet_width * packet_height> packet;
+      for (int y0 = ty0; y0 < ty1; y0 += block * packet_height) {
+        for (int x0 = tx0; x0 < tx1; x0 += block * packet_width) {
+          packet.clear();
+          for (int lane = 0; lane != packet.size; ++lane) {
+            int x = x0 + lane % packet_width * block, y = y0 + lane / packet_width * block;
+            if (x < tx1 && y < ty1) {
+              // the middle of a preview block or somewhere in the pixel
+              float jx = preview ? block * 0.5f : next_random(rng);
+              float jy = preview ? block * 0.5f : next_random(rng);
+              vec3 dir =
+                camera_y * ((y + jy) * yscale - ctxt.near_plane_ymax) - camera_z * ctxt.near_plane +
+                camera_x * ((x + jx) * xscale - ctxt.near_plane_xmax)
+              ;
+              packet.set(lane, eye, dir, tmax);
+            }
+          }
+
+          bvh.closest_hit(packet);
+
+          for (int lane = 0; lane != packet.size; ++lane) {
+            int x = x0 + lane % packet_width * block, y = y0 + lane / packet_width * block;
+            if (x >= tx1 || y >= ty1) continue;
+            vec3 color(0, 0, 0);
+            if (packet.instance[lane] != -1) {
+              color = trace_path(eye, packet.get_dir(lane), get_hit(packet, lane), rng);
+            }
+
+            if (preview) {
+              int bx1 = min(x + block, tx1), by1 = min(y + block, ty1);
+              for (int by = y; by != by1; ++by) {
+                uint8_t *dest = &pixels[(by * ctxt.width + x) * 3];
+                for (int bx = x; bx != bx1; ++bx) {
+                  for (int j = 0; j != 3; ++j) {
+                    *dest++ = to_byte(color[j]);
+                  }
+                }
+              }
+            } else {
+              float *sum = &accum[(y * ctxt.width + x) * 3];
+              uint8_t *dest = &pixels[(y * ctxt.width + x) * 3];
+              for (int j = 0; j != 3; ++j) {
+                sum[j] += color[j];
+                dest[j] = to_byte(sum[j] * inv_samples);
+              }
+            }
+          }
+        }
+      }
+    }
+
+    // set up the tree, objects, lights and camera for this frame
+    void begin_frame(const context &ctxt) {
+      this->ctxt = ctxt;
+      pixels.resize(ctxt.width * ctxt.height * 3);
+
+      bvh.update(ctxt.meshes, ctxt.modelToWorld, ctxt.num_objects);
+      objects.resize(ctxt.num_objects);
+      for (int i = 0; i != ctxt.num_objects; ++i) {
+        add_object(i);
+      }
+      add_lights();
+
+      eye = ctxt.cameraToWorld.w().xyz();
+      camera_x = ctxt.cameraToWorld.x().xyz();
+      camera_y = ctxt.cameraToWorld.y().xyz();
+      camera_z = ctxt.cameraToWorld.z().xyz();
+
+      num_tiles_x = (ctxt.width + tile_size - 1) / tile_size;
+      num_tiles_y = (ctxt.height + tile_size - 1) / tile_size;
+    }
+
+    // copy the image to the texture. with no texture (eg. offline) just keep the pixels.
+    void upload() {
+      if (ctxt.texture_handle) {
+        glBindTexture(GL_TEXTURE_2D, ctxt.texture_handle);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ctxt.width, ctxt.height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+      }
+    }
+
+    static bool same(const vec3 &a, const vec3 &b) {
+      return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
+    }
+
+    // true if the image, camera, objects (including their vertices) or lights differ from last time.
+    // remembers this frame for next time.
+    bool check_changes() {
+      bool changed =
+        ctxt.width != last_width || ctxt.height != last_height ||
+        memcmp(&ctxt.cameraToWorld, &last_cameraToWorld, sizeof(mat4t)) ||
+        last_modelToWorld.size() != (unsigned)ctxt.num_objects ||
+        last_lights.size() != lights.size()
+      ;
+      for (int i = 0; !changed && i != ctxt.num_objects; ++i) {
+        changed =
+          memcmp(&ctxt.modelToWorld[i], &last_modelToWorld[i], sizeof(mat4t)) ||
+          ctxt.meshes[i] != last_meshes[i] || ctxt.materials[i] != last_materials[i] ||
+          get_mesh_state(ctxt.meshes[i]) != last_mesh_states[i]
+        ;
+      }
+      for (unsigned i = 0; !changed && i != lights.size(); ++i) {
+        changed = !same(lights[i].direction, last_lights[i].direction) || !same(lights[i].color, last_lights[i].color);
+      }
+      changed = changed || !same(ambient, last_ambient);
+
+      if (changed) {
+        last_width = ctxt.width;
+        last_height = ctxt.height;
+        last_cameraToWorld = ctxt.cameraToWorld;
+        last_modelToWorld.resize(ctxt.num_objects);
+        last_meshes.resize(ctxt.num_objects);
+        last_materials.resize(ctxt.num_objects);
+        last_mesh_states.resize(ctxt.num_objects);
+        for (int i = 0; i != ctxt.num_objects; ++i) {
+          last_modelToWorld[i] = ctxt.modelToWorld[i];
+          last_meshes[i] = ctxt.meshes[i];
+          last_materials[i] = ctxt.materials[i];
+          last_mesh_states[i] = get_mesh_state(ctxt.meshes[i]);
+        }
+        last_lights.resize(lights.size());
+        for (unsigned i = 0; i != lights.size(); ++i) {
+          last_lights[i] = lights[i];
+        }
+        last_ambient = ambient;
+      }
+      return changed;
+    }
+
+  public:
+    raytracer() {
+      num_tiles_x = num_tiles_y = 0;
+      num_passes = 0;
+      next_tile = 0;
+      first_task_tile = 0;
+      max_bounces = 2;
+      last_width = last_height = 0;
+    }
+
+    void init() {
+    }
+
+    // trace the scene in ctxt and upload the RGB image to ctxt.texture_handle
+    void ray_trace(const context &ctxt) {
+      begin_frame(ctxt);
+      thread_pool::run(trace_tile, this, num_tiles_x * num_tiles_y);
+      upload();
+    }
+
+    // progressive path tracing: add samples for about time_budget seconds, then upload
+    // the image so far. the first passes are low resolution so that something appears
+    // at once. starts again when the camera, objects or lights move.
+    //
+    // offline, set texture_handle to 0 and call this until get_num_samples() is big enough.
+    void path_trace(const context &ctxt, float time_budget) {
+      double start_time = app_utils::get_time();
+      begin_frame(ctxt);
+
+      unsigned size = ctxt.width * ctxt.height * 3;
+      if (check_changes() || accum.size() != size) {
+        accum.resize(size);
+        for (unsigned i = 0; i != size; ++i) {
+          accum[i] = 0;
+        }
+        num_passes = 0;
+        next_tile = 0;
+      }
+
+      // a few tiles per thread at a time until we run out of time
+      unsigned num_tiles = num_tiles_x * num_tiles_y;
+      unsigned batch_size = thread_pool::get_num_threads() * 2;
+      do {
+        unsigned num_tasks = min(batch_size, num_tiles - next_tile);
+        first_task_tile = next_tile;
+        thread_pool::run(path_trace_tile, this, num_tasks);
+        next_tile += num_tasks;
+        if (next_tile == num_tiles) {
+          next_tile = 0;
+          num_passes++;
+        }
+      } while (app_utils::get_time() - start_time < time_budget);
+
+      upload();
+    }
+
+    // start the path traced image again, eg. after changing a material
+    void reset_accumulation() {
+      accum.reset();
+    }
+
+    // samples per pixel in the path traced image so far
+    unsigned get_num_samples() const {
+      return num_passes > num_preview_passes ? num_passes - num_preview_passes : 0;
+    }
+
+    // how many times paths bounce. 0 is just direct light.
+    void set_max_bounces(unsigned value) {
+      max_bounces = value;
+    }
+
+    // the last image traced, bottom row first
+    const uint8_t *get_pixels() const {
+      return pixels.size() ? &pixels[0] : 0;
+    }
+  };
 #endif
+}
@@ -6,6 +6,10 @@
 //
 //
 
+#ifndef WIN32
+  #include <sys/time.h>
+#endif
+
 namespace octet {
   enum atom_t {
     atom_, // null atom
@@ -23,6 +27,20 @@ namespace octet {
       }
       return value;
     }
+
+    // seconds from some time in the past. use differences for timing.
+    static double get_time() {
+      #ifdef WIN32
+        LARGE_INTEGER freq, count;
+        QueryPerformanceFrequency(&freq);
+        QueryPerformanceCounter(&count);
+        return (double)count.QuadPart / (double)freq.QuadPart;
+      #else
+        timeval tv;
+        gettimeofday(&tv, NULL);
+        return tv.tv_sec + tv.tv_usec * 1e-6;
+      #endif
+    }
   
     static void setrgb(dynarray<unsigned char> &buffer, int size, int x, int y, unsigned rgb, unsigned a = 0xff) {
       buffer[(y*size+x)*4+0] = rgb >> 16;
@@ -165,10 +183,16 @@ namespace octet {
       return file;
     }
 
-    static dictionary<atom_t> *get_atom_dict() {
-      static dictionary<atom_t> *dict;
-      if (!dict) dict = new dictionary<atom_t>();
-      return dict;
+    // atoms are indices into this table. the predefined atoms are added first, in order.
+    static string_table<> &get_atom_table() {
+      static string_table<> *table;
+      if (!table) {
+        table = new string_table<>();
+        for (unsigned i = 0; predefined_atom(i); ++i) {
+          table->add(predefined_atom(i));
+        }
+      }
+      return *table;
     }
 
     // get a unique int for a string.
@@ -179,21 +203,16 @@ namespace octet {
         return atom_;
       }
 
-      dictionary<atom_t> *dict = get_atom_dict();
+      return (atom_t)get_atom_table().add(name);
+    }
 
-      static int num_atoms = 0;
-      if (num_atoms == 0) {
-        for (++num_atoms; predefined_atom(num_atoms); num_atoms++) {
-          (*dict)[predefined_atom(num_atoms)] = (atom_t)num_atoms;
-        }
-      }
-      if (dict->contains(name)) {
-        //app_utils::log("old atom %s %d\n", name, (*dict)[name]);
-        return (*dict)[name];
-      } else {
-        //app_utils::log("new atom %s %d\n", name, num_atoms);
-        return (*dict)[name] = (atom_t)num_atoms++;
+    // get an atom for part of a string, eg. a slice.
+    static atom_t get_atom(const char *name, unsigned length) {
+      if (length == 0) {
+        return atom_;
       }
+
+      return (atom_t)get_atom_table().add(name, length);
     }
 
     static const char *predefined_atom(unsigned i) {
@@ -213,18 +232,8 @@ namespace octet {
     }
 
     static const char *get_atom_name(atom_t atom) {
-      const char *name = predefined_atom((unsigned)atom);
-      if (name) return name;
-
-      // slow!
-      dictionary<atom_t> *dict = get_atom_dict();
-      unsigned num_indices = dict->get_num_indices();
-      for (unsigned i = 0; i != num_indices; ++i) {
-        if (dict->get_value(i) == atom) {
-          return dict->get_key(i);
-        }
-      }
-      return "???";
+      string_table<> &table = get_atom_table();
+      return (unsigned)atom < table.size() ? table.get_name((unsigned)atom) : "???";
     }
 
   };
@@ -107,3 +107,6 @@ OCTET_ATOM(font_info)
 #define OCTET_CLASS(X) OCTET_ATOM(X)
 #include "classes.h"
 #undef OCTET_CLASS
+
+// saved files store atoms as numbers, so new atoms go at the end
+OCTET_ATOM(blend_state)
@@ -107,6 +107,16 @@ namespace octet {
       return true;
     }
 
+    // look ahead without reading: values start with their sid, or a type then their sid
+    bool is_next(atom_t sid) {
+      if (get_error()) return false;
+      long pos = ftell(file);
+      atom_t first = read_atom();
+      atom_t second = read_atom();
+      fseek(file, pos, SEEK_SET);
+      return first == sid || second == sid;
+    }
+
     // register a reference after creating a new object
     void add_new_ref(void *ref) {
       id_to_ref.push_back(ref);
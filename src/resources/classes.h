@@ -18,3 +18,4 @@ OCTET_CLASS(param)
 OCTET_CLASS(gl_resource)
 OCTET_CLASS(bitmap_font)
 OCTET_CLASS(mesh_text)
+OCTET_CLASS(skinned_mesh)
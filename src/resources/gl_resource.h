@@ -18,11 +18,15 @@ namespace octet {
     // GL_ARRAY_BUFFER etc.
     GLuint target;
 
+    // changes every time the bytes may have been written (lock() or allocate())
+    mutable unsigned version;
+
   public:
     RESOURCE_META(gl_resource)
 
     gl_resource(unsigned target=0, unsigned size=0) {
       buffer = 0;
+      version = 0;
       this->target = target;
       if (size) {
         allocate(target, size);
@@ -33,16 +37,21 @@ namespace octet {
     void visit(visitor &v) {
       v.visit(bytes, atom_bytes);
       v.visit(target, atom_target);
+      version++;
     }
 
-    // 
-    void allocate(GLuint target, unsigned size) {
+    // usage is GL_DYNAMIC_DRAW for buffers that change often (eg. skinned_mesh)
+    void allocate(GLuint target, unsigned size, GLenum usage=GL_STATIC_DRAW) {
       reset();
-      glGenBuffers(1, &buffer);
-      glBindBuffer(target, buffer);
-      glBufferData(target, size, NULL, GL_STATIC_DRAW);
+      // with no OpenGL we just keep the bytes
+      if (!app_common::is_headless()) {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferData(target, size, NULL, usage);
+      }
       bytes.resize(size);
       this->target = target;
+      version++;
     }
 
     void reset() {
@@ -72,13 +81,22 @@ namespace octet {
     void unlock_read_only() const {
     }
 
+    // for writing. use lock_read_only() to look.
     void *lock() const {
+      version++;
       return (void*)&bytes[0];
     }
 
     void unlock() const {
-      glBindBuffer(target, buffer);
-      glBufferSubData(target, 0, bytes.size(), &bytes[0]);
+      if (buffer != 0) {
+        glBindBuffer(target, buffer);
+        glBufferSubData(target, 0, bytes.size(), &bytes[0]);
+      }
+    }
+
+    // eg. to see if a mesh has been edited since a ray tracer last looked at it
+    unsigned get_version() const {
+      return version;
     }
 
     void bind() const {
@@ -92,10 +110,28 @@ namespace octet {
       unlock();
     }
 
-    void copy(const gl_resource *rhs) {
-      allocate(rhs->get_target(), rhs->get_size());
-      assign(rhs->lock(), 0, rhs->get_size());
-      rhs->unlock();
+    // transform count vec3 points stored at offset with stride bytes between them.
+    void transform_points(unsigned offset, unsigned stride, unsigned count, const mat4t &mat) {
+      if (count == 0) return;
+      assert(offset + stride * (count - 1) + 12 <= get_size());
+      uint8_t *base = (uint8_t*)lock() + offset;
+      transform_batch::points(base, stride, base, stride, count, mat);
+      unlock();
+    }
+
+    // transform count vec3 directions (eg. normals) stored at offset with stride bytes between them.
+    void transform_normals(unsigned offset, unsigned stride, unsigned count, const mat4t &mat) {
+      if (count == 0) return;
+      assert(offset + stride * (count - 1) + 12 <= get_size());
+      uint8_t *base = (uint8_t*)lock() + offset;
+      transform_batch::normals(base, stride, base, stride, count, mat);
+      unlock();
+    }
+
+    void copy(const gl_resource *rhs, GLenum usage=GL_STATIC_DRAW) {
+      allocate(rhs->get_target(), rhs->get_size(), usage);
+      assign((void*)rhs->lock_read_only(), 0, rhs->get_size());
+      rhs->unlock_read_only();
     }
   };
 }
@@ -27,16 +27,58 @@ namespace octet {
       return tmp;
     }
 
-    dynarray<string> &response;
+  public:
+    // the response is only needed until it is sent, so keep it in the frame arena
+    typedef dynarray<char, frame_allocator> response_t;
+
+    // append formatted text to a response
+    static void vappend(response_t &response, const char *fmt, va_list v) {
+      // measure first, then format straight into the response
+      va_list v2;
+      #if defined(_MSC_VER) && _MSC_VER < 1800
+        v2 = v; // no va_copy before VS2013, but va_list is just a pointer there
+      #else
+        va_copy(v2, v);
+      #endif
+      #ifdef WIN32
+        int len = _vscprintf(fmt, v2);
+      #else
+        int len = vsnprintf(0, 0, fmt, v2);
+      #endif
+      va_end(v2);
+      if (len <= 0) return;
+
+      unsigned size = response.size();
+      response.resize(size + len + 1); // room for the terminator
+      #ifdef WIN32
+        _vsnprintf_s(&response[size], len + 1, _TRUNCATE, fmt, v);
+      #else
+        vsnprintf(&response[size], len + 1, fmt, v);
+      #endif
+      response.resize(size + len);
+    }
+
+    static void append(response_t &response, const char *fmt, ...) {
+      va_list v;
+      va_start(v, fmt);
+      vappend(response, fmt, v);
+      va_end(v);
+    }
+
+  private:
+    response_t &response;
     int depth;
     int max_depth;
 
-    string &next() {
-      response.resize(response.size()+1);
-      return response.back();
+    void write(const char *fmt, ...) {
+      va_list v;
+      va_start(v, fmt);
+      vappend(response, fmt, v);
+      va_end(v);
     }
+
   public:
-    http_writer(int depth_, int max_depth_, dynarray<string> &response_) : response(response_) {
+    http_writer(int depth_, int max_depth_, response_t &response_) : response(response_) {
       depth = depth_;
       max_depth = max_depth_;
       response.resize(0);
@@ -44,10 +86,10 @@ namespace octet {
 
     bool begin_ref(void *ref, const char *sid, atom_t type) {
       if (depth == max_depth) {
-        next().format("%*s{ \"data\": \"%s\" },\n", depth*2, "", sid);
+        write("%*s{ \"data\": \"%s\" },\n", depth*2, "", sid);
         return false;
       } else {
-        next().format("%*s{ \"data\": \"%s\", children: [\n", depth*2, "", sid);
+        write("%*s{ \"data\": \"%s\", children: [\n", depth*2, "", sid);
         depth++;
         return true;
       }
@@ -59,10 +101,10 @@ namespace octet {
 
     bool begin_ref(void *ref, int index, atom_t type) {
       if (depth == max_depth) {
-        next().format("%*s{ \"data\": \"%d\",\n", depth*2, "", index);
+        write("%*s{ \"data\": \"%d\",\n", depth*2, "", index);
         return false;
       } else {
-        next().format("%*s{ \"data\": \"%d\", children: [\n", depth*2, "", index);
+        write("%*s{ \"data\": \"%d\", children: [\n", depth*2, "", index);
         depth++;
         return true;
       }
@@ -70,15 +112,15 @@ namespace octet {
 
     void end_ref() {
       depth--;
-      next().format("%*s]},\n", depth*2, "");
+      write("%*s]},\n", depth*2, "");
     }
 
     bool begin_refs(atom_t sid, int &size, bool is_dict) {
       if (depth == max_depth) {
-        next().format("%*s{ \"data\": \"%s\" },\n", depth*2, "", app_utils::get_atom_name(sid));
+        write("%*s{ \"data\": \"%s\" },\n", depth*2, "", app_utils::get_atom_name(sid));
         return false;
       } else {
-        next().format("%*s{ \"data\": \"%s\", children: [\n", depth*2, "", app_utils::get_atom_name(sid));
+        write("%*s{ \"data\": \"%s\", children: [\n", depth*2, "", app_utils::get_atom_name(sid));
         depth++;
         return true;
       }
@@ -86,7 +128,7 @@ namespace octet {
 
     void end_refs(bool is_dict) {
       depth--;
-      next().format("%*s]},\n", depth*2, "");
+      write("%*s]},\n", depth*2, "");
     }
 
     void visit_bin(void *value, size_t size, atom_t sid, atom_t type) {
@@ -109,7 +151,7 @@ namespace octet {
           }
         } break;
       }
-      next().format("%*s{ \"data\": \"%s\", children: [\"%s\"] },\n", depth*2, "", app_utils::get_atom_name(sid), data.c_str());
+      write("%*s{ \"data\": \"%s\", children: [\"%s\"] },\n", depth*2, "", app_utils::get_atom_name(sid), data.c_str());
     }
   };
 }
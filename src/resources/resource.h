@@ -22,13 +22,13 @@ namespace octet {
 
   class resource {
     // how many lives do we have?
-    int ref_count;
+    // build with OCTET_ATOMIC_REF_COUNT=1 to share resources between threads.
+    default_ref_count ref_count;
 
   public:
     // make a new resource with no lives.
     // adding it to a ref<> will give it a life.
     resource() {
-      ref_count = 0;
     }
 
     // factory for making new resources of various kinds
@@ -57,16 +57,21 @@ namespace octet {
 
     // give this resource an extra life
     void add_ref() {
-      ref_count++;
+      ref_count.add_ref();
     }
 
     // remove a life from this resource and delete it if it is dead.
     void release() {
-      if (--ref_count == 0) {
+      if (ref_count.release()) {
         delete this;
       }
     }
 
+    // how many ref<>s point at this resource?
+    int get_ref_count() const {
+      return ref_count.get();
+    }
+
     // use the allocator to allocate this resource and its child classes
     void *operator new (size_t size) {
       return allocator::malloc(size);
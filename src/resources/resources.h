@@ -82,11 +82,8 @@ namespace octet {
       }
       if (name[0] == '#') name++;
 
-      if (!dict.contains(name)) {
-        return NULL;
-      } else {
-        return dict[name];
-      }
+      int index = dict.get_index(name);
+      return index == -1 ? NULL : (resource*)dict.get_value(index);
     }
 
     scene *get_active_scene() const {
@@ -129,12 +126,9 @@ namespace octet {
     void find_all(dynarray<resource*> &result, atom_t type) {
       unsigned num_indices = dict.get_num_indices();
       for (unsigned i = 0; i != num_indices; ++i) {
-        const char *key = dict.get_key(i);
-        if (key) {
-          resource *res = dict.get_value(i);
-          if (res->get_type() == type) {
-            result.push_back(res);
-          }
+        resource *res = dict.get_value(i);
+        if (res && res->get_type() == type) {
+          result.push_back(res);
         }
       }
     }
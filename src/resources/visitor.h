@@ -81,6 +81,10 @@ namespace octet {
     virtual void end_read_dynarray(void *ptr, unsigned bytes) {}
     virtual void add_new_ref(void *ref) {}
     virtual bool begin_agg(void *ref, atom_t sid, atom_t type) { return true; }
+
+    // true if the next value in the file is sid, for fields that older files don't have.
+    // writers always write them.
+    virtual bool is_next(atom_t sid) { return true; }
     virtual void end_agg() {}
 
     void visit(int8_t &value, atom_t sid) {
@@ -6,20 +6,64 @@
 //
 // Animation resource
 //
+// An animation is a set of channels, each of which drives one value (eg. a node's
+// transform) with keys at times in seconds. To save memory, keys are compressed:
+// matrices become a 16 bit quaternion with a quantized translation and scale,
+// other values are 16 bits between the channel's min and max.
+//
+// example:
+//
+//   animation_instance *inst = new animation_instance(anim, target);
+//   ...
+//   // every frame
+//   inst->update(delta_time);
+//
+// The instance keeps a cursor for each channel, so that finding the keys is
+// O(1) when time moves forward.
+//
+// sample() evaluates the channels into a pose array instead of the targets,
+// so that animations can be blended (see animation_mixer).
+//
 
 namespace octet {
   class animation : public resource {
     // todo: this could be a GL/CL buffer
     dynarray<unsigned char> data;
 
+    // how the values of a channel are stored
+    enum {
+      // floats, as they came in
+      format_raw,
+
+      // 16 bits per component between a min and a max
+      format_quantized,
+
+      // matrices as a 16 bit quaternion and 16 bit translation and scale.
+      // only used if every key comes back within transform_tolerance.
+      format_transform,
+    };
+
+    // a quantized transform key: quaternion -32767..32767, translation and scale 0..65535
+    struct transform_key {
+      int16_t rotation[4];
+      uint16_t translation[3];
+      uint16_t scale[3];
+    };
+
+    // more than this times the largest value (or matrix element) and we keep the keys as floats
+    static float transform_tolerance() { return 1.0e-3f; }
+
     /// one channel of an animation
     struct channel {
       atom_t sid;          /// atom for sid on target (eg. node22)
       atom_t sub_target;   /// sub target (eg. rotateX)
       atom_t component;    /// component (eg. ANGLE)
-      int offset;          /// where in data
+      int offset;          /// where in data: num_times float times in seconds
       unsigned num_times;  /// how many time values
-      unsigned component_size; /// number of bytes per component
+      unsigned component_size; /// number of bytes per component (as floats)
+      unsigned format;     /// format_raw etc.
+      int value_offset;    /// where in data: the values, after any min and scale
+      unsigned pose_offset; /// where in a pose (see sample()), in floats
     };
 
     // format and component of channels
@@ -31,18 +75,376 @@ namespace octet {
     dynarray<ref<resource> > targets;
 
     float end_time;
+
+    // saved channels start with these two words (see visit()).
+    // files from before this have plain six word channels and 16 bit millisecond times.
+    enum {
+      channels_magic = 0x4d494e41,  // "ANIM"
+      channels_version = 2,
+    };
+
+    // a channel as it was saved before channels_version 2
+    struct channel_v1 {
+      atom_t sid;
+      atom_t sub_target;
+      atom_t component;
+      int offset;          // where in data: num_times 16 bit times in ms, then the floats
+      unsigned num_times;
+      unsigned component_size;
+    };
+
+    // save the channels after a version header
+    void write_channels(visitor &v) {
+      dynarray<uint32_t> words(2 + channels.size() * sizeof(channel) / sizeof(uint32_t));
+      words[0] = channels_magic;
+      words[1] = channels_version;
+      if (channels.size()) memcpy(&words[2], &channels[0], channels.size() * sizeof(channel));
+      v.visit(words, atom_channels);
+    }
+
+    // load the channels, converting old ones.
+    // old channels are returned in old_channels to be converted when we have the targets.
+    void read_channels(visitor &v, dynarray<channel_v1> &old_channels) {
+      dynarray<uint32_t> words;
+      v.visit(words, atom_channels);
+      channels.reset();
+      if (v.get_error() || words.size() == 0) return;
+
+      if (words.size() >= 2 && words[0] == channels_magic) {
+        unsigned bytes = (words.size() - 2) * sizeof(uint32_t);
+        if (words[1] != channels_version || bytes % sizeof(channel)) {
+          app_utils::log("error: animation channels version %d not supported\n", words[1]);
+          v.set_error(true);
+          return;
+        }
+        channels.resize(bytes / sizeof(channel));
+        if (bytes) memcpy(&channels[0], &words[2], bytes);
+      } else {
+        // (the first word of an old channel is an atom, never channels_magic)
+        unsigned bytes = words.size() * sizeof(uint32_t);
+        if (bytes % sizeof(channel_v1)) {
+          app_utils::log("error: bad animation channels\n");
+          v.set_error(true);
+          return;
+        }
+        old_channels.resize(bytes / sizeof(channel_v1));
+        memcpy(&old_channels[0], &words[0], bytes);
+      }
+    }
+
+    // add the channels of an old file again, which compresses them.
+    // old_data and old_targets are data and targets as loaded.
+    void convert_channels(const dynarray<channel_v1> &old_channels, const dynarray<unsigned char> &old_data, const dynarray<ref<resource> > &old_targets) {
+      dynarray<float> times;
+      dynarray<float> values;
+      for (unsigned i = 0; i != old_channels.size(); ++i) {
+        const channel_v1 &old = old_channels[i];
+        unsigned n = old.component_size / sizeof(float);
+        unsigned values_offset = old.offset + old.num_times * sizeof(uint16_t);
+        if (old.num_times == 0 || values_offset + old.num_times * old.component_size > old_data.size()) continue;
+
+        times.resize(old.num_times);
+        values.resize(old.num_times * n);
+        for (unsigned j = 0; j != old.num_times; ++j) {
+          uint16_t ms;
+          memcpy(&ms, &old_data[old.offset + j * sizeof(uint16_t)], sizeof(ms));
+          times[j] = ms * 0.001f;
+        }
+        if (n) memcpy(&values[0], &old_data[values_offset], old.num_times * old.component_size);
+        add_channel(i < old_targets.size() ? (resource*)old_targets[i] : 0, old.sid, old.sub_target, old.component, times, values);
+      }
+    }
+
+    // add bytes to data, keeping it four byte aligned
+    int alloc_data(unsigned bytes) {
+      int offset = (int)data.size();
+      data.resize(offset + ((bytes + 3) & ~3));
+      return offset;
+    }
+
+    static uint16_t quantize(float value, float min, float inv_scale) {
+      float q = (value - min) * inv_scale + 0.5f;
+      return (uint16_t)(q <= 0 ? 0 : q >= 65535 ? 65535 : q);
+    }
+
+    // find min and scale so that value = min + q * scale for q in 0..65535
+    static void get_range(float *min_scale, const float *values, unsigned count, unsigned stride) {
+      float vmin = 1e37f, vmax = -1e37f;
+      for (unsigned i = 0; i != count; ++i) {
+        vmin = values[i * stride] < vmin ? values[i * stride] : vmin;
+        vmax = values[i * stride] > vmax ? values[i * stride] : vmax;
+      }
+      min_scale[0] = vmin;
+      min_scale[1] = (vmax - vmin) * (1.0f / 65535);
+    }
+
+    // split a collada matrix into rotation, translation and scale.
+    // false if it has a projection or a zero scale.
+    static bool decompose(const float *values, vec4 &rotation, vec3 &translation, vec3 &scale) {
+      mat4t m;
+      m.init_transpose(values);
+      if (m[0][3] != 0 || m[1][3] != 0 || m[2][3] != 0 || m[3][3] != 1) return false;
+      vec3 x = m[0].xyz(), y = m[1].xyz(), z = m[2].xyz();
+      scale = vec3(x.length(), y.length(), z.length());
+      if (scale.x() == 0 || scale.y() == 0 || scale.z() == 0) return false;
+      x = x / scale.x();
+      y = y / scale.y();
+      z = z / scale.z();
+      if (x.cross(y).dot(z) < 0) {
+        // mirrored
+        x = -x;
+        scale = vec3(-scale.x(), scale.y(), scale.z());
+      }
+      mat4t rot(vec4(x, 0), vec4(y, 0), vec4(z, 0), vec4(0, 0, 0, 1));
+      rotation = rot.toQuaternion().normalize();
+      translation = m[3].xyz();
+      return true;
+    }
+
+    static mat4t compose(const vec4 &rotation, const vec3 &translation, const vec3 &scale) {
+      mat4t m = mat4t(quat(rotation));
+      m[0] = m[0] * scale.x();
+      m[1] = m[1] * scale.y();
+      m[2] = m[2] * scale.z();
+      m[3] = vec4(translation, 1);
+      return m;
+    }
+
+    // try to store a matrix channel as transform_keys
+    bool add_transform_values(channel &ch, const float *values) {
+      unsigned num_times = ch.num_times;
+      dynarray<vec4> rotations(num_times);
+      dynarray<vec3> translations(num_times);
+      dynarray<vec3> scales(num_times);
+      for (unsigned i = 0; i != num_times; ++i) {
+        if (!decompose(values + i * 16, rotations[i], translations[i], scales[i])) return false;
+
+        // keep neighbouring quaternions on the same side so that blending takes the short way
+        if (i && rotations[i].dot(rotations[i-1]) < 0) {
+          rotations[i] = -rotations[i];
+        }
+      }
+
+      float ranges[12];
+      for (unsigned j = 0; j != 3; ++j) {
+        get_range(ranges + j * 2, &translations[0][j], num_times, 3);
+        get_range(ranges + 6 + j * 2, &scales[0][j], num_times, 3);
+      }
+
+      dynarray<transform_key> keys(num_times);
+      for (unsigned i = 0; i != num_times; ++i) {
+        transform_key &key = keys[i];
+        for (unsigned j = 0; j != 4; ++j) {
+          key.rotation[j] = (int16_t)floorf(rotations[i][j] * 32767 + 0.5f);
+        }
+        for (unsigned j = 0; j != 3; ++j) {
+          const float *t = ranges + j * 2, *s = ranges + 6 + j * 2;
+          key.translation[j] = quantize(translations[i][j], t[0], t[1] ? 1.0f / t[1] : 0);
+          key.scale[j] = quantize(scales[i][j], s[0], s[1] ? 1.0f / s[1] : 0);
+        }
+
+        // check that we get the matrix back
+        mat4t original;
+        original.init_transpose(values + i * 16);
+        mat4t result = decode_transform(ranges, key);
+        float largest = 1, error = 0;
+        for (unsigned r = 0; r != 4; ++r) {
+          for (unsigned c = 0; c != 4; ++c) {
+            largest = max(largest, fabsf(original[r][c]));
+            error = max(error, fabsf(original[r][c] - result[r][c]));
+          }
+        }
+        if (error > transform_tolerance() * largest) return false;
+      }
+
+      ch.format = format_transform;
+      ch.value_offset = alloc_data(sizeof(ranges) + num_times * sizeof(transform_key));
+      memcpy(&data[ch.value_offset], ranges, sizeof(ranges));
+      memcpy(&data[ch.value_offset + sizeof(ranges)], &keys[0], num_times * sizeof(transform_key));
+      return true;
+    }
+
+    // try to store each component in 16 bits between its min and max
+    bool add_quantized_values(channel &ch, const float *values) {
+      unsigned n = ch.component_size / sizeof(float);
+      unsigned num_times = ch.num_times;
+
+      // infinities and NaNs stay as floats
+      float largest = 1;
+      for (unsigned i = 0; i != num_times * n; ++i) {
+        float size = fabsf(values[i]);
+        if (!(size <= 1e37f)) return false;
+        largest = max(largest, size);
+      }
+      float tolerance = transform_tolerance() * largest;
+
+      dynarray<float> min_scale(n * 2);
+      dynarray<uint16_t> keys(num_times * n);
+      for (unsigned j = 0; j != n; ++j) {
+        get_range(&min_scale[j * 2], values + j, num_times, n);
+      }
+      for (unsigned i = 0; i != num_times; ++i) {
+        for (unsigned j = 0; j != n; ++j) {
+          float value = values[i * n + j];
+          float base = min_scale[j * 2], scale = min_scale[j * 2 + 1];
+          uint16_t key = quantize(value, base, scale ? 1.0f / scale : 0);
+          keys[i * n + j] = key;
+
+          // check that we get the value back
+          if (fabsf(value - (base + key * scale)) > tolerance) return false;
+        }
+      }
+
+      ch.format = format_quantized;
+      ch.value_offset = alloc_data(n * 2 * sizeof(float) + num_times * n * sizeof(uint16_t));
+      memcpy(&data[ch.value_offset], &min_scale[0], n * 2 * sizeof(float));
+      memcpy(&data[ch.value_offset + n * 2 * sizeof(float)], &keys[0], num_times * n * sizeof(uint16_t));
+      return true;
+    }
+
+    static mat4t decode_transform(const float *ranges, const transform_key &key) {
+      vec4 rotation(key.rotation[0], key.rotation[1], key.rotation[2], key.rotation[3]);
+      vec3 translation, scale;
+      for (unsigned j = 0; j != 3; ++j) {
+        translation[j] = ranges[j * 2] + key.translation[j] * ranges[j * 2 + 1];
+        scale[j] = ranges[6 + j * 2] + key.scale[j] * ranges[6 + j * 2 + 1];
+      }
+      return compose(rotation.normalize(), translation, scale);
+    }
+
+    // find a such that times[a] <= time < times[a+1], starting at cursor.
+    // time usually moves forward a little each frame, so this is O(1) most of the time.
+    static unsigned find_key(const float *times, unsigned num_times, float time, unsigned &cursor) {
+      unsigned a = cursor < num_times - 1 ? cursor : 0;
+      if (time < times[a]) {
+        // went backwards (eg. looped): search from the start
+        a = 0;
+      }
+      for (unsigned i = 0; i != 4 && a + 2 < num_times && time >= times[a + 1]; ++i) {
+        a++;
+      }
+      if (a + 2 < num_times && time >= times[a + 1]) {
+        unsigned b = num_times - 1;
+        while (b - a > 1) {
+          unsigned mid = a + ((b - a) >> 1);
+          if (time >= times[mid]) {
+            a = mid;
+          } else {
+            b = mid;
+          }
+        }
+      }
+      cursor = a;
+      return a;
+    }
+
+    // find the keys either side of time and how far we are between them
+    void get_keys(const channel &ch, float time, unsigned &cursor, unsigned &a, unsigned &b, float &t) const {
+      const float *times = (const float*)&data[ch.offset];
+      if (ch.num_times == 1) {
+        a = b = 0;
+        t = 0;
+        return;
+      }
+      a = find_key(times, ch.num_times, time, cursor);
+      b = a + 1;
+      t = (time - times[a]) / (times[b] - times[a]);
+      t = t < 0 ? 0 : t > 1 ? 1 : t;
+    }
+
+    // matrix channels are sampled as rotation, translation and scale if every key
+    // could be split that way (format_transform). others (eg. zero scale, shear) are 16 floats.
+    static bool is_trs(const channel &ch) {
+      return ch.sub_target == atom_transform && ch.format == format_transform;
+    }
+
+    // interpolate a transform channel as a quaternion, translation and scale
+    void eval_trs(const channel &ch, unsigned a, unsigned b, float t, float *trs) const {
+      const float *ranges = (const float*)&data[ch.value_offset];
+      const transform_key *keys = (const transform_key*)(ranges + 12);
+      const transform_key &ka = keys[a], &kb = keys[b];
+      // normalized lerp of the quaternions
+      vec4 rotation;
+      for (unsigned j = 0; j != 4; ++j) {
+        rotation[j] = ka.rotation[j] * (1 - t) + kb.rotation[j] * t;
+      }
+      vec3 translation, scale;
+      for (unsigned j = 0; j != 3; ++j) {
+        float qt = ka.translation[j] * (1 - t) + kb.translation[j] * t;
+        float qs = ka.scale[j] * (1 - t) + kb.scale[j] * t;
+        translation[j] = ranges[j * 2] + qt * ranges[j * 2 + 1];
+        scale[j] = ranges[6 + j * 2] + qs * ranges[6 + j * 2 + 1];
+      }
+      rotation = rotation.normalize();
+      for (unsigned j = 0; j != 4; ++j) trs[j] = rotation[j];
+      for (unsigned j = 0; j != 3; ++j) trs[4 + j] = translation[j];
+      for (unsigned j = 0; j != 3; ++j) trs[7 + j] = scale[j];
+    }
+
+    // interpolate a transform channel
+    mat4t eval_transform(const channel &ch, unsigned a, unsigned b, float t) const {
+      float trs[trs_size];
+      eval_trs(ch, a, b, t, trs);
+      return trs_to_matrix(trs);
+    }
+
+    // interpolate the floats of a channel
+    void eval_floats(const channel &ch, unsigned a, unsigned b, float t, float *result) const {
+      unsigned n = ch.component_size / sizeof(float);
+      if (ch.format == format_transform) {
+        matrix_to_values(eval_transform(ch, a, b, t), result);
+      } else if (ch.format == format_quantized) {
+        const float *min_scale = (const float*)&data[ch.value_offset];
+        const uint16_t *values = (const uint16_t*)(min_scale + n * 2);
+        const uint16_t *va = values + a * n, *vb = values + b * n;
+        for (unsigned j = 0; j != n; ++j) {
+          result[j] = min_scale[j * 2] + (va[j] * (1 - t) + vb[j] * t) * min_scale[j * 2 + 1];
+        }
+      } else {
+        const float *values = (const float*)&data[ch.value_offset];
+        const float *va = values + a * n, *vb = values + b * n;
+        for (unsigned j = 0; j != n; ++j) {
+          result[j] = va[j] * (1 - t) + vb[j] * t;
+        }
+      }
+    }
   public:
     RESOURCE_META(animation)
+
+    // floats in a sampled matrix: quaternion, translation, scale
+    enum { trs_size = 10 };
   
     animation() {
       end_time = 0;
     }
 
+    // the channels are saved with a version (see channels_version).
+    // animations saved before that are converted as they load.
     void visit(visitor &v) {
       v.visit(data, atom_data);
-      v.visit(channels, atom_channels);
+      dynarray<channel_v1> old_channels;
+      if (v.is_reader()) {
+        read_channels(v, old_channels);
+      } else {
+        write_channels(v);
+      }
       v.visit(targets, atom_targets);
       v.visit(end_time, atom_end_time);
+
+      if (old_channels.size() && !v.get_error()) {
+        dynarray<unsigned char> old_data;
+        dynarray<ref<resource> > old_targets;
+        old_data.resize(data.size());
+        if (data.size()) memcpy(&old_data[0], &data[0], data.size());
+        old_targets.resize(targets.size());
+        for (unsigned i = 0; i != targets.size(); ++i) old_targets[i] = targets[i];
+        data.reset();
+        targets.reset();
+        float old_end_time = end_time;
+        end_time = 0;
+        convert_channels(old_channels, old_data, old_targets);
+        end_time = old_end_time > end_time ? old_end_time : end_time;
+      }
     }
 
     int get_num_channels() const {
@@ -69,11 +471,55 @@ namespace octet {
       return end_time;
     }
 
-    // just store the floats in the channel for now.
-    // todo: optimise animation data
+    // number of floats in a pose from sample()
+    unsigned get_pose_size() const {
+      if (channels.size() == 0) return 0;
+      return channels.back().pose_offset + get_pose_channel_size((int)channels.size() - 1);
+    }
+
+    // where a channel's values are in a pose
+    unsigned get_pose_offset(int ch) const {
+      return channels[ch].pose_offset;
+    }
+
+    // number of floats a channel has in a pose
+    unsigned get_pose_channel_size(int ch) const {
+      return is_trs(channels[ch]) ? (unsigned)trs_size : channels[ch].component_size / sizeof(float);
+    }
+
+    // true if a channel is sampled as a quaternion, translation and scale (trs_size floats).
+    // matrix channels with a key that has no such split (eg. zero scale) are sampled as 16 floats.
+    bool is_trs_channel(int ch) const {
+      return is_trs(channels[ch]);
+    }
+
+    // matrix from a sampled quaternion, translation and scale
+    static mat4t trs_to_matrix(const float *trs) {
+      vec4 rotation(trs[0], trs[1], trs[2], trs[3]);
+      return compose(rotation, vec3(trs[4], trs[5], trs[6]), vec3(trs[7], trs[8], trs[9]));
+    }
+
+    // collada (transposed) matrix values for set_value
+    static void matrix_to_values(const mat4t &m, float *value) {
+      for (unsigned r = 0; r != 4; ++r) {
+        for (unsigned c = 0; c != 4; ++c) {
+          value[r * 4 + c] = m[c][r];
+        }
+      }
+    }
+
+    // bytes used by the keys and values of all the channels
+    unsigned get_data_size() const {
+      return data.size();
+    }
+
+    // times are in seconds. matrices (16 values per key) are stored as quaternions,
+    // translations and scales if that is accurate enough. other values are quantized to 16 bits,
+    // again only if they come back within transform_tolerance.
     void add_channel(resource *target, atom_t sid, atom_t sub_target, atom_t component, dynarray<float> &times, dynarray<float> &values) {
       int num_times = (int)times.size();
       int num_values = (int)values.size();
+      if (num_times == 0) return;
       int component_size = (num_values / num_times) * sizeof(float);
 
       channel ch;
@@ -82,64 +528,88 @@ namespace octet {
       ch.sub_target = sub_target;
       ch.component = component;
       ch.component_size = component_size;
+      ch.pose_offset = get_pose_size();
 
-      int offset = ch.offset = (int)data.size();
-      int bytes = num_times * sizeof(unsigned short) + component_size * num_times;
-      data.resize(ch.offset + bytes);
+      ch.offset = alloc_data(num_times * sizeof(float));
+      memcpy(&data[ch.offset], &times[0], num_times * sizeof(float));
       end_time = times[num_times-1] > end_time ? times[num_times-1] : end_time;
-      for (int i = 0; i != num_times; ++i) {
-        unsigned short it = (unsigned short)( times[i] * 1000 );
-        *((unsigned short*)&data[offset]) = it;
-        offset += sizeof(unsigned short);
+
+      unsigned n = component_size / sizeof(float);
+      if (n == 16 && add_transform_values(ch, &values[0])) {
+        // format_transform
+      } else if (n != 0 && n <= 16 && add_quantized_values(ch, &values[0])) {
+        // format_quantized
+      } else {
+        ch.format = format_raw;
+        ch.value_offset = alloc_data(component_size * num_times);
+        memcpy(&data[ch.value_offset], &values[0], component_size * num_times);
       }
-      
-      memcpy(&data[offset], &values[0], component_size * num_times);
+
       channels.push_back(ch);
       targets.push_back(target);
     }
 
-    // evaluate one channel at one time - very inefficient.
-    // time is in ms.
-    void eval_chan(int chan, float time, resource *target) const {
-      int time_ms = int(time * 1000);
-      const channel &ch = channels[chan];
-      unsigned short *p = (unsigned short *)&data[ch.offset];
-      unsigned a = 0;
-      unsigned b = ch.num_times - 1;
-      unsigned component_size = ch.component_size;
-      //app_utils::log("ec %f %d\n", time, time_ms);
-
-      if (time_ms < p[0]) {
-        time_ms = p[0];
-      } else if (time_ms >= p[b]) {
-        time_ms = p[b];
-        a = b - 1;
-      } else {
-        while (b - a > 1) {
-          unsigned mid = a + ((b - a) >> 1);
-          if (time_ms > p[mid]) {
-            a = mid;
-          } else {
-            b = mid;
-          }
-        }
-      }
+    // evaluate every channel at one time and send the values to the targets,
+    // or to target if it is not null.
+    // cursors (one per channel, start at zero) remember which keys we used last time.
+    void eval(float time, unsigned *cursors, resource *target) const {
+      resource *cur_target = 0;
+      scene_node *node = 0;
+      float value[16];
+      for (unsigned chan = 0; chan != channels.size(); ++chan) {
+        const channel &ch = channels[chan];
+        resource *chan_target = target ? target : (resource*)targets[chan];
+        if (!chan_target) continue;
 
-      //app_utils::log("t=%d a=%d b=%d p[a]=%d p[b]=%d\n", time_ms, a, b, p[a], p[b]);
+        // channels for the same target are usually together, so only cast when it changes
+        if (chan_target != cur_target) {
+          cur_target = chan_target;
+          node = chan_target->get_scene_node();
+        }
 
-      unsigned data_offset = ch.offset + ch.num_times * sizeof(unsigned short);
+        unsigned a, b;
+        float t;
+        get_keys(ch, time, cursors[chan], a, b, t);
+        if (node && ch.format == format_transform && ch.sub_target == atom_transform) {
+          // straight to the node, without going through floats
+          node->access_nodeToParent() = eval_transform(ch, a, b, t);
+        } else if (ch.component_size <= sizeof(value)) {
+          eval_floats(ch, a, b, t, value);
+          chan_target->set_value(ch.sid, ch.sub_target, ch.component, value);
+        }
+      }
+    }
 
-      float t = float(time_ms - p[a]) / (p[b] - p[a]);
-      float tmp1[16];
-      float tmp2[16];
-      if (component_size <= sizeof(tmp1)) {
-        memcpy(tmp1, &data[data_offset + a * component_size], component_size);
-        memcpy(tmp2, &data[data_offset + b * component_size], component_size);
-        for (int i = 0; i != component_size/4; ++i) {
-          tmp1[i] = tmp1[i] * (1-t) + tmp2[i] * t;
+    // sample every channel at one time into pose (get_pose_size() floats), without touching the targets.
+    // matrices are sampled as a quaternion, translation and scale so that poses can be blended,
+    // except for channels with keys that can't be split up, which stay as 16 floats (see is_trs_channel()).
+    // this only reads the animation, so many instances can sample it at once.
+    void sample(float time, unsigned *cursors, float *pose) const {
+      for (unsigned chan = 0; chan != channels.size(); ++chan) {
+        const channel &ch = channels[chan];
+        unsigned a, b;
+        float t;
+        get_keys(ch, time, cursors[chan], a, b, t);
+        float *dest = pose + ch.pose_offset;
+        if (is_trs(ch)) {
+          eval_trs(ch, a, b, t, dest);
+        } else {
+          eval_floats(ch, a, b, t, dest);
         }
-        //app_utils::log("  t=%f %f %f %f\n", t, tmp1[0], tmp1[1], tmp1[2]);
-        target->set_value(ch.sid, ch.sub_target, ch.component, tmp1);
+      }
+    }
+
+    // evaluate one channel at one time.
+    // time is in seconds. use eval() for a whole animation.
+    void eval_chan(int chan, float time, resource *target) const {
+      const channel &ch = channels[chan];
+      unsigned cursor = 0, a, b;
+      float t;
+      get_keys(ch, time, cursor, a, b, t);
+      float value[16];
+      if (ch.component_size <= sizeof(value)) {
+        eval_floats(ch, a, b, t, value);
+        target->set_value(ch.sid, ch.sub_target, ch.component, value);
       }
     }
   };
@@ -14,6 +14,61 @@ namespace octet {
     float time;
     bool is_looping;
     bool is_paused;
+
+    // how much this instance counts when blended with others on the same targets
+    float weight;
+
+    // additive instances add their change from the first frame on top of the others
+    bool is_additive;
+
+    // weight moves towards fade_weight at fade_speed per second
+    float fade_weight;
+    float fade_speed;
+
+    // key we used last time for each channel
+    dynarray<unsigned> cursors;
+
+    // values of the channels at the current time, from sample()
+    dynarray<float> pose;
+
+    // values at time zero, for additive instances
+    dynarray<float> reference;
+
+    void reset_cursors() {
+      unsigned num_channels = (unsigned)anim->get_num_channels();
+      if (cursors.size() != num_channels) {
+        cursors.resize(num_channels);
+        for (unsigned i = 0; i != num_channels; ++i) {
+          cursors[i] = 0;
+        }
+      }
+    }
+
+    enum { blend_state_version = 1 };
+
+    // weight and is_additive, saved after a version word.
+    // files from before blending don't have them and keep the defaults.
+    void visit_blend_state(visitor &v) {
+      if (v.is_reader() && !v.is_next(atom_blend_state)) return;
+
+      dynarray<uint32_t> words(3);
+      words[0] = blend_state_version;
+      memcpy(&words[1], &weight, sizeof(weight));
+      words[2] = is_additive;
+      v.visit(words, atom_blend_state);
+
+      if (v.is_reader() && !v.get_error()) {
+        if (words.size() != 3 || words[0] != blend_state_version) {
+          app_utils::log("error: animation_instance blend state version not supported\n");
+          v.set_error(true);
+          return;
+        }
+        memcpy(&weight, &words[1], sizeof(weight));
+        is_additive = words[2] != 0;
+        fade_weight = weight;
+        fade_speed = 0;
+      }
+    }
   public:
     RESOURCE_META(animation_instance)
 
@@ -23,6 +78,10 @@ namespace octet {
       this->time = 0;
       this->is_looping = is_looping;
       this->is_paused = false;
+      this->weight = 1;
+      this->is_additive = false;
+      this->fade_weight = 1;
+      this->fade_speed = 0;
     }
 
     void visit(visitor &v) {
@@ -31,25 +90,86 @@ namespace octet {
       v.visit(time, atom_time);
       v.visit(is_looping, atom_is_looping);
       v.visit(is_paused, atom_is_paused);
+      visit_blend_state(v);
     }
 
     const animation *get_anim() const {
       return anim;
     }
 
+    // if not null, all the channels go to this target instead of the animation's own targets
+    resource *get_target() const {
+      return target;
+    }
+
     float get_time() const {
       return time;
     }
 
-    void update(float delta_time) {
-      if (target) {
-        for (int ch = 0; ch != anim->get_num_channels(); ++ch) {
-          anim->eval_chan(ch, time, target);
+    float get_weight() const {
+      return weight;
+    }
+
+    void set_weight(float value) {
+      weight = fade_weight = value;
+      fade_speed = 0;
+    }
+
+    // change the weight smoothly to new_weight over duration seconds.
+    // eg. to crossfade, fade the old instance to 0 and a new one (with weight 0) to 1.
+    void fade(float new_weight, float duration) {
+      fade_weight = new_weight;
+      fade_speed = duration > 0 ? fabsf(new_weight - weight) / duration : 0;
+      if (fade_speed == 0) weight = new_weight;
+    }
+
+    bool get_is_additive() const {
+      return is_additive;
+    }
+
+    void set_is_additive(bool value) {
+      is_additive = value;
+    }
+
+    // evaluate the channels into get_pose() without changing the targets (see animation_mixer).
+    // each instance has its own pose and cursors, so instances can be sampled in parallel.
+    void sample() {
+      reset_cursors();
+      unsigned pose_size = anim->get_pose_size();
+      pose.resize(pose_size);
+      if (pose_size == 0) return;
+
+      if (is_additive && reference.size() != pose_size) {
+        dynarray<unsigned> first_cursors(cursors.size());
+        for (unsigned i = 0; i != first_cursors.size(); ++i) {
+          first_cursors[i] = 0;
         }
-      } else {
-        for (int ch = 0; ch != anim->get_num_channels(); ++ch) {
-          resource *anim_target = anim->get_target(ch);
-          anim->eval_chan(ch, time, anim_target);
+        reference.resize(pose_size);
+        anim->sample(0, first_cursors.size() ? &first_cursors[0] : 0, &reference[0]);
+      }
+
+      anim->sample(time, cursors.size() ? &cursors[0] : 0, &pose[0]);
+    }
+
+    // values from the last sample(), laid out as in animation::get_pose_offset()
+    const float *get_pose() const {
+      return pose.size() ? &pose[0] : 0;
+    }
+
+    // values at time zero (only for additive instances)
+    const float *get_reference_pose() const {
+      return reference.size() ? &reference[0] : 0;
+    }
+
+    // move the time and weight on
+    void advance(float delta_time) {
+      if (fade_speed != 0) {
+        float step = fade_speed * delta_time;
+        if (fabsf(fade_weight - weight) <= step) {
+          weight = fade_weight;
+          fade_speed = 0;
+        } else {
+          weight += weight < fade_weight ? step : -step;
         }
       }
 
@@ -66,5 +186,15 @@ namespace octet {
         }
       }
     }
+
+    // write the channels straight to the targets and move on.
+    // this ignores the weight; use an animation_mixer to blend instances.
+    void update(float delta_time) {
+      reset_cursors();
+      if (cursors.size()) {
+        anim->eval(time, &cursors[0], target);
+      }
+      advance(delta_time);
+    }
   };
 }
@@ -0,0 +1,357 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Blends animation instances that drive the same targets
+//
+// Each instance samples its animation into its own pose array, then the poses are
+// blended by weight into one value for each target (eg. each node's transform)
+// and the targets are written once. Matrices blend as quaternions, translations
+// and scales. If any animation has a matrix key that can't be split that way
+// (eg. a zero scale or a shear), that target blends the 16 matrix values instead.
+//
+// example:
+//
+//   animation_mixer mixer;
+//   ...
+//   walk->fade(0, 0.5f);   // crossfade from walking...
+//   run->fade(1, 0.5f);    // ...to running over half a second
+//   ...
+//   // every frame
+//   mixer.update(instances, delta_time);
+//
+// Instances are normal or additive (set_is_additive()). Normal instances are
+// averaged by weight. Additive ones then add their change from their first frame,
+// scaled by their weight, eg. a breathing layer on top of a walk.
+//
+// The scene does this for all its animation instances. Sampling runs on the
+// thread_pool when there are many instances.
+//
+
+namespace octet {
+  class animation_mixer {
+    enum {
+      // fewer instances than this are sampled on one thread
+      min_parallel_instances = 8,
+    };
+
+    // one value driven by the animations, eg. the transform of a node
+    struct slot {
+      resource *target;
+      atom_t sid;
+      atom_t sub_target;
+      atom_t component;
+      unsigned offset;    // where in blend
+      unsigned size;      // number of floats
+      bool is_trs;        // quaternion, translation and scale, or 16 matrix values (see animation::sample())
+      int next;           // next slot with the same target, or -1
+      float weight;       // total weight of the normal instances this frame
+    };
+
+    dynarray<slot> slots;
+
+    // first slot for each target plus one (hash_map values start at zero)
+    hash_map<resource*, int> target_slots;
+
+    // slot for each channel of each instance (-1 if there is no target),
+    // instance i's channels start at instance_start[i]
+    dynarray<int> channel_slots;
+    dynarray<unsigned> instance_start;
+
+    // what the slots were made for
+    dynarray<animation_instance*> bound_instances;
+    dynarray<const animation*> bound_anims;
+    dynarray<unsigned> bound_num_channels;
+
+    // blended values of all the slots
+    dynarray<float> blend;
+
+    // instances with some weight this frame
+    dynarray<animation_instance*> active;
+
+    // instances being sampled in parallel
+    animation_instance **sample_instances;
+
+    // for update() with an array of refs
+    dynarray<animation_instance*> instance_ptrs;
+
+    animation_mixer(const animation_mixer &rhs) {
+      // you can't do this!
+    }
+
+    static void sample_batch(void *context, unsigned index) {
+      animation_mixer *m = (animation_mixer*)context;
+      m->sample_instances[index]->sample();
+    }
+
+    // find or make the slot for a channel. offsets are set when all the slots are known.
+    int find_slot(resource *target, atom_t sid, atom_t sub_target, atom_t component, unsigned size, bool is_trs) {
+      int &first = target_slots[target];
+      int last = -1;
+      for (int i = first - 1; i != -1; i = slots[i].next) {
+        slot &s = slots[i];
+        if (s.sid == sid && s.sub_target == sub_target && s.component == component) {
+          if (s.is_trs != is_trs) {
+            // one of the animations has matrices that don't split: blend them all as matrices
+            if ((is_trs ? s.size : size) != 16) return -1;
+            s.is_trs = false;
+            s.size = 16;
+            return i;
+          }
+          return s.size == size ? i : -1;
+        }
+        last = i;
+      }
+
+      slot s;
+      s.target = target;
+      s.sid = sid;
+      s.sub_target = sub_target;
+      s.component = component;
+      s.offset = 0;
+      s.size = size;
+      s.is_trs = is_trs;
+      s.next = -1;
+      s.weight = 0;
+      int index = (int)slots.size();
+      slots.push_back(s);
+      if (last == -1) {
+        first = index + 1;
+      } else {
+        slots[last].next = index;
+      }
+      return index;
+    }
+
+    bool is_bound(animation_instance **instances, unsigned num_instances) const {
+      if (bound_instances.size() != num_instances) return false;
+      for (unsigned i = 0; i != num_instances; ++i) {
+        const animation *anim = instances[i]->get_anim();
+        if (bound_instances[i] != instances[i] || bound_anims[i] != anim) return false;
+        if (bound_num_channels[i] != (unsigned)anim->get_num_channels()) return false;
+      }
+      return true;
+    }
+
+    // find the slot for every channel of every instance
+    void bind(animation_instance **instances, unsigned num_instances) {
+      slots.reset();
+      target_slots.clear();
+      channel_slots.reset();
+      instance_start.reset();
+      bound_instances.reset();
+      bound_anims.reset();
+      bound_num_channels.reset();
+      blend.reset();
+
+      for (unsigned i = 0; i != num_instances; ++i) {
+        animation_instance *inst = instances[i];
+        const animation *anim = inst->get_anim();
+        instance_start.push_back(channel_slots.size());
+        bound_instances.push_back(inst);
+        bound_anims.push_back(anim);
+        bound_num_channels.push_back((unsigned)anim->get_num_channels());
+        for (int ch = 0; ch != anim->get_num_channels(); ++ch) {
+          resource *target = inst->get_target() ? inst->get_target() : anim->get_target(ch);
+          int index = -1;
+          if (target) {
+            unsigned size = anim->get_pose_channel_size(ch);
+            index = find_slot(target, anim->get_sid(ch), anim->get_sub_target(ch), anim->get_component(ch), size, anim->is_trs_channel(ch));
+          }
+          channel_slots.push_back(index);
+        }
+      }
+
+      for (unsigned i = 0; i != slots.size(); ++i) {
+        slots[i].offset = blend.size();
+        blend.resize(blend.size() + slots[i].size);
+      }
+    }
+
+    // a channel's values in the form of its slot: trs poses become matrix values in matrix slots
+    static const float *get_src(const animation *anim, int ch, const float *pose, const slot &s, float *tmp) {
+      const float *src = pose + anim->get_pose_offset(ch);
+      if (s.is_trs || !anim->is_trs_channel(ch)) return src;
+      animation::matrix_to_values(animation::trs_to_matrix(src), tmp);
+      return tmp;
+    }
+
+    // weighted sum of one normal instance
+    void add_pose(animation_instance *inst, unsigned start) {
+      const animation *anim = inst->get_anim();
+      const float *pose = inst->get_pose();
+      float weight = inst->get_weight();
+      float tmp[16];
+      for (int ch = 0; ch != anim->get_num_channels(); ++ch) {
+        int index = channel_slots[start + ch];
+        if (index == -1) continue;
+        slot &s = slots[index];
+        const float *src = get_src(anim, ch, pose, s, tmp);
+        float *dest = &blend[s.offset];
+        float w = weight;
+        if (s.weight == 0) {
+          for (unsigned j = 0; j != s.size; ++j) dest[j] = src[j] * w;
+        } else {
+          // blend the quaternions the short way round
+          if (s.is_trs && dest[0] * src[0] + dest[1] * src[1] + dest[2] * src[2] + dest[3] * src[3] < 0) {
+            for (unsigned j = 0; j != 4; ++j) dest[j] -= src[j] * w;
+            for (unsigned j = 4; j != s.size; ++j) dest[j] += src[j] * w;
+          } else {
+            for (unsigned j = 0; j != s.size; ++j) dest[j] += src[j] * w;
+          }
+        }
+        s.weight += w;
+      }
+    }
+
+    // change of an additive instance since its first frame, on top of the normal ones
+    void add_additive_pose(animation_instance *inst, unsigned start) {
+      const animation *anim = inst->get_anim();
+      const float *pose = inst->get_pose();
+      const float *ref_pose = inst->get_reference_pose();
+      float w = inst->get_weight();
+      float tmp[16], ref_tmp[16];
+      for (int ch = 0; ch != anim->get_num_channels(); ++ch) {
+        int index = channel_slots[start + ch];
+        if (index == -1) continue;
+        slot &s = slots[index];
+
+        // nothing to add to
+        if (s.weight == 0) continue;
+
+        const float *src = get_src(anim, ch, pose, s, tmp);
+        const float *ref_src = get_src(anim, ch, ref_pose, s, ref_tmp);
+        float *dest = &blend[s.offset];
+        if (s.is_trs) {
+          // rotation from the reference to now, scaled by the weight
+          quat delta = quat(vec4(src[0], src[1], src[2], src[3])) * quat(vec4(ref_src[0], ref_src[1], ref_src[2], ref_src[3])).conjugate();
+          if (delta[3] < 0) delta = quat(-delta);
+          quat rotation = quat((vec4(0, 0, 0, 1) * (1 - w) + delta * w).normalize()) * quat(vec4(dest[0], dest[1], dest[2], dest[3]));
+          for (unsigned j = 0; j != 4; ++j) dest[j] = rotation[j];
+          for (unsigned j = 4; j != 7; ++j) dest[j] += (src[j] - ref_src[j]) * w;
+          for (unsigned j = 7; j != 10; ++j) {
+            if (ref_src[j] != 0) dest[j] *= 1 + (src[j] / ref_src[j] - 1) * w;
+          }
+        } else {
+          for (unsigned j = 0; j != s.size; ++j) dest[j] += (src[j] - ref_src[j]) * w;
+        }
+      }
+    }
+
+    // divide by the total weight
+    void normalize_slots() {
+      for (unsigned i = 0; i != slots.size(); ++i) {
+        slot &s = slots[i];
+        if (s.weight == 0) continue;
+        float *dest = &blend[s.offset];
+        if (s.is_trs) {
+          vec4 rotation = vec4(dest[0], dest[1], dest[2], dest[3]);
+          float len2 = rotation.squared();
+          rotation = len2 > 0 ? rotation * (1.0f / sqrtf(len2)) : vec4(0, 0, 0, 1);
+          for (unsigned j = 0; j != 4; ++j) dest[j] = rotation[j];
+          for (unsigned j = 4; j != s.size; ++j) dest[j] /= s.weight;
+        } else {
+          for (unsigned j = 0; j != s.size; ++j) dest[j] /= s.weight;
+        }
+      }
+    }
+
+    // write each blended value to its target
+    void apply() {
+      resource *cur_target = 0;
+      scene_node *node = 0;
+      float value[16];
+      for (unsigned i = 0; i != slots.size(); ++i) {
+        const slot &s = slots[i];
+        if (s.weight == 0) continue;
+        if (s.target != cur_target) {
+          cur_target = s.target;
+          node = s.target->get_scene_node();
+        }
+        const float *src = &blend[s.offset];
+        if (s.is_trs) {
+          mat4t m = animation::trs_to_matrix(src);
+          if (node) {
+            node->access_nodeToParent() = m;
+          } else {
+            animation::matrix_to_values(m, value);
+            s.target->set_value(s.sid, s.sub_target, s.component, value);
+          }
+        } else if (s.size <= 16) {
+          memcpy(value, src, s.size * sizeof(float));
+          s.target->set_value(s.sid, s.sub_target, s.component, value);
+        }
+      }
+    }
+  public:
+    animation_mixer() {
+      sample_instances = 0;
+    }
+
+    // sample, blend and apply all the instances, then move them on by delta_time.
+    void update(animation_instance **instances, unsigned num_instances, float delta_time) {
+      if (!is_bound(instances, num_instances)) {
+        bind(instances, num_instances);
+      }
+
+      // sample the poses. instances with no weight are skipped.
+      active.resize(0);
+      for (unsigned i = 0; i != num_instances; ++i) {
+        if (instances[i]->get_weight() != 0) {
+          active.push_back(instances[i]);
+        }
+      }
+      if (thread_pool::get_num_threads() > 1 && active.size() >= min_parallel_instances) {
+        sample_instances = &active[0];
+        thread_pool::run(sample_batch, this, active.size());
+        sample_instances = 0;
+      } else {
+        for (unsigned i = 0; i != active.size(); ++i) {
+          active[i]->sample();
+        }
+      }
+
+      for (unsigned i = 0; i != slots.size(); ++i) {
+        slots[i].weight = 0;
+      }
+
+      for (unsigned i = 0; i != num_instances; ++i) {
+        animation_instance *inst = instances[i];
+        if (inst->get_weight() != 0 && !inst->get_is_additive()) {
+          add_pose(inst, instance_start[i]);
+        }
+      }
+
+      normalize_slots();
+
+      for (unsigned i = 0; i != num_instances; ++i) {
+        animation_instance *inst = instances[i];
+        if (inst->get_weight() != 0 && inst->get_is_additive()) {
+          add_additive_pose(inst, instance_start[i]);
+        }
+      }
+
+      apply();
+
+      for (unsigned i = 0; i != num_instances; ++i) {
+        instances[i]->advance(delta_time);
+      }
+    }
+
+    // same, for an array of refs (eg. the scene's)
+    void update(dynarray<ref<animation_instance> > &instances, float delta_time) {
+      instance_ptrs.resize(instances.size());
+      for (unsigned i = 0; i != instances.size(); ++i) {
+        instance_ptrs[i] = instances[i];
+      }
+      update(instance_ptrs.size() ? &instance_ptrs[0] : 0, instance_ptrs.size(), delta_time);
+    }
+
+    // number of values the instances drive
+    unsigned get_num_slots() const {
+      return slots.size();
+    }
+  };
+}
@@ -0,0 +1,322 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Build bounding volume hierarchies from boxes
+//
+// This is shared by mesh_bvh (boxes around triangles) and scene_bvh (boxes around mesh instances).
+// The tree is built with the surface area heuristic (SAH): we try sixteen
+// split planes along the longest axis and keep the one that makes the cheapest tree.
+//
+// example:
+//
+//   dynarray<bvh_builder::bounds> boxes;
+//   ... one box per thing ...
+//   dynarray<bvh_builder::node> nodes;
+//   dynarray<unsigned> order;
+//   bvh_builder builder;
+//   builder.build(nodes, order, &boxes[0], boxes.size(), 4);
+//
+// The nodes are 32 bytes each in one array with the two children of a node next to
+// each other. Leaves refer to runs of "order", which holds the index of each box.
+//
+
+namespace octet {
+  class bvh_builder {
+  public:
+    // interior nodes have count == 0 and their children at first and first+1.
+    // leaves have count items starting at first.
+    struct node {
+      float min[3];
+      unsigned first;
+      float max[3];
+      unsigned count;
+    };
+
+    // bounds of some things
+    struct bounds {
+      vec3 min;
+      vec3 max;
+
+      void clear() {
+        min = vec3(1e37f, 1e37f, 1e37f);
+        max = vec3(-1e37f, -1e37f, -1e37f);
+      }
+
+      void grow(const vec3 &p) {
+        min = octet::min(min, p);
+        max = octet::max(max, p);
+      }
+
+      void grow(const bounds &b) {
+        min = octet::min(min, b.min);
+        max = octet::max(max, b.max);
+      }
+
+      // half the surface area (the SAH only needs ratios)
+      float area() const {
+        vec3 d = max - min;
+        return d.x() < 0 ? 0 : d.x() * d.y() + d.y() * d.z() + d.z() * d.x();
+      }
+    };
+
+    enum { max_depth = 64 };
+
+  private:
+    enum {
+      num_bins = 16,
+
+      // subtrees smaller than this are built on one thread
+      min_parallel_items = 4096,
+    };
+
+    // a subtree waiting to be built on a worker thread
+    struct job {
+      unsigned node_index;
+      unsigned begin;
+      unsigned end;
+      unsigned depth;
+      dynarray<node> nodes;
+    };
+
+    // used while building
+    const bounds *item_bounds;
+    dynarray<vec3> centroids;
+    unsigned *order;
+    unsigned max_leaf_size;
+    dynarray<job*> jobs;
+
+    // choose a split for order[begin..end) and partition it. return the split point or begin for a leaf.
+    unsigned split(bounds &node_bounds, unsigned begin, unsigned end) {
+      bounds cb;
+      node_bounds.clear();
+      cb.clear();
+      for (unsigned i = begin; i != end; ++i) {
+        node_bounds.grow(item_bounds[order[i]]);
+        cb.grow(centroids[order[i]]);
+      }
+
+      unsigned count = end - begin;
+      if (count <= 1) return begin;
+
+      vec3 extent = cb.max - cb.min;
+      int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+      if (extent[axis] <= 0) {
+        // all the centroids are in the same place, so we can only split by count.
+        return count <= max_leaf_size ? begin : begin + count / 2;
+      }
+
+      // put the items into bins by centroid
+      bounds bin_bounds[num_bins];
+      unsigned bin_count[num_bins];
+      for (int b = 0; b != num_bins; ++b) {
+        bin_bounds[b].clear();
+        bin_count[b] = 0;
+      }
+      float scale = num_bins * 0.9999f / extent[axis];
+      float base = cb.min[axis];
+      for (unsigned i = begin; i != end; ++i) {
+        int b = (int)((centroids[order[i]][axis] - base) * scale);
+        bin_bounds[b].grow(item_bounds[order[i]]);
+        bin_count[b]++;
+      }
+
+      // sweep from the right to get the cost of everything right of each plane
+      float right_area[num_bins];
+      unsigned right_count[num_bins];
+      bounds acc;
+      acc.clear();
+      unsigned n = 0;
+      for (int b = num_bins - 1; b > 0; --b) {
+        acc.grow(bin_bounds[b]);
+        n += bin_count[b];
+        right_area[b] = acc.area();
+        right_count[b] = n;
+      }
+
+      // then from the left to find the cheapest plane
+      float best_cost = 1e37f;
+      int best_plane = 0;
+      acc.clear();
+      n = 0;
+      for (int b = 1; b != num_bins; ++b) {
+        acc.grow(bin_bounds[b - 1]);
+        n += bin_count[b - 1];
+        if (n != 0 && right_count[b] != 0) {
+          float cost = acc.area() * n + right_area[b] * right_count[b];
+          if (cost < best_cost) {
+            best_cost = cost;
+            best_plane = b;
+          }
+        }
+      }
+
+      // a leaf costs one test per item, a split costs one box test plus the children.
+      float leaf_cost = node_bounds.area() * count;
+      if (best_plane == 0 || (count <= max_leaf_size && best_cost >= leaf_cost)) {
+        return count <= max_leaf_size ? begin : begin + count / 2;
+      }
+
+      // partition the order array about the plane
+      unsigned *lo = order + begin;
+      unsigned *hi = order + end;
+      while (lo < hi) {
+        int b = (int)((centroids[*lo][axis] - base) * scale);
+        if (b < best_plane) {
+          ++lo;
+        } else {
+          unsigned tmp = *lo; *lo = *--hi; *hi = tmp;
+        }
+      }
+      return (unsigned)(lo - order);
+    }
+
+    // build a subtree rooted at out[node_index]. if parallel, big subtrees become jobs instead.
+    void build(dynarray<node> &out, unsigned node_index, unsigned begin, unsigned end, unsigned depth, bool parallel) {
+      bounds b;
+      unsigned mid = split(b, begin, end);
+      set_bounds(out[node_index], b);
+
+      if (mid == begin || depth >= max_depth) {
+        out[node_index].first = begin;
+        out[node_index].count = end - begin;
+        return;
+      }
+
+      if (parallel && end - begin < min_parallel_items * 2) {
+        // leave this node for a worker
+        job *j = new job();
+        j->node_index = node_index;
+        j->begin = begin;
+        j->end = end;
+        j->depth = depth;
+        jobs.push_back(j);
+        return;
+      }
+
+      unsigned first = out.size();
+      out[node_index].first = first;
+      out[node_index].count = 0;
+      out.resize(first + 2);
+      build(out, first, begin, mid, depth + 1, parallel);
+      build(out, first + 1, mid, end, depth + 1, parallel);
+    }
+
+    static void do_job(void *context, unsigned index) {
+      bvh_builder *builder = (bvh_builder*)context;
+      job *j = builder->jobs[index];
+      j->nodes.resize(1);
+      builder->build(j->nodes, 0, j->begin, j->end, j->depth, false);
+    }
+
+    // copy a job's nodes into the tree. the job's root replaces the placeholder node.
+    static void add_job_nodes(dynarray<node> &nodes, job *j) {
+      unsigned base = nodes.size() - 1;
+      for (unsigned i = 1; i != j->nodes.size(); ++i) {
+        node n = j->nodes[i];
+        if (n.count == 0) n.first += base;
+        nodes.push_back(n);
+      }
+      node root = j->nodes[0];
+      if (root.count == 0) root.first += base;
+      nodes[j->node_index] = root;
+    }
+
+  public:
+    bvh_builder() {
+      item_bounds = 0;
+      order = 0;
+      max_leaf_size = 1;
+    }
+
+    // build a tree over num_items boxes. order gets the item index for each leaf slot.
+    void build(dynarray<node> &nodes, dynarray<unsigned> &order, const bounds *item_bounds, unsigned num_items, unsigned max_leaf_size) {
+      nodes.resize(0);
+      order.resize(num_items);
+      if (num_items == 0) return;
+
+      this->item_bounds = item_bounds;
+      this->order = &order[0];
+      this->max_leaf_size = max_leaf_size;
+      centroids.resize(num_items);
+      for (unsigned i = 0; i != num_items; ++i) {
+        centroids[i] = (item_bounds[i].min + item_bounds[i].max) * 0.5f;
+        order[i] = i;
+      }
+
+      // build the top of the tree here, then the big subtrees on all the cores.
+      bool parallel = num_items >= min_parallel_items * 2 && thread_pool::get_num_threads() > 1;
+      nodes.resize(1);
+      build(nodes, 0, 0, num_items, 0, parallel);
+      if (jobs.size()) {
+        thread_pool::run(do_job, this, jobs.size());
+        for (unsigned i = 0; i != jobs.size(); ++i) {
+          add_job_nodes(nodes, jobs[i]);
+          delete jobs[i];
+        }
+        jobs.reset();
+      }
+      centroids.reset();
+    }
+
+    static void set_bounds(node &n, const bounds &b) {
+      for (int i = 0; i != 3; ++i) {
+        n.min[i] = b.min[i];
+        n.max[i] = b.max[i];
+      }
+    }
+
+    static bounds get_bounds(const node &n) {
+      bounds b;
+      b.min = vec3(n.min[0], n.min[1], n.min[2]);
+      b.max = vec3(n.max[0], n.max[1], n.max[2]);
+      return b;
+    }
+
+    // recalculate the boxes of a tree whose items have moved. children always come after parents.
+    static void refit(dynarray<node> &nodes, const dynarray<unsigned> &order, const bounds *item_bounds) {
+      for (unsigned i = nodes.size(); i-- != 0; ) {
+        node &n = nodes[i];
+        bounds b;
+        b.clear();
+        if (n.count) {
+          for (unsigned j = n.first; j != n.first + n.count; ++j) {
+            b.grow(item_bounds[order[j]]);
+          }
+        } else {
+          b = get_bounds(nodes[n.first]);
+          b.grow(get_bounds(nodes[n.first + 1]));
+        }
+        set_bounds(n, b);
+      }
+    }
+
+    // SAH cost of a tree relative to its root box. this goes up as a refitted tree gets worse.
+    static float get_cost(const dynarray<node> &nodes) {
+      if (nodes.size() == 0) return 0;
+      float root_area = get_bounds(nodes[0]).area();
+      if (root_area <= 0) return 0;
+      float cost = 0;
+      for (unsigned i = 0; i != nodes.size(); ++i) {
+        const node &n = nodes[i];
+        cost += get_bounds(n).area() * (n.count ? (float)n.count : 1.0f);
+      }
+      return cost / root_area;
+    }
+
+    // slab test: does origin + dir * t hit the box for 0 <= t <= tmax? tnear is where it enters.
+    static bool hit_node(const node &n, const vec3 &origin, const vec3 &inv_dir, float tmax, float &tnear) {
+      float t0 = 0, t1 = tmax;
+      for (int i = 0; i != 3; ++i) {
+        float ta = (n.min[i] - origin[i]) * inv_dir[i];
+        float tb = (n.max[i] - origin[i]) * inv_dir[i];
+        t0 = max(t0, min(ta, tb));
+        t1 = min(t1, max(ta, tb));
+      }
+      tnear = t0;
+      return t0 <= t1;
+    }
+  };
+}
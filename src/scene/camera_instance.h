@@ -155,6 +155,14 @@ namespace octet {
       return ray(ray_start.xyz(), ray_end.xyz());
     }
 
+    // rays for a block of N/2 x 2 screen positions, eg. neighbouring pixels.
+    // lane i is at (x + (i % (N/2)) * step_x, y + (i / (N/2)) * step_y)
+    template <int N> void get_ray_packet(ray_packet<N> &packet, float x, float y, float step_x, float step_y) {
+      for (int i = 0; i != N; ++i) {
+        packet.set(i, get_ray(x + (i % (N/2)) * step_x, y + (i / (N/2)) * step_y));
+      }
+    }
+
     mat4t get_worldToProjection() const {
       mat4t result;
       result.loadIdentity();
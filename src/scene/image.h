@@ -254,6 +254,27 @@ namespace octet {
       //dxt_encode();
     }
 
+    // true if the pixels are in memory
+    bool is_loaded() const {
+      return bytes.size() != 0 && width != 0 && height != 0;
+    }
+
+    // nearest pixel of the top mip level with the uvs wrapped, for software renderers.
+    // call load() first if the image is not loaded.
+    vec4 get_texel(float u, float v) const {
+      if (!is_loaded() || (format != RGB && format != RGBA)) {
+        return vec4(1, 1, 1, 1);
+      }
+      unsigned num_comps = format == RGB ? 3 : 4;
+      int x = (int)floorf(u * width) % width;
+      int y = (int)floorf(v * height) % height;
+      x += x < 0 ? width : 0;
+      y += y < 0 ? height : 0;
+      const uint8_t *src = &bytes[(y * width + x) * num_comps];
+      const float scale = 1.0f / 255;
+      return vec4(src[0] * scale, src[1] * scale, src[2] * scale, num_comps == 4 ? src[3] * scale : 1.0f);
+    }
+
     GLuint get_gl_texture() {
       if (!gl_texture) {
         if (bytes.size() == 0 || width == 0 || height == 0) {
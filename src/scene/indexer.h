@@ -19,10 +19,11 @@ namespace octet {
         return size == rhs.size && memcmp(bytes, rhs.bytes, size) == 0;
       }
 
+      // FNV-1a: every byte affects every bit of the hash
       unsigned get_hash() const {
-        unsigned hash = 0;
+        unsigned hash = 2166136261u;
         for (unsigned i = 0; i != size; ++i) {
-          hash = ( hash >> 3 ) ^ ( hash >> 5 ) ^ bytes[i];
+          hash = ( hash ^ bytes[i] ) * 16777619u;
         }
         return hash;
       }
@@ -56,6 +57,7 @@ namespace octet {
       if (get_index_type() != GL_UNSIGNED_INT) return;
 
       hash_map<vertex, unsigned, vertex_cmp> vertex_to_index;
+      vertex_to_index.reserve(get_num_vertices());
 
       dynarray<uint8_t> dest_vertices;
       dynarray<uint32_t> dest_indices;
@@ -73,6 +73,10 @@ namespace octet {
       this->falloff_exponent = falloff_exponent;
     }
 
+    scene_node *get_node() {
+      return node;
+    }
+
     atom_t get_kind() {
       return kind;
     }
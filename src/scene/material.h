@@ -21,6 +21,10 @@ namespace octet {
     ref<param> bump;
     ref<param> shininess;
 
+  public:
+    RESOURCE_META(material)
+
+    // render() does this for you. render_queue calls it only when the material changes.
     void bind_textures() const {
       // set textures 0, 1, 2, 3 to their respective values
       glActiveTexture(GL_TEXTURE0);
@@ -38,9 +42,6 @@ namespace octet {
       glActiveTexture(GL_TEXTURE0);
     }
 
-  public:
-    RESOURCE_META(material)
-
     // default constructor makes a blank material.
     material() {
       diffuse = 0;
@@ -67,6 +68,13 @@ namespace octet {
       shininess = new param(vec4(30.0f/255, 0, 0, 0));
     }
 
+    param *get_diffuse() const { return diffuse; }
+    param *get_ambient() const { return ambient; }
+    param *get_emission() const { return emission; }
+    param *get_specular() const { return specular; }
+    param *get_bump() const { return bump; }
+    param *get_shininess() const { return shininess; }
+
     void visit(visitor &v) {
       v.visit(diffuse, atom_diffuse);
       v.visit(ambient, atom_ambient);
@@ -31,6 +31,9 @@ namespace octet {
     // bounding box
     aabb mesh_aabb;
 
+    // false until set_aabb() or calc_aabb(). culling always draws meshes with no box.
+    bool aabb_valid;
+
   public:
     RESOURCE_META(mesh)
 
@@ -51,6 +54,12 @@ namespace octet {
       v.visit(num_slots, atom_num_slots);
       v.visit(mesh_skin, atom_mesh_skin);
       v.visit(mesh_aabb, atom_mesh_aabb);
+
+      // files don't say if the box was set, so an empty one counts as never computed
+      if (v.is_reader()) {
+        vec3 half = mesh_aabb.get_half_extent();
+        aabb_valid = half.x() != 0 || half.y() != 0 || half.z() != 0;
+      }
     }
 
     ~mesh() {
@@ -74,6 +83,26 @@ namespace octet {
       mode = GL_TRIANGLES;
 
       mesh_skin = _skin;
+      mesh_aabb = aabb();
+      aabb_valid = false;
+    }
+
+    // use the same buffers, format and bounds as another mesh, but not its skin.
+    // modifiers then replace the buffers they change (see skinned_mesh).
+    void share_buffers(const mesh &source) {
+      vertices = source.vertices;
+      indices = source.indices;
+      memcpy(format, source.format, sizeof(format));
+      num_indices = source.num_indices;
+      num_vertices = source.num_vertices;
+      stride = source.stride;
+      mode = source.mode;
+      index_type = source.index_type;
+      normalized = source.normalized;
+      num_slots = source.num_slots;
+      mesh_aabb = source.mesh_aabb;
+      aabb_valid = source.aabb_valid;
+      mesh_skin = 0;
     }
 
     void clear_attributes() {
@@ -159,6 +188,7 @@ namespace octet {
     // set the axis aligned bounding box of the untransformed mesh
     void set_aabb(const aabb &value) {
       mesh_aabb = value;
+      aabb_valid = true;
     }
 
     // get the axis aligned bounding box of the untransformed mesh
@@ -166,6 +196,31 @@ namespace octet {
       return mesh_aabb;
     }
 
+    // true if the box has been set or calculated since the mesh was built
+    bool has_aabb() const {
+      return aabb_valid;
+    }
+
+    // set the bounding box from the positions (eg. after building or changing them)
+    void calc_aabb() {
+      unsigned slot = get_slot(attribute_pos);
+      // with no positions we can't tell, so leave it to be drawn anyway
+      aabb_valid = slot != ~0u;
+      if (get_num_vertices() == 0 || slot == ~0u) {
+        mesh_aabb = aabb();
+        return;
+      }
+
+      vec3 vmin(1e37f, 1e37f, 1e37f);
+      vec3 vmax(-1e37f, -1e37f, -1e37f);
+      for (unsigned i = 0; i != get_num_vertices(); ++i) {
+        vec3 pos = get_value(slot, i).xyz();
+        vmin = vmin.min(pos);
+        vmax = vmax.max(pos);
+      }
+      mesh_aabb = aabb((vmax + vmin) * 0.5f, (vmax - vmin) * 0.5f);
+    }
+
     // return true if this mesh has a particular attribute
     bool has_attribute(unsigned attr) {
       for (unsigned i = 0; i != num_slots; ++i) {
@@ -318,6 +373,14 @@ namespace octet {
       glDrawElements(get_mode(), get_num_indices(), get_index_type(), (GLvoid*)0);
     }
 
+    #if OCTET_INSTANCING
+      // draw num_instances copies. the per instance attributes must be set up (see render_queue)
+      void draw_instanced(unsigned num_instances) {
+        indices->bind();
+        glDrawElementsInstanced(get_mode(), get_num_indices(), get_index_type(), (GLvoid*)0, num_instances);
+      }
+    #endif
+
     void disable_attributes() {
       for (unsigned slot = 0; slot != get_num_slots(); ++slot) {
         unsigned attr = get_attr(slot);
@@ -491,6 +554,8 @@ namespace octet {
         set_value(tangent_slot, i, vec4(new_tangent,0));
         set_value(bitangent_slot, i, vec4(new_bitangent,0));
       }
+
+      calc_aabb();
     }
 
     // apply a matrix to every position
@@ -500,10 +565,19 @@ namespace octet {
       }
 
       unsigned slot = get_slot(attr);
-      for (unsigned i = 0; i != get_num_vertices(); ++i) {
-        vec4 pos = get_value(slot, i);
-        vec4 tpos = pos * matrix;
-        set_value(slot, i, tpos);
+      if (get_kind(slot) == GL_FLOAT && get_size(slot) == 3) {
+        // the common case: do the whole buffer in one go and upload it once.
+        vertices->transform_points(get_offset(slot), stride, get_num_vertices(), matrix);
+      } else {
+        for (unsigned i = 0; i != get_num_vertices(); ++i) {
+          vec4 pos = get_value(slot, i);
+          vec4 tpos = pos * matrix;
+          set_value(slot, i, tpos);
+        }
+      }
+
+      if (attr == attribute_pos) {
+        calc_aabb();
       }
     }
 
@@ -0,0 +1,280 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Bounding volume hierarchy for the triangles of a mesh
+//
+// This lets us find which triangle a ray hits without testing them all.
+// The tree is built by bvh_builder with the surface area heuristic.
+//
+// example:
+//
+//   mesh_bvh bvh;
+//   bvh.init(my_mesh);
+//
+//   mesh_bvh::hit h;
+//   if (bvh.closest_hit(h, ray(start, end))) {
+//     printf("triangle %d at %f\n", h.triangle, h.t);
+//   }
+//
+// closest_hit also takes a ray_packet, which tests four or eight rays against
+// each box and triangle with SIMD.
+//
+// The triangles are stored in leaf order, so a leaf is a run of memory.
+//
+
+namespace octet {
+  class mesh_bvh {
+  public:
+    // where a ray hit a triangle. the point is p0 * (1-u-v) + p1 * u + p2 * v
+    struct hit {
+      float t;       // distance along the ray
+      float u, v;    // barycentrics
+      int triangle;  // index of the triangle in the mesh, -1 if no hit
+    };
+
+    // see bvh_builder
+    typedef bvh_builder::node node;
+
+  private:
+    typedef bvh_builder::bounds bounds;
+
+    // triangle ready for Moller-Trumbore
+    struct triangle {
+      vec3 p0, e1, e2;
+    };
+
+    enum { max_leaf_size = 4 };
+
+    dynarray<node> nodes;
+    dynarray<triangle> triangles;
+    dynarray<unsigned> triangle_index;
+
+    // Moller-Trumbore. true if the ray hits between 0 and tmax.
+    static bool hit_triangle(const triangle &tri, const vec3 &origin, const vec3 &dir, float tmax, float &t, float &u, float &v) {
+      vec3 pvec = dir.cross(tri.e2);
+      float det = tri.e1.dot(pvec);
+      if (fabsf(det) < 1e-20f) return false;
+      float inv_det = 1.0f / det;
+      vec3 tvec = origin - tri.p0;
+      u = tvec.dot(pvec) * inv_det;
+      if (u < 0 || u > 1) return false;
+      vec3 qvec = tvec.cross(tri.e1);
+      v = dir.dot(qvec) * inv_det;
+      if (v < 0 || u + v > 1) return false;
+      t = tri.e2.dot(qvec) * inv_det;
+      return t >= 0 && t < tmax;
+    }
+
+    template <bool any> bool traverse(hit &result, const vec3 &origin, const vec3 &dir, float tmax) const {
+      result.triangle = -1;
+      result.t = tmax;
+      if (nodes.size() == 0) return false;
+
+      // 1/0 is inf, which the slab test handles.
+      vec3 inv_dir(1.0f / dir.x(), 1.0f / dir.y(), 1.0f / dir.z());
+      unsigned stack[bvh_builder::max_depth + 1];
+      unsigned sp = 0;
+      float tnear;
+      if (!bvh_builder::hit_node(nodes[0], origin, inv_dir, tmax, tnear)) return false;
+      stack[sp++] = 0;
+
+      while (sp) {
+        const node &n = nodes[stack[--sp]];
+        if (n.count) {
+          for (unsigned i = n.first; i != n.first + n.count; ++i) {
+            float t, u, v;
+            if (hit_triangle(triangles[i], origin, dir, result.t, t, u, v)) {
+              result.t = t;
+              result.u = u;
+              result.v = v;
+              result.triangle = (int)triangle_index[i];
+              if (any) return true;
+            }
+          }
+        } else {
+          // visit the nearer child first
+          float ta, tb;
+          bool hit_a = bvh_builder::hit_node(nodes[n.first], origin, inv_dir, result.t, ta);
+          bool hit_b = bvh_builder::hit_node(nodes[n.first + 1], origin, inv_dir, result.t, tb);
+          if (hit_a && hit_b) {
+            bool a_first = ta <= tb;
+            stack[sp++] = a_first ? n.first + 1 : n.first;
+            stack[sp++] = a_first ? n.first : n.first + 1;
+          } else if (hit_a) {
+            stack[sp++] = n.first;
+          } else if (hit_b) {
+            stack[sp++] = n.first + 1;
+          }
+        }
+      }
+      return result.triangle != -1;
+    }
+
+    // the same for a packet of rays. a box is visited if any live lane hits it.
+    template <int N> unsigned traverse_packet(ray_packet<N> &packet) const {
+      if (nodes.size() == 0) return 0;
+
+      unsigned stack[bvh_builder::max_depth + 1];
+      unsigned sp = 0;
+      float tnear[N];
+      if (!packet.hit_box(nodes[0].min, nodes[0].max, tnear)) return 0;
+      stack[sp++] = 0;
+
+      unsigned hits = 0;
+      while (sp) {
+        const node &n = nodes[stack[--sp]];
+        if (n.count) {
+          for (unsigned i = n.first; i != n.first + n.count; ++i) {
+            const triangle &tri = triangles[i];
+            hits |= packet.hit_triangle(tri.p0, tri.e1, tri.e2, (int)triangle_index[i]);
+          }
+        } else {
+          float ta[N], tb[N];
+          unsigned hit_a = packet.hit_box(nodes[n.first].min, nodes[n.first].max, ta);
+          unsigned hit_b = packet.hit_box(nodes[n.first + 1].min, nodes[n.first + 1].max, tb);
+          if (hit_a && hit_b) {
+            // the rays are close together, so one lane that hits both chooses the order.
+            unsigned both = hit_a & hit_b;
+            unsigned lane = 0;
+            while (both && !(both & (1 << lane))) ++lane;
+            bool a_first = both ? ta[lane] <= tb[lane] : true;
+            stack[sp++] = a_first ? n.first + 1 : n.first;
+            stack[sp++] = a_first ? n.first : n.first + 1;
+          } else if (hit_a) {
+            stack[sp++] = n.first;
+          } else if (hit_b) {
+            stack[sp++] = n.first + 1;
+          }
+        }
+      }
+      return hits;
+    }
+
+  public:
+    mesh_bvh() {
+    }
+
+    ~mesh_bvh() {
+    }
+
+    // build from the positions of a triangle mesh.
+    void init(mesh *m) {
+      reset();
+      unsigned pos_slot = m->get_slot(attribute_pos);
+      if (m->get_mode() != GL_TRIANGLES || pos_slot == ~0u || m->get_kind(pos_slot) != GL_FLOAT || m->get_size(pos_slot) < 3) {
+        return;
+      }
+
+      unsigned num_vertices = m->get_num_vertices();
+      gl_resource *index_buffer = m->get_indices();
+      unsigned num_indices = index_buffer ? m->get_num_indices() : num_vertices;
+      dynarray<unsigned> indices(num_indices);
+      if (index_buffer) {
+        const uint8_t *src = (const uint8_t *)index_buffer->lock_read_only();
+        bool short_indices = m->get_index_type() == GL_UNSIGNED_SHORT;
+        for (unsigned i = 0; i != num_indices; ++i) {
+          indices[i] = short_indices ? ((const uint16_t*)src)[i] : ((const uint32_t*)src)[i];
+        }
+        index_buffer->unlock_read_only();
+      } else {
+        for (unsigned i = 0; i != num_indices; ++i) {
+          indices[i] = i;
+        }
+      }
+
+      const uint8_t *vertices = (const uint8_t *)m->get_vertices()->lock_read_only();
+      init(vertices + m->get_offset(pos_slot), m->get_stride(), num_vertices, num_indices ? &indices[0] : 0, num_indices / 3);
+      m->get_vertices()->unlock_read_only();
+    }
+
+    // build from num_triangles sets of three indices into an array of vec3 positions stride bytes apart.
+    void init(const uint8_t *positions, unsigned stride, unsigned num_vertices, const unsigned *indices, unsigned num_triangles) {
+      reset();
+      if (num_triangles == 0) return;
+
+      dynarray<bounds> tri_bounds(num_triangles);
+      dynarray<triangle> unsorted(num_triangles);
+      for (unsigned i = 0; i != num_triangles; ++i) {
+        vec3 p[3];
+        for (unsigned j = 0; j != 3; ++j) {
+          unsigned idx = indices[i * 3 + j];
+          assert(idx < num_vertices);
+          const float *src = (const float*)(positions + stride * idx);
+          p[j] = vec3(src[0], src[1], src[2]);
+        }
+        unsorted[i].p0 = p[0];
+        unsorted[i].e1 = p[1] - p[0];
+        unsorted[i].e2 = p[2] - p[0];
+        tri_bounds[i].clear();
+        tri_bounds[i].grow(p[0]);
+        tri_bounds[i].grow(p[1]);
+        tri_bounds[i].grow(p[2]);
+      }
+
+      bvh_builder builder;
+      builder.build(nodes, triangle_index, &tri_bounds[0], num_triangles, max_leaf_size);
+
+      // store the triangles in leaf order
+      triangles.resize(num_triangles);
+      for (unsigned i = 0; i != num_triangles; ++i) {
+        triangles[i] = unsorted[triangle_index[i]];
+      }
+    }
+
+    void reset() {
+      nodes.reset();
+      triangles.reset();
+      triangle_index.reset();
+    }
+
+    // find the nearest triangle hit by origin + dir * t for 0 <= t < tmax
+    bool closest_hit(hit &result, const vec3 &origin, const vec3 &dir, float tmax) const {
+      return traverse<false>(result, origin, dir, tmax);
+    }
+
+    // find any triangle hit by origin + dir * t (eg. for shadows). quicker than closest_hit.
+    bool any_hit(hit &result, const vec3 &origin, const vec3 &dir, float tmax) const {
+      return traverse<true>(result, origin, dir, tmax);
+    }
+
+    // ray versions: t is 0 at the start of the ray and 1 at the end.
+    bool closest_hit(hit &result, const ray &the_ray) const {
+      return traverse<false>(result, the_ray.get_origin(), the_ray.get_distance(), 1.0f);
+    }
+
+    bool any_hit(hit &result, const ray &the_ray) const {
+      return traverse<true>(result, the_ray.get_origin(), the_ray.get_distance(), 1.0f);
+    }
+
+    // trace four or eight rays at once. lanes that hit something nearer than their t
+    // get t, u, v and triangle. returns one bit for each lane that hit.
+    template <int N> unsigned closest_hit(ray_packet<N> &packet) const {
+      packet.finish();
+      return traverse_packet(packet);
+    }
+
+    // bounds of the whole mesh
+    aabb get_aabb() const {
+      if (nodes.size() == 0) return aabb(vec3(0, 0, 0), vec3(0, 0, 0));
+      const node &n = nodes[0];
+      vec3 min(n.min[0], n.min[1], n.min[2]);
+      vec3 max(n.max[0], n.max[1], n.max[2]);
+      return aabb((min + max) * 0.5f, (max - min) * 0.5f);
+    }
+
+    unsigned get_num_nodes() const {
+      return nodes.size();
+    }
+
+    unsigned get_num_triangles() const {
+      return triangles.size();
+    }
+
+    const node *get_nodes() const {
+      return nodes.size() ? &nodes[0] : 0;
+    }
+  };
+}
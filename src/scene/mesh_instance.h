@@ -20,7 +20,9 @@ namespace octet {
 
     // for characters, which skeleton to use
     ref<skeleton> skel;
-    
+
+    // the mesh posed on the CPU, made when first asked for
+    ref<skinned_mesh> cpu_skin;
 
   public:
     RESOURCE_META(mesh_instance)
@@ -101,6 +103,25 @@ namespace octet {
     material *get_material() const { return mat; }
     skeleton *get_skeleton() const { return skel; }
 
+    // the mesh posed by the skeleton on the CPU, or 0 if we have no skeleton or skin.
+    // the vertices are only posed again if the bones have moved (see skinned_mesh).
+    skinned_mesh *get_cpu_skinned_mesh() {
+      if (!msh || !skel || !msh->get_skin()) return 0;
+      if (!cpu_skin || cpu_skin->get_src() != msh) {
+        cpu_skin = new skinned_mesh(msh, skel);
+      } else {
+        cpu_skin->set_skeleton(skel);
+        cpu_skin->update();
+      }
+      return cpu_skin;
+    }
+
+    // the mesh in its current pose, eg. for ray tracing.
+    mesh *get_posed_mesh() {
+      skinned_mesh *posed = get_cpu_skinned_mesh();
+      return posed ? (mesh*)posed : (mesh*)msh;
+    }
+
     void set_node(scene_node *value) { node = value; }
     void set_mesh(mesh *value) { msh = value; }
     void set_material(material *value) { mat = value; }
@@ -48,6 +48,7 @@ namespace octet {
       get_indices()->unlock();
       set_num_indices(num_quads * 6);
       set_num_vertices(num_quads * 4);
+      calc_aabb();
     }
 
     void visit(visitor &v) {
@@ -78,6 +78,18 @@ namespace octet {
     image *get_image() {
       return img;
     }
+
+    // make sure get_texel() has pixels to read
+    void load_texels() {
+      if (kind == atom_image && img && !img->is_loaded()) {
+        img->load();
+      }
+    }
+
+    // color at a uv, for software renderers.
+    vec4 get_texel(float u, float v) const {
+      return kind == atom_image && img ? img->get_texel(u, v) : color;
+    }
   };
 }
 
@@ -0,0 +1,425 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Sort draws to save state changes
+//
+// Drawing things in the order they were added to the scene switches shaders,
+// textures and vertex buffers far more often than we need to. The render queue
+// collects the draws for a frame, gives each one a 64 bit key and sorts them with
+// a radix sort so that draws which share state are next to each other:
+//
+//   bit  63     : skinned (which shader)
+//   bits 62..42 : material
+//   bits 41..21 : mesh
+//   bits 15..0  : depth, nearest first
+//
+// Then it only changes the shader, textures or vertex attributes when they differ
+// from the last draw.
+//
+// After sorting, runs of draws with the same mesh and material are drawn with one
+// instanced draw call if the GL context can do it. The matrices go in a vertex buffer
+// with one modelToProjection and modelToCamera per instance. Without instancing
+// (GLES2, or OCTET_INSTANCING=0) we draw them one at a time as before. The instance
+// matrices use attribute slots 4-6 and 9-12, so meshes with attributes there (eg.
+// a second set of texture coordinates) are drawn one at a time too.
+//
+// example:
+//
+//   queue.reset(cam.get_farVal());
+//   queue.add(msh, mat, modelToWorld, skel, depth);
+//   ...
+//   queue.render(object_shader, skin_shader, cam, light_uniforms, num_light_uniforms, num_lights);
+//   printf("%d draws %d state changes\n", queue.get_num_draw_calls(), queue.get_num_state_changes());
+//
+
+namespace octet {
+  class render_queue {
+    struct item {
+      mesh *msh;
+      material *mat;
+      skeleton *skel;
+      const mat4t *modelToWorld;
+    };
+
+    enum {
+      id_bits = 21,
+      depth_bits = 16,
+      max_id = (1 << id_bits) - 1,
+
+      // shorter runs of the same mesh and material are not worth an instance buffer
+      min_instances = 4,
+
+      // floats per instance: modelToProjection and the first three rows of modelToCamera
+      instance_floats = 16 + 12,
+    };
+
+    dynarray<item> items;
+    dynarray<uint64_t> keys;
+    dynarray<unsigned> order;
+
+    // dense per-frame ids for the sort key, in the order we first see them
+    hash_map<material*, unsigned> material_ids;
+    hash_map<mesh*, unsigned> mesh_ids;
+
+    float depth_scale;
+    bool sorting;
+
+    // counters for the last render()
+    unsigned num_draw_calls;
+    unsigned num_shader_changes;
+    unsigned num_material_changes;
+    unsigned num_mesh_changes;
+    unsigned num_instanced_draws;
+    unsigned num_instances;
+
+    // instanced drawing: enabled, and -1 until we have asked GL if we can
+    bool instancing;
+    int instancing_support;
+    bump_shader instanced_shader;
+    GLuint instance_buffer;
+    dynarray<float> instance_data;
+
+    // skeletons to evaluate together before drawing and the position of their first draw
+    hash_map<skeleton*, unsigned> palette_ids;
+    dynarray<skeleton*> palette_skeletons;
+    dynarray<skin*> palette_skins;
+    dynarray<mat4t> palette_modelToCamera;
+    dynarray<uint8_t> palette_ready;
+
+    // scratch space for the sort
+    dynarray<uint64_t> tmp_keys;
+    dynarray<unsigned> tmp_order;
+
+    template <class type> static unsigned get_id(hash_map<type*, unsigned> &ids, type *ptr) {
+      unsigned &id = ids[ptr];
+      if (id == 0) {
+        // hash_map values start at zero, so ids start at one
+        id = ids.size();
+      }
+      return id < max_id ? id : max_id;
+    }
+
+    // can we draw instanced? this needs a GL context, so we find out on the first render.
+    bool init_instancing() {
+      if (instancing_support < 0) {
+        instancing_support = 0;
+        #if OCTET_INSTANCING
+          bool has_functions = true;
+          #ifdef WIN32
+            // these are null if the driver does not have them
+            has_functions = glDrawElementsInstanced && glVertexAttribDivisor;
+          #endif
+          GLint max_attribs = 0;
+          glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_attribs);
+          if (has_functions && max_attribs > attribute_instance_modelToProjection + 3) {
+            instanced_shader.init(false, true);
+            glGenBuffers(1, &instance_buffer);
+            instancing_support = 1;
+          }
+        #endif
+      }
+      return instancing_support == 1;
+    }
+
+    // calculate the bone matrices of every skinned draw at once with the thread_pool.
+    // a skeleton drawn twice is done the second time when we draw it.
+    void calc_palettes(camera_instance &cam) {
+      palette_ids.clear();
+      palette_skeletons.resize(0);
+      palette_skins.resize(0);
+      palette_modelToCamera.resize(0);
+      palette_ready.resize(order.size());
+      for (unsigned i = 0; i != order.size(); ++i) {
+        const item &it = items[order[i]];
+        palette_ready[i] = 0;
+        if (!it.skel) continue;
+
+        unsigned &id = palette_ids[it.skel];
+        if (id != 0) continue;
+        id = palette_ids.size();
+
+        mat4t modelToCamera;
+        mat4t modelToProjection;
+        cam.get_matrices(modelToProjection, modelToCamera, *it.modelToWorld);
+        palette_skeletons.push_back(it.skel);
+        palette_skins.push_back(it.msh->get_skin());
+        palette_modelToCamera.push_back(modelToCamera);
+        palette_ready[i] = 1;
+      }
+
+      if (palette_skeletons.size()) {
+        skeleton::calc_transforms(&palette_skeletons[0], &palette_modelToCamera[0], &palette_skins[0], palette_skeletons.size());
+      }
+    }
+
+    // true if the mesh has no attributes in the slots of the instance matrices
+    static bool can_instance(const mesh *msh) {
+      for (unsigned j = 0; j != 3; ++j) {
+        if (msh->get_slot(attribute_instance_modelToCamera + j) != ~0u) return false;
+      }
+      for (unsigned j = 0; j != 4; ++j) {
+        if (msh->get_slot(attribute_instance_modelToProjection + j) != ~0u) return false;
+      }
+      return true;
+    }
+
+    // number of draws from first on that can share an instanced draw call
+    unsigned get_run_length(unsigned first) const {
+      const item &it = items[order[first]];
+      if (!can_instance(it.msh)) return 1;
+      unsigned end = first + 1;
+      while (end != order.size()) {
+        const item &next = items[order[end]];
+        if (next.msh != it.msh || next.mat != it.mat || next.skel) break;
+        ++end;
+      }
+      return end - first;
+    }
+
+    // draw a run of non-skinned draws with one call. the mesh attributes are already enabled.
+    void draw_instanced(camera_instance &cam, unsigned first, unsigned count) {
+      #if OCTET_INSTANCING
+        instance_data.resize(count * instance_floats);
+        float *dest = &instance_data[0];
+        for (unsigned i = 0; i != count; ++i) {
+          mat4t modelToCamera;
+          mat4t modelToProjection;
+          cam.get_matrices(modelToProjection, modelToCamera, *items[order[first + i]].modelToWorld);
+          memcpy(dest, modelToProjection.get(), 16 * sizeof(float));
+          memcpy(dest + 16, modelToCamera.get(), 12 * sizeof(float));
+          dest += instance_floats;
+        }
+
+        unsigned stride = instance_floats * sizeof(float);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, count * stride, &instance_data[0], GL_STREAM_DRAW);
+
+        // a mat4 attribute takes four slots, a mat3 three. each slot is a row of our matrix
+        for (unsigned row = 0; row != 7; ++row) {
+          unsigned attr = row < 4 ? attribute_instance_modelToProjection + row : attribute_instance_modelToCamera + row - 4;
+          glVertexAttribPointer(attr, row < 4 ? 4 : 3, GL_FLOAT, GL_FALSE, stride, (void*)(row * 4 * sizeof(float)));
+          glEnableVertexAttribArray(attr);
+          glVertexAttribDivisor(attr, 1);
+        }
+
+        items[order[first]].msh->draw_instanced(count);
+
+        for (unsigned row = 0; row != 7; ++row) {
+          unsigned attr = row < 4 ? attribute_instance_modelToProjection + row : attribute_instance_modelToCamera + row - 4;
+          glVertexAttribDivisor(attr, 0);
+          glDisableVertexAttribArray(attr);
+        }
+      #endif
+    }
+
+    // sort keys (and order with them) least significant byte first.
+    // bytes that are the same in every key are skipped.
+    void radix_sort() {
+      unsigned n = keys.size();
+      tmp_keys.resize(n);
+      tmp_order.resize(n);
+      uint64_t *src_keys = &keys[0], *dest_keys = &tmp_keys[0];
+      unsigned *src_order = &order[0], *dest_order = &tmp_order[0];
+
+      for (unsigned shift = 0; shift != 64; shift += 8) {
+        unsigned count[256];
+        memset(count, 0, sizeof(count));
+        for (unsigned i = 0; i != n; ++i) {
+          count[(src_keys[i] >> shift) & 0xff]++;
+        }
+        if (count[(src_keys[0] >> shift) & 0xff] == n) continue;
+
+        unsigned offset = 0;
+        for (unsigned b = 0; b != 256; ++b) {
+          unsigned c = count[b];
+          count[b] = offset;
+          offset += c;
+        }
+        for (unsigned i = 0; i != n; ++i) {
+          unsigned dest = count[(src_keys[i] >> shift) & 0xff]++;
+          dest_keys[dest] = src_keys[i];
+          dest_order[dest] = src_order[i];
+        }
+        uint64_t *tk = src_keys; src_keys = dest_keys; dest_keys = tk;
+        unsigned *to = src_order; src_order = dest_order; dest_order = to;
+      }
+
+      if (src_keys != &keys[0]) {
+        memcpy(&keys[0], src_keys, n * sizeof(keys[0]));
+        memcpy(&order[0], src_order, n * sizeof(order[0]));
+      }
+    }
+
+  public:
+    render_queue() {
+      depth_scale = 1;
+      sorting = true;
+      instancing = true;
+      instancing_support = -1;
+      instance_buffer = 0;
+      num_draw_calls = num_shader_changes = num_material_changes = num_mesh_changes = 0;
+      num_instanced_draws = num_instances = 0;
+    }
+
+    ~render_queue() {
+      if (instance_buffer) {
+        glDeleteBuffers(1, &instance_buffer);
+      }
+    }
+
+    // start a new frame. depths run from 0 to max_depth (eg. the far plane)
+    void reset(float max_depth) {
+      items.resize(0);
+      keys.resize(0);
+      order.resize(0);
+      material_ids.clear();
+      mesh_ids.clear();
+      depth_scale = max_depth > 0 ? ((1 << depth_bits) - 1) / max_depth : 0;
+    }
+
+    // queue a draw. modelToWorld must stay put until render().
+    // skel is the skeleton for skinned meshes or 0.
+    void add(mesh *msh, material *mat, const mat4t *modelToWorld, skeleton *skel, float depth) {
+      bool skinned = skel && msh->get_skin();
+      float d = depth * depth_scale;
+      uint64_t depth_key = d <= 0 ? 0 : d >= (1 << depth_bits) - 1 ? (1 << depth_bits) - 1 : (uint64_t)d;
+      uint64_t key =
+        ((uint64_t)skinned << 63) |
+        ((uint64_t)get_id(material_ids, mat) << (id_bits * 2)) |
+        ((uint64_t)get_id(mesh_ids, msh) << id_bits) |
+        depth_key
+      ;
+
+      item it = { msh, mat, skinned ? skel : 0, modelToWorld };
+      order.push_back(items.size());
+      items.push_back(it);
+      keys.push_back(key);
+    }
+
+    // draw everything, sorted unless set_sorting(false)
+    void render(bump_shader &object_shader, bump_shader &skin_shader, camera_instance &cam, vec4 *light_uniforms, int num_light_uniforms, int num_lights) {
+      num_draw_calls = num_shader_changes = num_material_changes = num_mesh_changes = 0;
+      num_instanced_draws = num_instances = 0;
+      if (items.size() == 0) return;
+
+      if (sorting) {
+        radix_sort();
+      }
+
+      calc_palettes(cam);
+
+      const mat4t &cameraToProjection = cam.get_cameraToProjection();
+      bump_shader *cur_shader = 0;
+      material *cur_material = 0;
+      mesh *cur_mesh = 0;
+      for (unsigned i = 0; i != order.size(); ) {
+        const item &it = items[order[i]];
+        unsigned run = instancing && !it.skel ? get_run_length(i) : 1;
+        bool instanced = run >= min_instances && init_instancing();
+        bump_shader *shader = instanced ? &instanced_shader : it.skel ? &skin_shader : &object_shader;
+        if (shader != cur_shader) {
+          shader->begin(light_uniforms, num_light_uniforms, num_lights, it.skel != 0);
+          cur_shader = shader;
+          num_shader_changes++;
+        }
+
+        // textures stay bound when we change shaders
+        if (it.mat != cur_material) {
+          it.mat->bind_textures();
+          cur_material = it.mat;
+          num_material_changes++;
+        }
+
+        if (it.msh != cur_mesh) {
+          if (cur_mesh) cur_mesh->disable_attributes();
+          it.msh->enable_attributes();
+          cur_mesh = it.msh;
+          num_mesh_changes++;
+        }
+
+        if (instanced) {
+          draw_instanced(cam, i, run);
+
+          // the instance matrices used vertex attribute slots, so set up the mesh again next time
+          cur_mesh->disable_attributes();
+          cur_mesh = 0;
+          num_draw_calls++;
+          num_instanced_draws++;
+          num_instances += run;
+          i += run;
+          continue;
+        }
+
+        mat4t modelToCamera;
+        mat4t modelToProjection;
+        cam.get_matrices(modelToProjection, modelToCamera, *it.modelToWorld);
+        if (!it.skel) {
+          // normal rendering for single matrix objects
+          // the projection space is the cube -1 <= x/w, y/w, z/w <= 1
+          shader->set_matrices(modelToProjection, modelToCamera);
+        } else {
+          // multi-matrix rendering
+          skin *skn = it.msh->get_skin();
+          mat4t *transforms = palette_ready[i] ? it.skel->get_transforms() : it.skel->calc_transforms(modelToCamera, skn);
+          int num_joints = skn->get_num_joints();
+          assert(num_joints <= bump_shader::max_skin_matrices);
+          shader->set_skinned_matrices(cameraToProjection, transforms, num_joints);
+        }
+
+        it.msh->draw();
+        num_draw_calls++;
+        i++;
+      }
+
+      if (cur_mesh) cur_mesh->disable_attributes();
+    }
+
+    // false to draw in the order of add(), eg. to compare the counters
+    void set_sorting(bool value) {
+      sorting = value;
+    }
+
+    // false to draw every mesh on its own even if the GL context can do instancing
+    void set_instancing(bool value) {
+      instancing = value;
+    }
+
+    // true if the last render() found that the GL context can draw instanced
+    bool can_draw_instanced() const {
+      return instancing_support == 1;
+    }
+
+    unsigned get_num_draw_calls() const {
+      return num_draw_calls;
+    }
+
+    // shader, material and mesh changes in the last render()
+    unsigned get_num_state_changes() const {
+      return num_shader_changes + num_material_changes + num_mesh_changes;
+    }
+
+    unsigned get_num_shader_changes() const {
+      return num_shader_changes;
+    }
+
+    unsigned get_num_material_changes() const {
+      return num_material_changes;
+    }
+
+    unsigned get_num_mesh_changes() const {
+      return num_mesh_changes;
+    }
+
+    // instanced draw calls in the last render() and the meshes they drew
+    unsigned get_num_instanced_draws() const {
+      return num_instanced_draws;
+    }
+
+    unsigned get_num_instances() const {
+      return num_instances;
+    }
+  };
+}
@@ -20,6 +20,9 @@ namespace octet {
     // animations playing at the moment
     dynarray<ref<animation_instance> > animation_instances;
 
+    // blends the animation instances that drive the same nodes
+    animation_mixer mixer;
+
     // cameras available
     dynarray<ref<camera_instance> > camera_instances;
 
@@ -42,6 +45,49 @@ namespace octet {
 
     int frame_number;
 
+    // tree of mesh instances for ray casts, and the frame and node version it was refitted at
+    scene_bvh bvh;
+    int bvh_frame;
+    unsigned bvh_version;
+
+    // tree of mesh instance boxes for hierarchical culling, with no triangle trees
+    scene_bvh cull_bvh;
+    int cull_bvh_frame;
+    unsigned cull_bvh_version;
+
+    // frustum culling: one byte per mesh instance from the last render
+    dynarray<uint8_t> visible;
+    bool frustum_culling;
+    bool hierarchical_culling;
+    unsigned num_visible;
+    unsigned num_culled;
+
+    // pose every skinned mesh on the CPU, not just ones with too many bones for the shader
+    bool cpu_skinning;
+
+    // draws for this frame, sorted to save state changes
+    render_queue queue;
+
+    // per instance scratch for get_world_aabbs() and update_bvh(), kept between frames
+    // so that we don't depend on anyone resetting the frame arena.
+    dynarray<aabb> world_aabbs;
+    dynarray<aabb> model_aabbs;
+    dynarray<mat4t> instance_modelToWorld;
+    dynarray<mesh*> instance_meshes;
+
+    // optionally update all the world matrices in one flat sweep (see transform_hierarchy)
+    transform_hierarchy flat_transforms;
+    bool use_flat_transforms;
+
+    // bring the cached world matrices of the nodes up to date
+    void update_transforms() {
+      if (use_flat_transforms) {
+        flat_transforms.update(this);
+      } else {
+        update_world_matrices();
+      }
+    }
+
     void draw_aabb(const aabb &bb) {
       vec3 pos[8];
       for (int i = 0; i != 8; ++i) {
@@ -92,12 +138,35 @@ namespace octet {
       num_light_uniforms = 1 + num_lights * light_size;
     }
 
+    // get the world space bounding boxes of all the mesh instances in one batch.
+    // instances with no node or mesh get an empty box at the origin.
+    const dynarray<aabb> &get_world_aabbs() {
+      update_transforms();
+      unsigned num = mesh_instances.size();
+      world_aabbs.resize(num);
+      if (num == 0) return world_aabbs;
+
+      model_aabbs.resize(num);
+      instance_modelToWorld.resize(num);
+      mat4t *modelToWorld = &instance_modelToWorld[0];
+      for (unsigned i = 0; i != num; ++i) {
+        mesh_instance *mi = mesh_instances[i];
+        if (mi && mi->get_node() && mi->get_mesh()) {
+          model_aabbs[i] = mi->get_mesh()->get_aabb();
+          modelToWorld[i] = mi->get_node()->get_modelToWorld();
+        } else {
+          model_aabbs[i] = aabb();
+          modelToWorld[i].loadIdentity();
+        }
+      }
+      transform_batch::aabbs(&world_aabbs[0], &model_aabbs[0], num, modelToWorld);
+      return world_aabbs;
+    }
+
     void render_mesh_aabbs() {
-      for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
-        mesh_instance *mi = mesh_instances[mesh_index];
-        aabb bb = mi->get_mesh()->get_aabb();
-        bb = bb.get_transform(mi->get_node()->calcModelToWorld());
-        draw_aabb(bb);
+      const dynarray<aabb> &boxes = get_world_aabbs();
+      for (unsigned mesh_index = 0; mesh_index != boxes.size(); ++mesh_index) {
+        draw_aabb(boxes[mesh_index]);
       }
     }
 
@@ -114,7 +183,7 @@ namespace octet {
       for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
         mesh_instance *mi = mesh_instances[mesh_index];
         mesh *msh = mi->get_mesh();
-        mat4t modelToWorld = mi->get_node()->calcModelToWorld();
+        mat4t modelToWorld = mi->get_node()->get_modelToWorld();
         mat4t modelToCamera;
         mat4t modelToProjection;
         cam.get_matrices(modelToProjection, modelToCamera, modelToWorld);
@@ -124,17 +193,23 @@ namespace octet {
         unsigned stride = msh->get_stride();
         bool is_short_index = msh->get_index_type() != GL_UNSIGNED_INT;
 
+        // transform every vertex once, rather than once per index.
+        unsigned num_vertices = msh->get_num_vertices();
+        dynarray<vec4> world_pos(num_vertices);
+        dynarray<vec4> proj_pos(num_vertices);
+        if (num_vertices) {
+          transform_batch::points(&world_pos[0], vp + pos_offset, stride, num_vertices, modelToWorld);
+          transform_batch::points(&proj_pos[0], vp + pos_offset, stride, num_vertices, modelToProjection);
+        }
+
         for (unsigned i = 0; i != msh->get_num_indices(); ++i) {
           unsigned index = is_short_index ? ((uint16_t*)ip)[i] : ((uint32_t*)ip)[i];
           vec3 pos = *(vec3*)(vp + stride * index + pos_offset);
-          vec4 pos1 = pos.xyz1();
-          vec4 world_pos = pos1 * modelToWorld;
-          vec4 proj_pos = pos1 * modelToProjection;
           app_utils::log("%5d i=%5d m=[%9.3f, %9.3f, %9.3f] w=[%9.3f, %9.3f, %9.3f] p=[%9.3f, %9.3f, %9.3f]\n",
             i, index,
             pos.x(), pos.y(), pos.z(),
-            world_pos.x(), world_pos.y(), world_pos.z(),
-            proj_pos.x()/proj_pos.w(), proj_pos.y()/proj_pos.w(), proj_pos.z()/proj_pos.w()
+            world_pos[index].x(), world_pos[index].y(), world_pos[index].z(),
+            proj_pos[index].x()/proj_pos[index].w(), proj_pos[index].y()/proj_pos[index].w(), proj_pos[index].z()/proj_pos[index].w()
           );
         }
 
@@ -170,8 +245,54 @@ namespace octet {
       }
     }
 
+    // the mesh we draw for an instance. skinned meshes are posed on the CPU
+    // if they have too many joints for the skinned shader or cpu_skinning is on.
+    mesh *get_draw_mesh(mesh_instance *mi) {
+      mesh *msh = mi->get_mesh();
+      if (!msh || !mi->get_skeleton() || !msh->get_skin()) return msh;
+      if (cpu_skinning || msh->get_skin()->get_num_joints() > bump_shader::max_skin_matrices) {
+        return mi->get_cpu_skinned_mesh();
+      }
+      return msh;
+    }
+
+    // find the mesh instances that may be on the screen
+    void cull(const frustum &view) {
+      unsigned num = mesh_instances.size();
+      visible.resize(num);
+      if (num == 0) {
+        num_visible = num_culled = 0;
+        return;
+      }
+
+      if (!frustum_culling) {
+        memset(&visible[0], 1, num);
+      } else if (hierarchical_culling) {
+        // walk the scene bvh, which skips whole groups of instances at once
+        get_cull_bvh().cull(view, &visible[0]);
+      } else {
+        view.test_aabbs(&visible[0], &get_world_aabbs()[0], num);
+      }
+
+      num_visible = 0;
+      for (unsigned i = 0; i != num; ++i) {
+        // skinned meshes can move outside their bind pose box, so we always draw them.
+        // the same goes for meshes whose box was never computed (see mesh::has_aabb()).
+        mesh_instance *mi = mesh_instances[i];
+        mesh *msh = mi ? mi->get_mesh() : 0;
+        if (!visible[i] && msh && (!msh->has_aabb() || (mi->get_skeleton() && msh->get_skin()))) {
+          visible[i] = 1;
+        }
+        num_visible += visible[i];
+      }
+      num_culled = num - num_visible;
+    }
+
     void render_impl(bump_shader &object_shader, bump_shader &skin_shader, camera_instance &cam, float aspect_ratio) {
-      mat4t cameraToWorld = cam.get_node()->calcModelToWorld();
+      // catch anything that moved since update()
+      update_transforms();
+
+      mat4t cameraToWorld = cam.get_node()->get_modelToWorld();
 
       mat4t worldToCamera;
       cameraToWorld.invertQuick(worldToCamera);
@@ -181,36 +302,24 @@ namespace octet {
       cam.set_cameraToWorld(cameraToWorld, aspect_ratio);
       mat4t cameraToProjection = cam.get_cameraToProjection();
 
+      // skip the instances that are off the screen
+      cull(frustum(worldToCamera * cameraToProjection));
+
       draw_debug_data(object_shader, cam);
 
+      // sort the visible instances by shader, material, mesh and depth to save state changes
+      queue.reset(cam.get_farVal());
       for (unsigned mesh_index = 0; mesh_index != mesh_instances.size(); ++mesh_index) {
+        if (!visible[mesh_index]) continue;
+
         mesh_instance *mi = mesh_instances[mesh_index];
-        mesh *msh = mi->get_mesh();
-        skin *skn = msh->get_skin();
+        const mat4t &modelToWorld = mi->get_node()->get_modelToWorld();
+        float depth = -(modelToWorld.w() * worldToCamera).z();
         skeleton *skel = mi->get_skeleton();
-        material *mat = mi->get_material();
-
-        mat4t modelToWorld = mi->get_node()->calcModelToWorld();
-        mat4t modelToCamera;
-        mat4t modelToProjection;
-        cam.get_matrices(modelToProjection, modelToCamera, modelToWorld);
-
-        if (!skel || !skn) {
-          // normal rendering for single matrix objects
-          // build a projection matrix: model -> world -> camera_instance -> projection
-          // the projection space is the cube -1 <= x/w, y/w, z/w <= 1
-          mat->render(object_shader, modelToProjection, modelToCamera, light_uniforms, num_light_uniforms, num_lights);
-        } else {
-          // multi-matrix rendering
-          mat4t *transforms = skel->calc_transforms(modelToCamera, skn);
-          int num_bones = skel->get_num_bones();
-          assert(num_bones < 64);
-          mat->render_skinned(skin_shader, cameraToProjection, transforms, num_bones, light_uniforms, num_light_uniforms, num_lights);
-        }
-        msh->enable_attributes();
-        msh->draw();
-        msh->disable_attributes();
+        mesh *msh = get_draw_mesh(mi);
+        queue.add(msh, mi->get_material(), &modelToWorld, msh == mi->get_mesh() ? skel : 0, depth);
       }
+      queue.render(object_shader, skin_shader, cam, light_uniforms, num_light_uniforms, num_lights);
       frame_number++;
     }
   public:
@@ -219,6 +328,15 @@ namespace octet {
     // create an empty scene
     scene() {
       frame_number = 0;
+      bvh_frame = -1;
+      bvh_version = 0;
+      cull_bvh_frame = -1;
+      cull_bvh_version = 0;
+      use_flat_transforms = false;
+      frustum_culling = true;
+      hierarchical_culling = false;
+      cpu_skinning = false;
+      num_visible = num_culled = 0;
       num_light_uniforms = 0;
       num_lights = 0;
       render_aabbs = false;
@@ -326,6 +444,43 @@ namespace octet {
       return (scene_node*)this;
     }
 
+    // update every world matrix in one linear sweep instead of walking the dirty branches.
+    // this is quicker when most of the nodes move every frame, eg. big animated skeletons.
+    void set_flat_transforms(bool value) {
+      use_flat_transforms = value;
+    }
+
+    // don't draw mesh instances that are off the screen (on by default)
+    void set_frustum_culling(bool value) {
+      frustum_culling = value;
+    }
+
+    // cull with the scene bvh, which is quicker for big scenes with lots of instances off the screen
+    void set_hierarchical_culling(bool value) {
+      hierarchical_culling = value;
+    }
+
+    // pose all skinned meshes on the CPU (see skinned_mesh). ray casts then see the pose too.
+    // skins with more than bump_shader::max_skin_matrices joints are always done on the CPU.
+    void set_cpu_skinning(bool value) {
+      cpu_skinning = value;
+    }
+
+    // mesh instances drawn in the last render()
+    unsigned get_num_visible_instances() const {
+      return num_visible;
+    }
+
+    // mesh instances skipped by frustum culling in the last render()
+    unsigned get_num_culled_instances() const {
+      return num_culled;
+    }
+
+    // the draws of the last render(), eg. for get_num_draw_calls() and get_num_state_changes()
+    render_queue &get_render_queue() {
+      return queue;
+    }
+
     // debugging aid to draw boxes around objects
     void set_render_aabbs(bool value) {
       render_aabbs = value;
@@ -357,17 +512,18 @@ namespace octet {
     }
 
     // advance all the animation instances
+    // instances on the same targets are blended by weight (see animation_mixer).
     // note that we want to update before rendering or doing physics and AI actions.
     void update(float delta_time) {
-      for (int idx = 0; idx != animation_instances.size(); ++idx) {
-        animation_instance *inst = animation_instances[idx];
-        inst->update(delta_time);
-      }
+      mixer.update(animation_instances, delta_time);
 
       for (int idx = 0; idx != mesh_instances.size(); ++idx) {
         mesh_instance *inst = mesh_instances[idx];
         inst->update(delta_time);
       }
+
+      // one pass over the nodes that the animations (or anything else) have moved
+      update_transforms();
     }
 
     // call OpenGL to draw all the mesh instances (scene_node + mesh + material)
@@ -376,15 +532,18 @@ namespace octet {
     }
 
     // play an animation on another target (not the same one as in the collada file)
-    void play(animation *anim, resource *target, bool is_looping) {
+    // use the instance's fade() or set_weight() to blend it with others.
+    animation_instance *play(animation *anim, resource *target, bool is_looping) {
       animation_instance *inst = new animation_instance(anim, target, is_looping);
       animation_instances.push_back(inst);
+      return inst;
     }
 
     // play an animation with built-in targets (as in the collada file)
-    void play(animation *anim, bool is_looping) {
+    animation_instance *play(animation *anim, bool is_looping) {
       animation_instance *inst = new animation_instance(anim, NULL, is_looping);
       animation_instances.push_back(inst);
+      return inst;
     }
 
     // find a mesh instance for a node
@@ -398,52 +557,81 @@ namespace octet {
       return NULL;
     }
 
-    // get the approximate size of the scene, not including lights or cameras
-    aabb get_world_aabb() {
-      aabb world_aabb;
-      bool first = true;
-      for (int i = 0; i != mesh_instances.size(); ++i) {
+    // refit a tree to where the mesh instances are now
+    void update_bvh(scene_bvh &tree, bool with_triangles) {
+      update_transforms();
+      unsigned num = mesh_instances.size();
+      instance_meshes.resize(num);
+      instance_modelToWorld.resize(num);
+      mesh **meshes = num ? &instance_meshes[0] : 0;
+      mat4t *modelToWorld = num ? &instance_modelToWorld[0] : 0;
+      for (unsigned i = 0; i != num; ++i) {
         mesh_instance *mi = mesh_instances[i];
-        if (mi && mi->get_node()) {
-          mat4t nodeToWorld = mi->get_node()->calcModelToWorld();
-          aabb bb = mi->get_mesh()->get_aabb();
-          bb = bb.get_transform(nodeToWorld);
-          if (first) {
-            world_aabb = bb;
-            first = false;
-          } else {
-            world_aabb = world_aabb.get_union(bb);
-          }
+        bool valid = mi && mi->get_node();
+        // culling draws skinned meshes anyway, so their bind pose box will do
+        meshes[i] = !valid ? 0 : with_triangles ? get_draw_mesh(mi) : mi->get_mesh();
+        if (valid) {
+          modelToWorld[i] = mi->get_node()->get_modelToWorld();
+        } else {
+          modelToWorld[i].loadIdentity();
         }
       }
-      return world_aabb;
+      if (with_triangles) {
+        tree.update(meshes, modelToWorld, num);
+      } else {
+        tree.update_bounds(meshes, modelToWorld, num);
+      }
+    }
+
+    // refit a tree if any node has moved, instances were added or a frame was drawn
+    void refresh_bvh(scene_bvh &tree, int &tree_frame, unsigned &tree_version, bool with_triangles) {
+      unsigned num = mesh_instances.size();
+      unsigned version = scene_node::get_transform_version();
+      if (tree_frame != frame_number || tree_version != version || tree.get_num_instances() != num) {
+        update_bvh(tree, with_triangles);
+        tree_frame = frame_number;
+        tree_version = version;
+      }
+    }
+
+    // the tree of mesh instances used for ray casts.
+    // this is refitted when nodes move, at most once a frame otherwise.
+    scene_bvh &get_bvh() {
+      refresh_bvh(bvh, bvh_frame, bvh_version, true);
+      return bvh;
+    }
+
+    // the tree of mesh instance boxes used for hierarchical culling.
+    // this uses mesh::get_aabb(), so no triangle trees are built.
+    scene_bvh &get_cull_bvh() {
+      refresh_bvh(cull_bvh, cull_bvh_frame, cull_bvh_version, false);
+      return cull_bvh;
+    }
+
+    // get the approximate size of the scene, not including lights or cameras.
+    // this uses the mesh boxes, so no triangle trees are built.
+    aabb get_world_aabb() {
+      return get_cull_bvh().get_aabb();
     }
 
     struct cast_result {
       mesh_instance *mi;
       rational depth;
+      int triangle;
     };
 
-    // brute force & ignorance ray cast.
-    // return the mesh instance and location of hits.
-    // todo: build a kd tree for mesh instance bbs & mesh triangles
+    // find the nearest triangle on the ray.
+    // return the mesh instance, the triangle and the fraction of the way along the ray.
     void cast_ray(cast_result &result, const ray &the_ray) {
       result.mi = 0;
       result.depth = rational(0, 0);
+      result.triangle = -1;
 
-      for (int i = 0; i != mesh_instances.size(); ++i) {
-        mesh_instance *mi = mesh_instances[i];
-        if (mi && mi->get_node()) {
-          mat4t nodeToWorld = mi->get_node()->calcModelToWorld();
-          aabb bb = mi->get_mesh()->get_aabb();
-          bb = bb.get_transform(nodeToWorld);
-          if (the_ray.intersects(bb)) {
-            //rational depth = the_ray.intersection(bb);
-            result.mi = mi;
-            //static int i;
-            //printf("%d hit\n", i++);
-          }
-        }
+      scene_bvh::hit h;
+      if (get_bvh().closest_hit(h, the_ray)) {
+        result.mi = mesh_instances[h.instance];
+        result.depth = rational(h.t, 1);
+        result.triangle = h.triangle;
       }
     }
 
@@ -0,0 +1,431 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Two level bounding volume hierarchy for a set of mesh instances
+//
+// The top level is a tree of the instances' world space boxes. Each leaf points
+// to a mesh_bvh (the bottom level) for the triangles of that mesh, which is
+// built once per mesh and shared by all the instances of it.
+//
+// Call update() when things move. This refits the boxes of the top level tree
+// in place, which is cheap, and only rebuilds it if the tree has got much worse
+// than when it was built.
+//
+// example:
+//
+//   scene_bvh bvh;
+//   bvh.update(meshes, modelToWorld, num_instances);
+//
+//   scene_bvh::hit h;
+//   if (bvh.closest_hit(h, the_ray)) {
+//     printf("instance %d triangle %d\n", h.instance, h.triangle);
+//   }
+//
+// Rays that start together and point the same way, like camera rays, are
+// quicker to trace in packets of four or eight:
+//
+//   ray_packet<8> packet;
+//   ... packet.set(lane, ray) for each lane ...
+//   bvh.closest_hit(packet);
+//
+// A mesh's bvh is built the first time we see the mesh. If you change the
+// positions of a mesh, call invalidate() on it.
+//
+// For frustum culling only, update_bounds() uses each mesh's get_aabb() for the
+// leaves and builds no triangle trees. Ray casts then hit nothing.
+//
+
+namespace octet {
+  class scene_bvh {
+  public:
+    // where a ray hit a triangle of an instance
+    struct hit {
+      float t;       // distance along the ray
+      float u, v;    // barycentrics in the triangle
+      int triangle;  // index of the triangle in the mesh
+      int instance;  // index of the instance, -1 if no hit
+    };
+
+  private:
+    typedef bvh_builder::node node;
+    typedef bvh_builder::bounds bounds;
+
+    // top level tree, one instance per leaf
+    dynarray<node> nodes;
+    dynarray<unsigned> order;
+
+    // per instance
+    dynarray<bounds> world_bounds;
+    dynarray<mat4t> worldToModel;
+    dynarray<mesh_bvh*> instance_bvhs;
+    dynarray<uint8_t> is_empty;   // no mesh or no triangles: never hit or visible
+
+    // scratch for update(), kept so that refits don't allocate
+    dynarray<aabb> model_aabbs;
+    dynarray<aabb> world_aabbs;
+
+    // bottom level trees, one per mesh. we keep the meshes alive so that the pointers stay unique.
+    hash_map<mesh*, mesh_bvh*> mesh_bvhs;
+    dynarray<ref<mesh> > meshes;
+
+    // skinned_mesh::get_version() + 1 of each skinned mesh when its tree was built
+    hash_map<mesh*, unsigned> skinned_versions;
+
+    // cost of the tree when we last built it
+    float built_cost;
+
+    // rebuild when the refitted tree costs this much more than the new one did
+    float rebuild_ratio;
+
+    unsigned num_rebuilds;
+
+    scene_bvh(const scene_bvh &rhs) {
+      // you can't do this!
+    }
+
+    template <bool any> bool traverse(hit &result, const vec3 &origin, const vec3 &dir, float tmax) const {
+      result.instance = -1;
+      result.triangle = -1;
+      result.t = tmax;
+      if (nodes.size() == 0) return false;
+
+      vec3 inv_dir(1.0f / dir.x(), 1.0f / dir.y(), 1.0f / dir.z());
+      unsigned stack[bvh_builder::max_depth + 1];
+      unsigned sp = 0;
+      float tnear;
+      if (!bvh_builder::hit_node(nodes[0], origin, inv_dir, tmax, tnear)) return false;
+      stack[sp++] = 0;
+
+      while (sp) {
+        const node &n = nodes[stack[--sp]];
+        if (n.count) {
+          for (unsigned i = n.first; i != n.first + n.count; ++i) {
+            unsigned inst = order[i];
+            mesh_bvh *bvh = instance_bvhs[inst];
+            if (!bvh) continue;
+
+            // t is the same in model space if we transform the direction too.
+            const mat4t &m = worldToModel[inst];
+            vec3 model_origin = (vec4(origin, 1) * m).xyz();
+            vec3 model_dir = (vec4(dir, 0) * m).xyz();
+            mesh_bvh::hit h;
+            if (any ? bvh->any_hit(h, model_origin, model_dir, result.t) : bvh->closest_hit(h, model_origin, model_dir, result.t)) {
+              result.t = h.t;
+              result.u = h.u;
+              result.v = h.v;
+              result.triangle = h.triangle;
+              result.instance = (int)inst;
+              if (any) return true;
+            }
+          }
+        } else {
+          // visit the nearer child first
+          float ta, tb;
+          bool hit_a = bvh_builder::hit_node(nodes[n.first], origin, inv_dir, result.t, ta);
+          bool hit_b = bvh_builder::hit_node(nodes[n.first + 1], origin, inv_dir, result.t, tb);
+          if (hit_a && hit_b) {
+            bool a_first = ta <= tb;
+            stack[sp++] = a_first ? n.first + 1 : n.first;
+            stack[sp++] = a_first ? n.first : n.first + 1;
+          } else if (hit_a) {
+            stack[sp++] = n.first;
+          } else if (hit_b) {
+            stack[sp++] = n.first + 1;
+          }
+        }
+      }
+      return result.instance != -1;
+    }
+
+    // the same for a packet of rays. a box is visited if any live lane hits it.
+    template <int N> unsigned traverse_packet(ray_packet<N> &packet) const {
+      if (nodes.size() == 0) return 0;
+
+      unsigned stack[bvh_builder::max_depth + 1];
+      unsigned sp = 0;
+      float tnear[N];
+      if (!packet.hit_box(nodes[0].min, nodes[0].max, tnear)) return 0;
+      stack[sp++] = 0;
+
+      unsigned hits = 0;
+      ray_packet<N> model;
+      while (sp) {
+        const node &n = nodes[stack[--sp]];
+        if (n.count) {
+          for (unsigned i = n.first; i != n.first + n.count; ++i) {
+            unsigned inst = order[i];
+            mesh_bvh *bvh = instance_bvhs[inst];
+            if (!bvh) continue;
+
+            packet.transform(model, worldToModel[inst]);
+            unsigned h = bvh->closest_hit(model);
+            for (int lane = 0; lane != N; ++lane) {
+              if (h & (1 << lane)) {
+                packet.t[lane] = model.t[lane];
+                packet.u[lane] = model.u[lane];
+                packet.v[lane] = model.v[lane];
+                packet.triangle[lane] = model.triangle[lane];
+                packet.instance[lane] = (int)inst;
+              }
+            }
+            hits |= h;
+          }
+        } else {
+          float ta[N], tb[N];
+          unsigned hit_a = packet.hit_box(nodes[n.first].min, nodes[n.first].max, ta);
+          unsigned hit_b = packet.hit_box(nodes[n.first + 1].min, nodes[n.first + 1].max, tb);
+          if (hit_a && hit_b) {
+            unsigned both = hit_a & hit_b;
+            unsigned lane = 0;
+            while (both && !(both & (1 << lane))) ++lane;
+            bool a_first = both ? ta[lane] <= tb[lane] : true;
+            stack[sp++] = a_first ? n.first + 1 : n.first;
+            stack[sp++] = a_first ? n.first : n.first + 1;
+          } else if (hit_a) {
+            stack[sp++] = n.first;
+          } else if (hit_b) {
+            stack[sp++] = n.first + 1;
+          }
+        }
+      }
+      return hits;
+    }
+
+    // with_triangles also builds the triangle trees for ray casts
+    void update_impl(mesh *const *instance_meshes, const mat4t *modelToWorld, unsigned num_instances, bool with_triangles) {
+      bool changed = num_instances != world_bounds.size();
+      world_bounds.resize(num_instances);
+      worldToModel.resize(num_instances);
+      instance_bvhs.resize(num_instances);
+      is_empty.resize(num_instances);
+      if (num_instances == 0) {
+        nodes.reset();
+        order.reset();
+        return;
+      }
+
+      model_aabbs.resize(num_instances);
+      world_aabbs.resize(num_instances);
+      for (unsigned i = 0; i != num_instances; ++i) {
+        mesh *msh = instance_meshes[i];
+        mesh_bvh *bvh = 0;
+        bool empty = !msh || msh->get_num_vertices() == 0;
+        if (!empty && with_triangles) {
+          bvh = get_mesh_bvh(msh);
+          empty = bvh->get_num_triangles() == 0;
+        }
+
+        instance_bvhs[i] = empty ? 0 : bvh;
+        is_empty[i] = empty;
+        if (!empty) {
+          model_aabbs[i] = bvh ? bvh->get_aabb() : msh->get_aabb();
+          if (with_triangles) {
+            worldToModel[i] = modelToWorld[i].inverse4x4();
+          } else {
+            worldToModel[i].loadIdentity();
+          }
+        } else {
+          model_aabbs[i] = aabb();
+          worldToModel[i].loadIdentity();
+        }
+      }
+      transform_batch::aabbs(&world_aabbs[0], &model_aabbs[0], num_instances, modelToWorld);
+
+      for (unsigned i = 0; i != num_instances; ++i) {
+        if (!is_empty[i]) {
+          world_bounds[i].min = world_aabbs[i].get_min();
+          world_bounds[i].max = world_aabbs[i].get_max();
+        } else {
+          // empty instances are a point at their origin, so they don't stretch the tree
+          world_bounds[i].min = world_bounds[i].max = modelToWorld[i].w().xyz();
+        }
+      }
+
+      if (changed || nodes.size() == 0) {
+        rebuild();
+      } else {
+        bvh_builder::refit(nodes, order, &world_bounds[0]);
+        if (bvh_builder::get_cost(nodes) > built_cost * rebuild_ratio) {
+          rebuild();
+        }
+      }
+    }
+
+    void rebuild() {
+      bvh_builder builder;
+      builder.build(nodes, order, world_bounds.size() ? &world_bounds[0] : 0, world_bounds.size(), 1);
+      built_cost = bvh_builder::get_cost(nodes);
+      num_rebuilds++;
+    }
+
+  public:
+    scene_bvh() {
+      built_cost = 0;
+      rebuild_ratio = 1.5f;
+      num_rebuilds = 0;
+    }
+
+    ~scene_bvh() {
+      reset();
+    }
+
+    // throw away all the trees
+    void reset() {
+      for (unsigned i = 0; i != mesh_bvhs.capacity(); ++i) {
+        if (mesh_bvhs.is_used(i)) {
+          delete mesh_bvhs.value(i);
+        }
+      }
+      mesh_bvhs.clear();
+      skinned_versions.clear();
+      meshes.reset();
+      nodes.reset();
+      order.reset();
+      world_bounds.reset();
+      worldToModel.reset();
+      instance_bvhs.reset();
+      is_empty.reset();
+    }
+
+    // the bottom level tree for a mesh, built if we have not seen the mesh before.
+    mesh_bvh *get_mesh_bvh(mesh *msh) {
+      mesh_bvh *&bvh = mesh_bvhs[msh];
+      if (!bvh) {
+        bvh = new mesh_bvh();
+        bvh->init(msh);
+        meshes.push_back(msh);
+      }
+
+      // skinned meshes move their vertices when they are posed
+      skinned_mesh *posed = msh->get_skinned_mesh();
+      if (posed) {
+        unsigned &version = skinned_versions[msh];
+        if (version != posed->get_version() + 1) {
+          if (version != 0) bvh->init(msh);
+          version = posed->get_version() + 1;
+        }
+      }
+      return bvh;
+    }
+
+    // call this if the positions of a mesh have changed
+    void invalidate(mesh *msh) {
+      if (mesh_bvhs.contains(msh)) {
+        mesh_bvh *bvh = mesh_bvhs[msh];
+        bvh->init(msh);
+      }
+    }
+
+    // set the instances (which may be null) and where they are.
+    // refits the top level tree, or rebuilds it if the number of instances has changed
+    // or the refitted tree is too slow.
+    void update(mesh *const *instance_meshes, const mat4t *modelToWorld, unsigned num_instances) {
+      update_impl(instance_meshes, modelToWorld, num_instances, true);
+    }
+
+    // same, but the leaves are the meshes' own boxes (mesh::get_aabb()) and no
+    // triangle trees are built. enough for cull(), but ray casts will not hit anything.
+    void update_bounds(mesh *const *instance_meshes, const mat4t *modelToWorld, unsigned num_instances) {
+      update_impl(instance_meshes, modelToWorld, num_instances, false);
+    }
+
+    // find the nearest triangle hit by origin + dir * t for 0 <= t < tmax
+    bool closest_hit(hit &result, const vec3 &origin, const vec3 &dir, float tmax) const {
+      return traverse<false>(result, origin, dir, tmax);
+    }
+
+    // find any triangle hit by origin + dir * t (eg. for shadows)
+    bool any_hit(hit &result, const vec3 &origin, const vec3 &dir, float tmax) const {
+      return traverse<true>(result, origin, dir, tmax);
+    }
+
+    // ray versions: t is 0 at the start of the ray and 1 at the end.
+    bool closest_hit(hit &result, const ray &the_ray) const {
+      return traverse<false>(result, the_ray.get_origin(), the_ray.get_distance(), 1.0f);
+    }
+
+    bool any_hit(hit &result, const ray &the_ray) const {
+      return traverse<true>(result, the_ray.get_origin(), the_ray.get_distance(), 1.0f);
+    }
+
+    // trace four or eight rays at once (see ray_packet). lanes that hit something nearer
+    // than their t get t, u, v, triangle and instance. returns one bit for each lane that hit.
+    template <int N> unsigned closest_hit(ray_packet<N> &packet) const {
+      packet.finish();
+      return traverse_packet(packet);
+    }
+
+    // set visible[i] to 1 for instances that may be in the frustum and 0 for the others.
+    // whole branches of the tree are dropped, or accepted without testing their instances.
+    // empty instances are never visible. returns the number of visible instances.
+    unsigned cull(const frustum &view, uint8_t *visible) const {
+      unsigned num_instances = world_bounds.size();
+      memset(visible, 0, num_instances);
+      if (nodes.size() == 0) return 0;
+
+      // (node, inside) pairs: inside nodes need no more tests
+      unsigned stack[bvh_builder::max_depth + 1];
+      bool inside_stack[bvh_builder::max_depth + 1];
+      unsigned sp = 0;
+      stack[sp] = 0;
+      inside_stack[sp++] = false;
+      unsigned num_visible = 0;
+      while (sp) {
+        --sp;
+        const node &n = nodes[stack[sp]];
+        bool inside = inside_stack[sp];
+        if (!inside) {
+          int c = view.classify(n.min, n.max);
+          if (c == frustum::outside) continue;
+          inside = c == frustum::inside;
+        }
+        if (n.count) {
+          for (unsigned i = n.first; i != n.first + n.count; ++i) {
+            unsigned inst = order[i];
+            if (is_empty[inst]) continue;
+            if (inside || view.classify(&world_bounds[inst].min[0], &world_bounds[inst].max[0]) != frustum::outside) {
+              visible[inst] = 1;
+              num_visible++;
+            }
+          }
+        } else {
+          stack[sp] = n.first;
+          inside_stack[sp++] = inside;
+          stack[sp] = n.first + 1;
+          inside_stack[sp++] = inside;
+        }
+      }
+      return num_visible;
+    }
+
+    // world space box of every instance
+    aabb get_aabb() const {
+      if (nodes.size() == 0) return aabb();
+      bounds b = bvh_builder::get_bounds(nodes[0]);
+      return aabb((b.min + b.max) * 0.5f, (b.max - b.min) * 0.5f);
+    }
+
+    // world space box of one instance
+    aabb get_instance_aabb(unsigned index) const {
+      const bounds &b = world_bounds[index];
+      return aabb((b.min + b.max) * 0.5f, (b.max - b.min) * 0.5f);
+    }
+
+    unsigned get_num_instances() const {
+      return world_bounds.size();
+    }
+
+    // how many times we have built the top level tree (for tuning)
+    unsigned get_num_rebuilds() const {
+      return num_rebuilds;
+    }
+
+    // rebuild when the refitted tree costs this many times more than the new one did
+    void set_rebuild_ratio(float value) {
+      rebuild_ratio = value;
+    }
+  };
+}
@@ -6,6 +6,17 @@
 //
 // Scene Node
 //
+// Each node keeps a cached modelToWorld matrix. Changing a node with access_nodeToParent()
+// marks it dirty (and its parents as having dirty children), then one top-down pass of
+// update_world_matrices() on the root recalculates only the branches that changed.
+// scene calls this for you in update(), so get_modelToWorld() is just a read.
+//
+// example:
+//
+//   node->access_nodeToParent().rotateY(1);
+//   the_scene->update(1.0f/30);
+//   mat4t modelToWorld = node->get_modelToWorld();
+//
 
 namespace octet {
   class scene_node : public resource {
@@ -19,6 +30,27 @@ namespace octet {
     // array of relative transforms (indexed by scene_node index)
     mat4t nodeToParent;
 
+    // nodeToParent * parent's modelToWorld, as of the last update_world_matrices()
+    mat4t modelToWorld;
+
+    // our modelToWorld needs recalculating
+    bool is_dirty;
+
+    // some node below us is dirty
+    bool has_dirty_children;
+
+    // goes up whenever any tree of nodes changes shape (see transform_hierarchy)
+    static unsigned &hierarchy_version() {
+      static unsigned value = 0;
+      return value;
+    }
+
+    // goes up whenever any node is moved or added (see scene::get_bvh)
+    static unsigned &transform_version() {
+      static unsigned value = 0;
+      return value;
+    }
+
     // sid used to target animations
     atom_t sid;
   public:
@@ -26,12 +58,16 @@ namespace octet {
 
     scene_node() {
       nodeToParent.loadIdentity();
+      modelToWorld.loadIdentity();
       sid = atom_;
+      is_dirty = has_dirty_children = true;
     }
 
     scene_node(const mat4t &nodeToParent, atom_t sid) {
       this->nodeToParent = nodeToParent;
       this->sid = sid;
+      modelToWorld = nodeToParent;
+      is_dirty = has_dirty_children = true;
     }
 
     // the virtual add_ref on animation_target gets passed to here and we pass iton (delegate it) to the resource
@@ -48,6 +84,7 @@ namespace octet {
     void set_value(atom_t sid, atom_t sub_target, atom_t component, float *value) {
       if (sub_target == atom_transform) {
         nodeToParent.init_transpose(value);
+        set_dirty();
       }
     }
 
@@ -62,11 +99,16 @@ namespace octet {
       app_utils::log("visit scene_node nodeToParent\n");
       v.visit(nodeToParent, atom_nodeToParent);
       v.visit(sid, atom_sid);
+      is_dirty = has_dirty_children = true;
+      hierarchy_version()++;
+      transform_version()++;
     }
 
     void add_child(scene_node *new_node) {
       new_node->parent = this;
       children.push_back(new_node);
+      new_node->set_dirty();
+      hierarchy_version()++;
     }
 
     scene_node *get_parent() {
@@ -81,7 +123,8 @@ namespace octet {
       return children[index];
     }
 
-    // compute the scene_node to world matrix for an individual scene_node;
+    // compute the scene_node to world matrix for an individual scene_node by walking to the root.
+    // use get_modelToWorld() for nodes in a scene, which is much cheaper.
     mat4t calcModelToWorld() {
       mat4t result = nodeToParent;
       for (scene_node *p = parent; p != NULL; p = p->parent) {
@@ -94,10 +137,81 @@ namespace octet {
       return nodeToParent;
     }
 
+    // use this to change the matrix. this marks the node dirty, so call it again
+    // if you keep the reference and change the matrix later.
     mat4t &access_nodeToParent() {
+      set_dirty();
       return nodeToParent;
     }
 
+    // cached node to world matrix, up to date after update_world_matrices() on the root
+    const mat4t &get_modelToWorld() const {
+      return modelToWorld;
+    }
+
+    // true if this node or any node below it needs update_world_matrices()
+    bool is_tree_dirty() const {
+      return is_dirty || has_dirty_children;
+    }
+
+    // used by transform_hierarchy, which calculates modelToWorld for all the nodes at once
+    void set_modelToWorld(const mat4t &value) {
+      modelToWorld = value;
+      is_dirty = has_dirty_children = false;
+    }
+
+    // changes every time a child is added to any node
+    static unsigned get_hierarchy_version() {
+      return hierarchy_version();
+    }
+
+    // changes every time any node is marked dirty, so world matrices may have changed
+    static unsigned get_transform_version() {
+      return transform_version();
+    }
+
+    // our modelToWorld (and our children's) needs recalculating.
+    // tell the parents so that update_world_matrices() can find us.
+    void set_dirty() {
+      is_dirty = true;
+      transform_version()++;
+      for (scene_node *p = parent; p != NULL && !p->has_dirty_children; p = p->parent) {
+        p->has_dirty_children = true;
+      }
+    }
+
+    // recalculate modelToWorld for every dirty node below this one (usually the root)
+    // and everything below those. clean branches are skipped.
+    void update_world_matrices() {
+      if (!is_dirty && !has_dirty_children) return;
+
+      // (node, parent changed) pairs
+      dynarray<scene_node*> stack;
+      dynarray<bool> changed_stack;
+      stack.reserve(64);
+      changed_stack.reserve(64);
+      stack.push_back(this);
+      changed_stack.push_back(false);
+      while (!stack.is_empty()) {
+        scene_node *node = stack.back();
+        bool changed = changed_stack.back();
+        stack.pop_back();
+        changed_stack.pop_back();
+        if (changed || node->is_dirty) {
+          node->modelToWorld = node->parent ? node->nodeToParent * node->parent->modelToWorld : node->nodeToParent;
+          node->is_dirty = false;
+          changed = true;
+        }
+        if (changed || node->has_dirty_children) {
+          node->has_dirty_children = false;
+          for (int i = 0; i != node->children.size(); ++i) {
+            stack.push_back(node->children[i]);
+            changed_stack.push_back(changed);
+          }
+        }
+      }
+    }
+
     atom_t get_sid() {
       return sid;
     }
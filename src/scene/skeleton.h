@@ -10,20 +10,105 @@
 
 namespace octet {
   class skeleton : public resource {
-    // skeleton components
+    // skeleton components, one entry per bone in each array
     dynarray<mat4t> nodeToParents;
     dynarray<atom_t> joints;
     dynarray<ref<scene_node> > nodes;
     dynarray<int> parents;
-    dynarray<mat4t> boneToNode;
+
+    // bone index + 1 for each joint sid (built when needed)
+    hash_map<int, int> joint_index;
+    unsigned num_indexed_joints;
 
     // cached skin components
     dynarray<mat4t> result;  /// uniforms to shader
     dynarray<int> indices;   /// map skeleton to skin indices
+
+    // modelToBind * bindToModel[i] for each joint of bound_skin.
+    // we hold the skin so its address can't be reused by another one.
+    dynarray<mat4t> jointToBones;
+    ref<skin> bound_skin;
+    unsigned bound_version;
+    unsigned bound_bones;
+    unsigned bound_joints;
+
+    // bone -> camera for the last calc_transforms()
+    dynarray<mat4t> boneToNode;
+
+    // a batch for calc_transforms(jobs, num_jobs)
+    struct batch {
+      skeleton **skeletons;
+      const mat4t *modelToCamera;
+      skin **skins;
+    };
+
+    static void calc_batch_item(void *context, unsigned index) {
+      batch *b = (batch*)context;
+      b->skeletons[index]->calc_palette(b->modelToCamera[index]);
+    }
+
+    // match the joints of the skin to our bones and combine the bind matrices.
+    // only done when the skin or the bones change, not every frame.
+    // this allocates, so calc_palette() can run on the worker threads.
+    void bind(skin *skn) {
+      unsigned num_bones = nodeToParents.size();
+      unsigned num_joints = skn->get_num_joints();
+      if (skn == bound_skin && skn->get_version() == bound_version && num_bones == bound_bones) return;
+
+      boneToNode.resize(num_bones);
+      result.resize(num_joints);
+      indices.resize(num_joints);
+      jointToBones.resize(num_joints);
+      for (unsigned i = 0; i != num_joints; ++i) {
+        // skin -> bind space -> skeleton
+        indices[i] = find_joint(skn->get_joint(i));
+        jointToBones[i] = skn->get_modelToBind() * skn->get_bindToModel(i);
+      }
+      bound_skin = skn;
+      bound_version = skn->get_version();
+      bound_bones = num_bones;
+      bound_joints = num_joints;
+    }
+
+    // the work of calc_transforms after bind()
+    void calc_palette(const mat4t &modelToCamera) {
+      unsigned num_bones = bound_bones;
+
+      // todo: optionally drive animation directly to the skeleton.
+      for (unsigned i = 0; i != num_bones; ++i) {
+        nodeToParents[i] = nodes[i]->get_nodeToParent();
+      }
+
+      // compute matrix heirachy. parents come before their children.
+      if (num_bones == 0) return;
+      const int *parent = &parents[0];
+      const mat4t *local = &nodeToParents[0];
+      mat4t *bone = &boneToNode[0];
+      for (unsigned i = 0; i != num_bones; ++i) {
+        // skeleton -> parent -> parent -> world -> camera
+        bone[i] = local[i] * (parent[i] == -1 ? modelToCamera : bone[parent[i]]);
+      }
+
+      // premultiply by the combined skin matrices
+      unsigned num_joints = bound_joints;
+      if (num_joints == 0) return;
+      const int *index = &indices[0];
+      const mat4t *jointToBone = &jointToBones[0];
+      mat4t *dest = &result[0];
+      for (unsigned i = 0; i != num_joints; ++i) {
+        // skin -> bind space -> skeleton -> parent -> parent -> world -> camera
+        dest[i] = index[i] != -1 ? jointToBone[i] * bone[index[i]] : modelToCamera;
+      }
+    }
+
   public:
     RESOURCE_META(skeleton)
 
     skeleton() {
+      bound_version = 0;
+      bound_bones = 0;
+      bound_joints = 0;
+      num_indexed_joints = 0;
     }
 
     void visit(visitor &v) {
@@ -34,6 +119,8 @@ namespace octet {
       v.visit(boneToNode, atom_boneToNode);
       v.visit(result, atom_result);  /// uniforms to shader
       v.visit(indices, atom_indices);   /// map skeleton to skin indices
+      bound_skin = 0;
+      num_indexed_joints = 0;
     }
 
     void add_bone(scene_node *node, int parent) {
@@ -41,74 +128,49 @@ namespace octet {
       nodeToParents.push_back(node->get_nodeToParent());
       joints.push_back(node->get_sid());
       parents.push_back(parent);
-      app_utils::log("skeleton: add_bone %d [%s]\n", node->get_sid(), node->access_nodeToParent().toString());
+      app_utils::log("skeleton: add_bone %d [%s]\n", node->get_sid(), node->get_nodeToParent().toString());
     }
 
     int get_num_bones() const { return nodeToParents.size(); }
 
     int find_joint(atom_t sid) {
-      for (unsigned i = 0; i != joints.size(); ++i) {
-        if (joints[i] == sid) {
-          return i;
+      if (num_indexed_joints != joints.size()) {
+        joint_index.clear();
+        for (unsigned i = 0; i != joints.size(); ++i) {
+          int &value = joint_index[(int)joints[i]];
+          // the first bone with this sid wins, as before
+          if (value == 0) value = (int)i + 1;
         }
+        num_indexed_joints = joints.size();
       }
-      return -1;
+      return joint_index.contains((int)sid) ? joint_index[(int)sid] - 1 : -1;
     }
 
     mat4t *calc_transforms(const mat4t &worldToCamera, skin *skn) {
-      //static bool first_frame = true;
-      if (boneToNode.size() < nodeToParents.size()) {
-        boneToNode.resize(nodeToParents.size());
-      }
-
-      // todo: optionally drive animation directly to the skeleton.
-      for (int i = 0; i != nodes.size(); ++i) {
-        nodeToParents[i] = nodes[i]->access_nodeToParent();
-      }
-
-      // compute matrix heirachy
-      for (int i = 0; i != nodeToParents.size(); ++i) {
-        int parent = parents[i];
-        // skeleton -> parent -> parent -> world -> camera
-        if (parent == -1) {
-          boneToNode[i] = nodeToParents[i] * worldToCamera;
-        } else {
-          boneToNode[i] = nodeToParents[i] * boneToNode[parent];
-        }
-        //app_utils::log("%d %s p=%d\n", i, result[i].toString(), parent);
-      }
-
-      unsigned num_joints = skn->get_num_joints();
-      if (result.size() < num_joints) {
-        result.resize(num_joints);
-        indices.resize(num_joints);
-        for (int i = 0; i != num_joints; ++i) {
-          // skin -> bind space -> skeleton -> parent -> parent -> world -> camera
-          indices[i] = find_joint(skn->get_joint(i));
-        }
-      }
+      bind(skn);
+      calc_palette(worldToCamera);
+      return &result[0];
+    }
 
-      // premultiply by skin matrices
-      for (int i = 0; i != num_joints; ++i) {
-        // skin -> bind space -> skeleton -> parent -> parent -> world -> camera
-        int index = indices[i];
-        if (index != -1) {
-          result[i] = skn->get_modelToBind() * skn->get_bindToModel(i) * boneToNode[index];
-        } else {
-          result[i] = worldToCamera;
-        }
-        //if (first_frame) app_utils::log("%d %d [%s]\n", i, index, result[i].toString());
+    // calc_transforms() for many skeletons at once, shared between the threads of the thread_pool.
+    // each skeleton must only be in the list once. use get_transforms() for the results.
+    static void calc_transforms(skeleton **skeletons, const mat4t *modelToCamera, skin **skins, unsigned num_skeletons) {
+      // binding may allocate, so do it on this thread
+      for (unsigned i = 0; i != num_skeletons; ++i) {
+        skeletons[i]->bind(skins[i]);
       }
+      batch b = { skeletons, modelToCamera, skins };
+      thread_pool::run(calc_batch_item, &b, num_skeletons);
+    }
 
+    // the matrices of the last calc_transforms()
+    mat4t *get_transforms() {
       return &result[0];
     }
 
-    // convert an sid into an index. (should be cached!)
+    // convert an sid into an index.
     int get_bone_index(atom_t sid) {
-      for (int i = 0; i != joints.size(); ++i) {
-        if (joints[i] == sid) return i;
-      }
-      return -1;
+      return find_joint(sid);
     }
 
     void set_bone(int index, const mat4t &value) {
@@ -18,25 +18,32 @@ namespace octet {
     // a name for each joint (sid)
     dynarray<atom_t> joints;
 
+    // changes whenever the joints change, so skeletons know to bind again
+    unsigned version;
+
   public:
     RESOURCE_META(skin)
 
     skin() {
+      version = 0;
     }
 
     skin(const mat4t &modelToBind) {
       this->modelToBind = modelToBind;
+      version = 0;
     }
 
     void visit(visitor &v) {
       v.visit(modelToBind, atom_modelToBind);
       v.visit(bindToModel, atom_bindToModel);
       v.visit(joints, atom_joints);
+      version++;
     }
 
     void add_joint(const mat4t &bindToModel, atom_t sid) {
       this->bindToModel.push_back(bindToModel);
       joints.push_back(sid);
+      version++;
       app_utils::log("skin: add_joint %d\n", sid);
     }
 
@@ -53,6 +60,7 @@ namespace octet {
     const mat4t &get_modelToBind() const { return modelToBind; }
     atom_t get_joint(int i) const { return joints[i]; }
     unsigned get_num_joints() const { return joints.size(); }
+    unsigned get_version() const { return version; }
   };
 
 }
@@ -0,0 +1,260 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// CPU skinning modifier.
+//
+// The skinned bump_shader only has room for a limited number of bone matrices.
+// This modifier poses a skinned mesh on the CPU instead: it blends the positions,
+// normals, tangents and bitangents into its own dynamic vertex buffer, which is
+// drawn like any other mesh with the object shader. There is no limit on the bones.
+//
+// The pose is cached. If no scene_node has moved since last time, update() returns
+// straight away, and if the bone matrices come out the same it does not pose again. Ray casts and the ray tracer can use the posed triangles too.
+//
+// example:
+//
+//   skinned_mesh *posed = new skinned_mesh(msh, skel);
+//   ...
+//   // every frame, after animating
+//   posed->update();
+//
+// The scene does this for you for characters with too many bones (see mesh_instance).
+//
+
+namespace octet {
+  class skinned_mesh : public mesh {
+    // source mesh, which has the skin
+    ref<mesh> src;
+
+    // which skeleton poses it
+    ref<skeleton> skel;
+
+    // bone matrices of the current pose, to see if it has changed
+    dynarray<mat4t> palette;
+
+    // incremented every time the vertices change
+    unsigned version;
+
+    // what the pose was made from: scene_node::get_transform_version() and the versions
+    // of the skin and the source vertices. if these match, the bones can't have moved.
+    unsigned node_version;
+    unsigned skin_version;
+    unsigned src_version;
+    bool is_posed;
+
+    // copy the source, with our own vertex buffer to write to
+    void init_from_source() {
+      share_buffers(*src);
+      gl_resource *vertices = new gl_resource();
+      vertices->copy(src->get_vertices(), GL_DYNAMIC_DRAW);
+      set_vertices(vertices);
+      palette.reset();
+      is_posed = false;
+    }
+
+    // blend the bone matrices for each vertex and transform it.
+    // the weights are (1 - x - y - z, x, y, z) for the four indices, as in the skinned shader.
+    void pose(const mat4t *matrices, unsigned num_matrices) {
+      unsigned pos_slot = get_slot(attribute_pos);
+      unsigned weight_slot = get_slot(attribute_blendweight);
+      unsigned index_slot = get_slot(attribute_blendindices);
+      if (pos_slot == ~0u || weight_slot == ~0u || index_slot == ~0u) return;
+      if (get_kind(pos_slot) != GL_FLOAT || get_kind(weight_slot) != GL_FLOAT || get_kind(index_slot) != GL_FLOAT) return;
+
+      // directions to rotate: normal, tangent and bitangent
+      unsigned dir_offsets[3];
+      unsigned num_dirs = 0;
+      static const unsigned dir_attrs[] = { attribute_normal, attribute_tangent, attribute_bitangent };
+      for (unsigned i = 0; i != 3; ++i) {
+        unsigned slot = get_slot(dir_attrs[i]);
+        if (slot != ~0u && get_kind(slot) == GL_FLOAT && get_size(slot) >= 3) {
+          dir_offsets[num_dirs++] = get_offset(slot);
+        }
+      }
+
+      unsigned stride = get_stride();
+      unsigned pos_offset = get_offset(pos_slot);
+      unsigned weight_offset = get_offset(weight_slot);
+      unsigned index_offset = get_offset(index_slot);
+      unsigned num_weights = min(min(get_size(weight_slot), get_size(index_slot) - 1), 3u);
+
+      const uint8_t *src_bytes = (const uint8_t*)src->get_vertices()->lock_read_only();
+      uint8_t *dest_bytes = (uint8_t*)get_vertices()->lock();
+      #if OCTET_SIMD
+        // each vertex has its own matrices, so we go one vertex at a time with
+        // the four rows of the blended matrix in registers.
+        simd4 vmin = simd_splat(1e37f), vmax = simd_splat(-1e37f);
+        simd4 xyz_mask = simd_cmpne(simd_set(1, 1, 1, 0), simd_zero());
+      #else
+        vec4 vmin(1e37f, 1e37f, 1e37f, 0);
+        vec4 vmax(-1e37f, -1e37f, -1e37f, 0);
+      #endif
+      for (unsigned i = 0; i != get_num_vertices(); ++i) {
+        const uint8_t *sv = src_bytes + i * stride;
+        uint8_t *dv = dest_bytes + i * stride;
+        const float *weights = (const float*)(sv + weight_offset);
+        const float *indices = (const float*)(sv + index_offset);
+
+        // blend the rows of up to four matrices, skipping zero weights
+        float w[4];
+        w[0] = 1.0f;
+        for (unsigned j = 0; j != num_weights; ++j) {
+          w[j+1] = weights[j];
+          w[0] -= weights[j];
+        }
+
+        const float *p = (const float*)(sv + pos_offset);
+        float *dp = (float*)(dv + pos_offset);
+        #if OCTET_SIMD
+          simd4 r0 = simd_zero(), r1 = simd_zero(), r2 = simd_zero(), r3 = simd_zero();
+          for (unsigned j = 0; j <= num_weights; ++j) {
+            if (w[j] == 0) continue;
+            unsigned index = (unsigned)indices[j];
+            const mat4t &m = matrices[index < num_matrices ? index : 0];
+            simd4 wj = simd_splat(w[j]);
+            r0 = simd_add(r0, simd_mul(m[0].get_simd(), wj));
+            r1 = simd_add(r1, simd_mul(m[1].get_simd(), wj));
+            r2 = simd_add(r2, simd_mul(m[2].get_simd(), wj));
+            r3 = simd_add(r3, simd_mul(m[3].get_simd(), wj));
+          }
+
+          simd4 pos = simd_add(simd_add(simd_mul(r0, simd_splat(p[0])), simd_mul(r1, simd_splat(p[1]))), simd_add(simd_mul(r2, simd_splat(p[2])), r3));
+          float pv[4];
+          simd_store(pv, pos);
+          dp[0] = pv[0]; dp[1] = pv[1]; dp[2] = pv[2];
+          vmin = simd_min(vmin, pos);
+          vmax = simd_max(vmax, pos);
+
+          for (unsigned d = 0; d != num_dirs; ++d) {
+            const float *n = (const float*)(sv + dir_offsets[d]);
+            simd4 dir = simd_add(simd_add(simd_mul(r0, simd_splat(n[0])), simd_mul(r1, simd_splat(n[1]))), simd_mul(r2, simd_splat(n[2])));
+            dir = simd_and(dir, xyz_mask);
+            float len2 = simd_get_x(simd_dot(dir, dir));
+            if (len2 > 0) dir = simd_mul(dir, simd_splat(1.0f / sqrtf(len2)));
+            float dv4[4];
+            simd_store(dv4, dir);
+            float *dn = (float*)(dv + dir_offsets[d]);
+            dn[0] = dv4[0]; dn[1] = dv4[1]; dn[2] = dv4[2];
+          }
+        #else
+          vec4 r0(0, 0, 0, 0), r1(0, 0, 0, 0), r2(0, 0, 0, 0), r3(0, 0, 0, 0);
+          for (unsigned j = 0; j <= num_weights; ++j) {
+            if (w[j] == 0) continue;
+            unsigned index = (unsigned)indices[j];
+            const mat4t &m = matrices[index < num_matrices ? index : 0];
+            r0 += m[0] * w[j];
+            r1 += m[1] * w[j];
+            r2 += m[2] * w[j];
+            r3 += m[3] * w[j];
+          }
+
+          vec4 pos = r0 * p[0] + r1 * p[1] + r2 * p[2] + r3;
+          dp[0] = pos[0]; dp[1] = pos[1]; dp[2] = pos[2];
+          vmin = vmin.min(pos);
+          vmax = vmax.max(pos);
+
+          for (unsigned d = 0; d != num_dirs; ++d) {
+            const float *n = (const float*)(sv + dir_offsets[d]);
+            vec3 dir = (r0 * n[0] + r1 * n[1] + r2 * n[2]).xyz();
+            float len2 = dir.squared();
+            if (len2 > 0) dir = dir * (1.0f / sqrtf(len2));
+            float *dn = (float*)(dv + dir_offsets[d]);
+            dn[0] = dir[0]; dn[1] = dir[1]; dn[2] = dir[2];
+          }
+        #endif
+      }
+      src->get_vertices()->unlock_read_only();
+      get_vertices()->unlock();
+
+      if (get_num_vertices()) {
+        #if OCTET_SIMD
+          vec3 lo = vec4(vmin).xyz(), hi = vec4(vmax).xyz();
+        #else
+          vec3 lo = vmin.xyz(), hi = vmax.xyz();
+        #endif
+        set_aabb(aabb((hi + lo) * 0.5f, (hi - lo) * 0.5f));
+      }
+    }
+
+  public:
+    RESOURCE_META(skinned_mesh)
+
+    skinned_mesh(mesh *src=0, skeleton *skel=0) {
+      this->src = src;
+      this->skel = skel;
+      version = 0;
+      node_version = skin_version = src_version = 0;
+      is_posed = false;
+      if (src) init_from_source();
+      update();
+    }
+
+    // pose the vertices, unless the bones have not moved since last time.
+    // this is called several times a frame (drawing, culling, ray casts), so it is
+    // cheap when nothing has changed.
+    void update() {
+      if (!src || !skel || !src->get_skin()) return;
+
+      if (get_num_vertices() != src->get_num_vertices() || get_stride() != src->get_stride()) {
+        init_from_source();
+      }
+
+      skin *skn = src->get_skin();
+      unsigned new_node_version = scene_node::get_transform_version();
+      unsigned new_skin_version = skn->get_version();
+      unsigned new_src_version = src->get_vertices()->get_version();
+      if (is_posed && node_version == new_node_version && skin_version == new_skin_version && src_version == new_src_version) {
+        return;
+      }
+      bool src_changed = src_version != new_src_version;
+      node_version = new_node_version;
+      skin_version = new_skin_version;
+      src_version = new_src_version;
+      is_posed = true;
+
+      // matrices from the skin to the space of the skeleton's parent node.
+      // we are drawn with the mesh_instance's modelToWorld like any other mesh.
+      mat4t modelToParent;
+      modelToParent.loadIdentity();
+      mat4t *matrices = skel->calc_transforms(modelToParent, skn);
+      unsigned num_matrices = skn->get_num_joints();
+
+      unsigned bytes = num_matrices * sizeof(mat4t);
+      if (!src_changed && palette.size() == num_matrices && (num_matrices == 0 || !memcmp(&palette[0], matrices, bytes))) {
+        return;
+      }
+      palette.resize(num_matrices);
+      if (num_matrices) memcpy(&palette[0], matrices, bytes);
+
+      pose(num_matrices ? &palette[0] : 0, num_matrices);
+      version++;
+    }
+
+    void visit(visitor &v) {
+      mesh::visit(v);
+      v.visit(src, atom_src);
+      v.visit(skel, atom_skel);
+    }
+
+    mesh *get_src() const {
+      return src;
+    }
+
+    skeleton *get_skeleton() const {
+      return skel;
+    }
+
+    void set_skeleton(skeleton *value) {
+      if (value != skel) is_posed = false;
+      skel = value;
+    }
+
+    // changes every time the vertices are posed, eg. to know when to rebuild a mesh_bvh
+    unsigned get_version() const {
+      return version;
+    }
+  };
+}
@@ -193,6 +193,7 @@ namespace octet {
       uv_offset = get_offset(uv_slot);
 
       dest_indices.reserve(get_num_indices() * 4);
+      edges.reserve(get_num_indices() * 2);
       dest_vertices.reserve(get_num_vertices() * get_stride() * 4);
       dest_vertices.resize(get_num_vertices() * get_stride());
 
@@ -0,0 +1,175 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// (C) Andy Thomason 2012, 2013
+//
+// Modular Framework for OpenGLES2 rendering on multiple platforms.
+//
+// Flattened copy of a tree of scene_nodes for updating all the world matrices at once
+//
+// The nodes are stored breadth first with the index of each node's parent, so a
+// parent always comes before its children. The local and world matrices are in
+// two contiguous arrays and one linear sweep calculates every world matrix:
+//
+//   modelToWorld[i] = nodeToParent[i] * modelToWorld[parents[i]]
+//
+// All the nodes at one depth only depend on the depths above, so big levels are
+// shared between the cores with the thread_pool.
+//
+// example:
+//
+//   transform_hierarchy flat;
+//   ...
+//   // every frame, after animating
+//   flat.update(the_scene->get_root_node());
+//   mat4t modelToWorld = node->get_modelToWorld();
+//
+// update() reads nodeToParent from the nodes and writes the results back to their
+// cached modelToWorld, so the scene_node API stays in sync. If a child has been
+// added to any node since the last update, the flat copy is rebuilt.
+//
+
+namespace octet {
+  class transform_hierarchy {
+    enum {
+      // levels with fewer nodes than this are done on one thread
+      min_parallel_nodes = 1024,
+
+      // nodes for each task when a level is done in parallel
+      batch_size = 256,
+    };
+
+    // root of the tree we were built from.
+    // not a ref: the scene keeps us and is usually the root itself, so a ref would be a cycle.
+    // the caller keeps the root alive.
+    scene_node *root;
+
+    // scene_node::get_hierarchy_version() when we were built
+    unsigned version;
+
+    // nodes in breadth first order with the index of the parent (-1 for the root)
+    dynarray<scene_node*> nodes;
+    dynarray<int> parents;
+
+    // nodes at depth d are level_start[d] .. level_start[d+1]-1
+    dynarray<unsigned> level_start;
+
+    // matrices, one per node
+    dynarray<mat4t> nodeToParent;
+    dynarray<mat4t> modelToWorld;
+
+    // the level being swept in parallel
+    unsigned sweep_begin;
+    unsigned sweep_end;
+
+    transform_hierarchy(const transform_hierarchy &rhs) {
+      // you can't do this!
+    }
+
+    void sweep(unsigned begin, unsigned end) {
+      const int *parent = &parents[0];
+      const mat4t *local = &nodeToParent[0];
+      mat4t *world = &modelToWorld[0];
+      for (unsigned i = begin; i != end; ++i) {
+        world[i] = local[i] * world[parent[i]];
+      }
+    }
+
+    static void sweep_batch(void *context, unsigned index) {
+      transform_hierarchy *h = (transform_hierarchy*)context;
+      unsigned begin = h->sweep_begin + index * batch_size;
+      unsigned end = min(begin + (unsigned)batch_size, h->sweep_end);
+      h->sweep(begin, end);
+    }
+
+  public:
+    transform_hierarchy() {
+      root = 0;
+      version = ~0u;
+      sweep_begin = sweep_end = 0;
+    }
+
+    // flatten the tree below new_root
+    void build(scene_node *new_root) {
+      root = new_root;
+      version = scene_node::get_hierarchy_version();
+      nodes.resize(0);
+      parents.resize(0);
+      level_start.resize(0);
+      if (!new_root) return;
+
+      nodes.push_back(new_root);
+      parents.push_back(-1);
+      level_start.push_back(0);
+      unsigned begin = 0;
+      while (begin != nodes.size()) {
+        unsigned end = nodes.size();
+        level_start.push_back(end);
+        for (unsigned i = begin; i != end; ++i) {
+          scene_node *node = nodes[i];
+          for (int j = 0; j != node->get_num_children(); ++j) {
+            nodes.push_back(node->get_child(j));
+            parents.push_back((int)i);
+          }
+        }
+        begin = end;
+      }
+
+      nodeToParent.resize(nodes.size());
+      modelToWorld.resize(nodes.size());
+    }
+
+    // recalculate the world matrix of every node below new_root and store them in the nodes.
+    // does nothing if no node has changed since the last update.
+    void update(scene_node *new_root) {
+      if (new_root != root || version != scene_node::get_hierarchy_version()) {
+        build(new_root);
+      } else if (!root || !root->is_tree_dirty()) {
+        return;
+      }
+      if (nodes.size() == 0) return;
+
+      unsigned num_nodes = nodes.size();
+      for (unsigned i = 0; i != num_nodes; ++i) {
+        nodeToParent[i] = nodes[i]->get_nodeToParent();
+      }
+
+      // the root may itself have a parent outside the tree
+      scene_node *root_parent = root->get_parent();
+      modelToWorld[0] = root_parent ? nodeToParent[0] * root_parent->get_modelToWorld() : nodeToParent[0];
+
+      bool parallel = thread_pool::get_num_threads() > 1;
+      for (unsigned d = 1; d + 1 < level_start.size(); ++d) {
+        unsigned begin = level_start[d], end = level_start[d + 1];
+        if (parallel && end - begin >= min_parallel_nodes) {
+          sweep_begin = begin;
+          sweep_end = end;
+          thread_pool::run(sweep_batch, this, (end - begin + batch_size - 1) / batch_size);
+        } else {
+          sweep(begin, end);
+        }
+      }
+
+      for (unsigned i = 0; i != num_nodes; ++i) {
+        nodes[i]->set_modelToWorld(modelToWorld[i]);
+      }
+    }
+
+    unsigned get_num_nodes() const {
+      return nodes.size();
+    }
+
+    scene_node *get_node(unsigned index) const {
+      return nodes[index];
+    }
+
+    // index of the parent of a node, -1 for the root
+    int get_parent(unsigned index) const {
+      return parents[index];
+    }
+
+    // world matrices of all the nodes as of the last update()
+    const mat4t *get_modelToWorlds() const {
+      return nodes.size() ? &modelToWorld[0] : 0;
+    }
+  };
+}
@@ -34,9 +34,9 @@ namespace octet {
 
       gl_resource *indices = new gl_resource(GL_ELEMENT_ARRAY_BUFFER, isize);
       void *dp = indices->lock();
-      void *sp = src->get_indices()->lock();
+      const void *sp = src->get_indices()->lock_read_only();
       if (index_type == GL_UNSIGNED_SHORT) {
-        uint16_t *s = (uint16_t*)sp;
+        const uint16_t *s = (const uint16_t*)sp;
         uint16_t *d = (uint16_t*)dp;
         for (unsigned i = 0; i < num_indices; i += 3) {
           d[0] = s[0]; d[1] = s[1];
@@ -45,7 +45,7 @@ namespace octet {
           d += 6; s += 3;
         }
       } else { // assume GL_UNSIGNED_INT
-        uint32_t *s = (uint32_t*)sp;
+        const uint32_t *s = (const uint32_t*)sp;
         uint32_t *d = (uint32_t*)dp;
         for (unsigned i = 0; i < num_indices; i += 3) {
           d[0] = s[0]; d[1] = s[1];
@@ -56,7 +56,7 @@ namespace octet {
       }
 
       indices->unlock();
-      src->get_indices()->unlock();
+      src->get_indices()->unlock_read_only();
       set_num_indices(num_indices*2);
       set_indices( indices );
     }
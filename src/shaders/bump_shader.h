@@ -8,6 +8,12 @@
 
 namespace octet {
   class bump_shader : public shader {
+  public:
+    // skinned draws with more matrices than this are posed on the CPU (see skinned_mesh).
+    // the skinned shader has room for 96, but this leaves space on GPUs with few uniforms.
+    enum { max_skin_matrices = 64 };
+
+  private:
     // indices to use with glUniform*()
 
     GLuint modelToProjection_index; // index for model space to projection space matrix
@@ -32,7 +38,8 @@ namespace octet {
     }
 
   public:
-    void init(bool is_skinned=false) {
+    // is_instanced takes the matrices from per instance attributes instead of uniforms
+    void init(bool is_skinned=false, bool is_instanced=false) {
       // this is the vertex shader for regular geometry
       // it is called for each corner of each triangle
       // it inputs pos and uv from each corner
@@ -62,6 +69,31 @@ namespace octet {
         }
       );
 
+      // the same for instanced geometry. the matrices are attributes
+      // which change once per instance (glVertexAttribDivisor)
+      const char instanced_vertex_shader[] = SHADER_STR(
+        varying vec2 uv_;
+        varying vec3 normal_;
+        varying vec3 tangent_;
+        varying vec3 bitangent_;
+      
+        attribute vec4 pos;
+        attribute vec3 normal;
+        attribute vec3 tangent;
+        attribute vec3 bitangent;
+        attribute vec2 uv;
+        attribute mat4 instance_modelToProjection;
+        attribute mat3 instance_modelToCamera;
+      
+        void main() {
+          uv_ = uv;
+          normal_ = instance_modelToCamera * normal;
+          tangent_ = instance_modelToCamera * tangent;
+          bitangent_ = instance_modelToCamera * bitangent;
+          gl_Position = instance_modelToProjection * pos;
+        }
+      );
+
       // this is the vertex shader for skinned geometry
       // this is the shader for skinned geometry
       // it is not terribly efficient, but does the job.
@@ -160,39 +192,42 @@ namespace octet {
     
       // use the common shader code to compile and link the shaders
       // the result is a shader program
-      init_uniforms(is_skinned ? skinned_vertex_shader : vertex_shader, fragment_shader);
+      init_uniforms(is_skinned ? skinned_vertex_shader : is_instanced ? instanced_vertex_shader : vertex_shader, fragment_shader);
     }
 
     void render(const mat4t &modelToProjection, const mat4t &modelToCamera, const vec4 *light_uniforms, int num_light_uniforms, int num_lights) {
+      begin(light_uniforms, num_light_uniforms, num_lights, false);
+      set_matrices(modelToProjection, modelToCamera);
+    }
+
+    void render_skinned(const mat4t &cameraToProjection, const mat4t *modelToCamera, int num_matrices, const vec4 *light_uniforms, int num_light_uniforms, int num_lights) {
+      begin(light_uniforms, num_light_uniforms, num_lights, true);
+      set_skinned_matrices(cameraToProjection, modelToCamera, num_matrices);
+    }
+
+    // the uniforms that stay the same for a whole frame. use this once and then
+    // set_matrices() for each object (see render_queue).
+    void begin(const vec4 *light_uniforms, int num_light_uniforms, int num_lights, bool is_skinned) {
       // tell openGL to use the program
       shader::render();
 
-      // customize the program with uniforms
-      glUniformMatrix4fv(modelToProjection_index, 1, GL_FALSE, modelToProjection.get());
-      glUniformMatrix4fv(modelToCamera_index, 1, GL_FALSE, modelToCamera.get());
-
       glUniform4fv(light_uniforms_index, num_light_uniforms, (float*)light_uniforms);
       glUniform1i(num_lights_index, num_lights);
 
-      // we use textures 0-3 for material properties.
+      // we use textures 0-5 for material properties.
       static const GLint samplers[] = { 0, 1, 2, 3, 4, 5 };
-      glUniform1iv(samplers_index, 6, samplers);
+      glUniform1iv(samplers_index, is_skinned ? 5 : 6, samplers);
     }
 
-    void render_skinned(const mat4t &cameraToProjection, const mat4t *modelToCamera, int num_matrices, const vec4 *light_uniforms, int num_light_uniforms, int num_lights) {
-      // tell openGL to use the program
-      shader::render();
+    // per object uniforms
+    void set_matrices(const mat4t &modelToProjection, const mat4t &modelToCamera) {
+      glUniformMatrix4fv(modelToProjection_index, 1, GL_FALSE, modelToProjection.get());
+      glUniformMatrix4fv(modelToCamera_index, 1, GL_FALSE, modelToCamera.get());
+    }
 
-      // customize the program with uniforms
+    void set_skinned_matrices(const mat4t &cameraToProjection, const mat4t *modelToCamera, int num_matrices) {
       glUniformMatrix4fv(cameraToProjection_index, 1, GL_FALSE, cameraToProjection.get());
       glUniformMatrix4fv(modelToCamera_index, num_matrices, GL_FALSE, (float*)modelToCamera);
-
-      glUniform4fv(light_uniforms_index, num_light_uniforms, (float*)light_uniforms);
-      glUniform1i(num_lights_index, num_lights);
-
-      // we use textures 0-3 for material properties.
-      static const GLint samplers[] = { 0, 1, 2, 3, 4 };
-      glUniform1iv(samplers_index, 5, samplers);
     }
   };
 }
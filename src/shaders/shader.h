@@ -51,6 +51,8 @@ namespace octet {
       glBindAttribLocation(program, attribute_blendindices, "blendindices");
       glBindAttribLocation(program, attribute_color, "color");
       glBindAttribLocation(program, attribute_uv, "uv");
+      glBindAttribLocation(program, attribute_instance_modelToCamera, "instance_modelToCamera");
+      glBindAttribLocation(program, attribute_instance_modelToProjection, "instance_modelToProjection");
       glLinkProgram(program);
 
       program_ = program;